@@ -0,0 +1,362 @@
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_linux.h"
+
+#define LINUX_SPI_SPEED_HZ   5000000
+#define LINUX_EVENT_BATCH    16     // Line events read per system call
+#define LINUX_CONSUMER       "cc1101"
+
+/* SPI: every access is one SPI_IOC_MESSAGE, its transfers are clocked back to back */
+
+static int linux_spi_message(cc1101_linux_t *lx, struct spi_ioc_transfer *xfer, unsigned count)
+{
+    unsigned i;
+
+    for (i = 0; i < count; i++){
+        xfer[i].speed_hz = lx->speed_hz;
+        xfer[i].bits_per_word = 8;
+    }
+    lx->messages++;
+    return (ioctl(lx->spi_fd, SPI_IOC_MESSAGE(count), xfer) < 0) ? 1 : 0;
+}
+
+static int linux_spi_transfer(void *ctx, uint8_t *tx, uint8_t *rx, uint8_t len)
+{
+    struct spi_ioc_transfer xfer[1];
+
+    memset(xfer, 0, sizeof(xfer));
+    xfer[0].tx_buf = (uintptr_t) tx;
+    xfer[0].rx_buf = (uintptr_t) rx;
+    xfer[0].len = len;
+    return linux_spi_message((cc1101_linux_t *) ctx, xfer, 1);
+}
+
+// Header and payload under one chip select. A NULL tx clocks zeros out, a NULL rx drops the payload.
+static unsigned linux_spi_sg(struct spi_ioc_transfer *xfer, const uint8_t *cmd, uint8_t *status, const uint8_t *tx, uint8_t *rx, uint8_t len)
+{
+    xfer[0].tx_buf = (uintptr_t) cmd;
+    xfer[0].rx_buf = (uintptr_t) status;
+    xfer[0].len = 1;
+    if (len == 0){
+        return 1;
+    }
+    xfer[1].tx_buf = (uintptr_t) tx;
+    xfer[1].rx_buf = (uintptr_t) rx;
+    xfer[1].len = len;
+    return 2;
+}
+
+static int linux_spi_transfer_sg(void *ctx, uint8_t cmd, uint8_t *status, const uint8_t *tx, uint8_t *rx, uint8_t len)
+{
+    struct spi_ioc_transfer xfer[2];
+
+    memset(xfer, 0, sizeof(xfer));
+    return linux_spi_message((cc1101_linux_t *) ctx, xfer, linux_spi_sg(xfer, &cmd, status, tx, rx, len));
+}
+
+// Queued transactions in one message, chip select released after the last transfer of each
+static int linux_spi_batch(void *ctx, const cc11xx_spi_op_t *op, uint8_t count, uint8_t *status)
+{
+    struct spi_ioc_transfer xfer[2 * CC11xx_SPI_QUEUE_DEPTH];
+    unsigned i, n = 0;
+
+    memset(xfer, 0, sizeof(xfer));
+    for (i = 0; i < count; i++){
+        n += linux_spi_sg(&xfer[n], &op[i].cmd, &status[i], op[i].tx, op[i].rx, op[i].len);
+        xfer[n - 1].cs_change = (i + 1 < count) ? 1 : 0;
+    }
+    return linux_spi_message((cc1101_linux_t *) ctx, xfer, n);
+}
+
+/* GDO levels, interrupt mask and backoff timer. The lines were requested GDO0 first. */
+
+static int linux_gdo_level(cc1101_linux_t *lx, uint64_t mask)
+{
+    struct gpio_v2_line_values values;
+
+    values.bits = 0;
+    values.mask = mask;
+    if (ioctl(lx->line_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0){
+        return 0;
+    }
+    return (values.bits & mask) ? 1 : 0;
+}
+
+static int linux_gdo0(void *ctx)
+{
+    return linux_gdo_level((cc1101_linux_t *) ctx, 1);
+}
+
+static int linux_gdo2(void *ctx)
+{
+    return linux_gdo_level((cc1101_linux_t *) ctx, 2);
+}
+
+static void linux_it_disable(void *ctx)
+{
+    pthread_mutex_lock(&((cc1101_linux_t *) ctx)->lock);
+}
+
+static void linux_it_enable(void *ctx)
+{
+    pthread_mutex_unlock(&((cc1101_linux_t *) ctx)->lock);
+}
+
+static void linux_timer_start(void *ctx, uint32_t us)
+{
+    cc1101_linux_t *lx = (cc1101_linux_t *) ctx;
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = us / 1000000;
+    its.it_value.tv_nsec = (us % 1000000) * 1000;
+    if (us == 0){
+        its.it_value.tv_nsec = 1; // A zero value would disarm it
+    }
+    timerfd_settime(lx->timer_fd, 0, &its, NULL);
+}
+
+const cc11xx_backend_t cc1101_linux_backend = {
+    linux_spi_transfer,
+    linux_spi_transfer_sg,
+    NULL,                   // No background transfers: spidev ioctls are blocking
+    NULL,
+    linux_gdo0,
+    linux_gdo2,
+    linux_it_disable,
+    linux_it_enable,
+    linux_timer_start,
+    linux_spi_batch
+};
+
+// Edge events of both lines in kernel order, one ISR call each
+static void linux_gdo_events(cc1101_linux_t *lx)
+{
+    struct gpio_v2_line_event event[LINUX_EVENT_BATCH];
+    ssize_t ret;
+    unsigned i, n;
+
+    while ((ret = read(lx->line_fd, event, sizeof(event))) > 0){
+        n = (unsigned) ret / sizeof(event[0]);
+        for (i = 0; i < n; i++){
+            if (event[i].seqno != lx->line_seqno + 1){
+                lx->events_lost += event[i].seqno - lx->line_seqno - 1;
+            }
+            lx->line_seqno = event[i].seqno;
+            lx->events++;
+            if (event[i].offset == lx->gdo0_line){
+                gdo0_isr(lx->radio);
+            }else{
+                gdo2_isr(lx->radio);
+            }
+        }
+        if (n < LINUX_EVENT_BATCH){
+            break;
+        }
+    }
+}
+
+static void *linux_event_thread(void *arg)
+{
+    cc1101_linux_t *lx = (cc1101_linux_t *) arg;
+    struct epoll_event ev[3];
+    uint64_t expirations;
+    int i, n;
+
+    for (;;){
+        n = epoll_wait(lx->epoll_fd, ev, 3, -1);
+        if (n < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            break;
+        }
+        for (i = 0; i < n; i++){
+            if (ev[i].data.fd == lx->stop_fd){
+                return NULL;
+            }
+        }
+        pthread_mutex_lock(&lx->lock);
+        for (i = 0; i < n; i++){
+            if (ev[i].data.fd == lx->line_fd){
+                linux_gdo_events(lx);
+            }else if ((ev[i].data.fd == lx->timer_fd) && (read(lx->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations))){
+                radio_csma_timer_isr(lx->radio); // Nothing to read when it was restarted meanwhile
+            }
+        }
+        pthread_mutex_unlock(&lx->lock);
+    }
+    return NULL;
+}
+
+static int linux_epoll_add(cc1101_linux_t *lx, int fd)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    return (epoll_ctl(lx->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) ? 1 : 0;
+}
+
+static int linux_spi_open(cc1101_linux_t *lx, const cc1101_linux_config_t *config)
+{
+    uint8_t mode = SPI_MODE_0, bits = 8;
+
+    lx->spi_fd = open(config->spi_dev, O_RDWR | O_CLOEXEC);
+    if (lx->spi_fd < 0){
+        return 1;
+    }
+    lx->speed_hz = config->spi_speed_hz ? config->spi_speed_hz : LINUX_SPI_SPEED_HZ;
+    if ((ioctl(lx->spi_fd, SPI_IOC_WR_MODE, &mode) < 0)
+     || (ioctl(lx->spi_fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0)
+     || (ioctl(lx->spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &lx->speed_hz) < 0)){
+        return 1;
+    }
+    return 0;
+}
+
+static int linux_gpio_open(cc1101_linux_t *lx, const cc1101_linux_config_t *config)
+{
+    struct gpio_v2_line_request request;
+    int chip_fd, ret;
+
+    if (config->gdo0_line == config->gdo2_line){
+        return 1;
+    }
+    chip_fd = open(config->gpio_chip, O_RDWR | O_CLOEXEC);
+    if (chip_fd < 0){
+        return 1;
+    }
+    memset(&request, 0, sizeof(request));
+    request.offsets[0] = config->gdo0_line;
+    request.offsets[1] = config->gdo2_line;
+    request.num_lines = 2;
+    strncpy(request.consumer, LINUX_CONSUMER, sizeof(request.consumer) - 1);
+    request.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    ret = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &request);
+    close(chip_fd);
+    if (ret < 0){
+        return 1;
+    }
+    lx->line_fd = request.fd;
+    lx->gdo0_line = config->gdo0_line;
+    if (fcntl(lx->line_fd, F_SETFL, fcntl(lx->line_fd, F_GETFL) | O_NONBLOCK) < 0){
+        return 1;
+    }
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Open the devices of a radio and make lx the backend of spi_parms. Returns 1 on error, with
+// errno from the failing call and nothing left open.
+int cc1101_linux_open(cc1101_linux_t *lx, const cc1101_linux_config_t *config, spi_parms_t *spi_parms)
+// ------------------------------------------------------------------------------------------------
+{
+    pthread_mutexattr_t attr;
+    int err;
+
+    memset(lx, 0, sizeof(*lx));
+    lx->spi_fd = lx->line_fd = lx->timer_fd = lx->stop_fd = lx->epoll_fd = -1;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&lx->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    if (linux_spi_open(lx, config) || linux_gpio_open(lx, config)){
+        goto error;
+    }
+    lx->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    lx->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    lx->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if ((lx->timer_fd < 0) || (lx->stop_fd < 0) || (lx->epoll_fd < 0)
+     || linux_epoll_add(lx, lx->line_fd) || linux_epoll_add(lx, lx->timer_fd) || linux_epoll_add(lx, lx->stop_fd)){
+        goto error;
+    }
+    spi_parms->backend = &cc1101_linux_backend;
+    spi_parms->backend_ctx = lx;
+    return 0;
+
+error:
+    err = errno;
+    cc1101_linux_close(lx);
+    errno = err;
+    return 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Start delivering the GDO and timer interrupts to radio, once enable_isr_routine() is done
+int cc1101_linux_start(cc1101_linux_t *lx, radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    lx->radio = radio;
+    if (pthread_create(&lx->thread, NULL, linux_event_thread, lx) != 0){
+        return 1;
+    }
+    lx->running = 1;
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Stop the event thread and close the devices
+void cc1101_linux_close(cc1101_linux_t *lx)
+// ------------------------------------------------------------------------------------------------
+{
+    uint64_t one = 1;
+    int *fd[] = { &lx->epoll_fd, &lx->stop_fd, &lx->timer_fd, &lx->line_fd, &lx->spi_fd };
+    unsigned i;
+
+    if (lx->running){
+        if (write(lx->stop_fd, &one, sizeof(one)) == sizeof(one)){
+            pthread_join(lx->thread, NULL);
+        }
+        lx->running = 0;
+    }
+    for (i = 0; i < sizeof(fd) / sizeof(fd[0]); i++){
+        if (*fd[i] >= 0){
+            close(*fd[i]);
+            *fd[i] = -1;
+        }
+    }
+}
+
+uint64_t cc1101_linux_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void cc1101_linux_sleep_ms(uint32_t ms)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long) (ms % 1000) * 1000000L;
+    while ((nanosleep(&ts, &ts) < 0) && (errno == EINTR)){
+    }
+}
+
+void cc1101_linux_sleep_us(uint32_t us)
+{
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (long) (us % 1000000) * 1000L;
+    while ((nanosleep(&ts, &ts) < 0) && (errno == EINTR)){
+    }
+}
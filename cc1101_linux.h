@@ -0,0 +1,77 @@
+#ifndef __CC1101_LINUX_H__
+#define __CC1101_LINUX_H__
+
+/*
+ * Linux userspace backend.
+ *
+ * SPI goes through spidev ioctls: a burst access is one SPI_IOC_MESSAGE with
+ * the header and the payload as two transfers under the same chip select, and
+ * the transactions queued by an interrupt handler run as one SPI_IOC_MESSAGE
+ * (spi_batch) with the chip select released between them. The chip ready wait
+ * (SO low after CS) cannot be done with spidev: the chip must not be put in
+ * SLEEP or XOFF while this backend drives it.
+ *
+ * GDO0 and GDO2 are requested together from the GPIO character device (uAPI
+ * v2) with edge detection on both edges. An event thread waits on the line
+ * events and on a timerfd (CSMA backoff timer) with epoll and calls gdo0_isr,
+ * gdo2_isr and radio_csma_timer_isr with the radio lock held. The lock is a
+ * recursive mutex taken by disable_IT(), so driver calls from the callbacks
+ * work as they do on a microcontroller. Events of both lines are handled in
+ * the order the kernel queued them; like on a microcontroller the ISRs sample
+ * the live line levels (one ioctl each).
+ *
+ * Use:
+ *     cc1101_linux_open(&lx, &config, &spi);     // Sets spi.backend
+ *     init_radio_config(&spi, &radio_parms);
+ *     enable_isr_routine(&radio, &spi, &radio_parms);
+ *     cc1101_linux_start(&lx, &radio);
+ *
+ * Built with CC11xx_LINUX, which gives cc1101_wrapper.h its clock and sleep.
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "cc1101_routine.h"
+
+/* Devices of one radio */
+typedef struct cc1101_linux_config_s
+{
+    const char *spi_dev;        // spidev node, e.g. "/dev/spidev0.0"
+    uint32_t    spi_speed_hz;   // SCLK, 0 for 5 MHz (burst accesses are limited to 6.5 MHz)
+    const char *gpio_chip;      // GPIO character device of the GDO lines, e.g. "/dev/gpiochip0"
+    uint32_t    gdo0_line;      // Line offsets on gpio_chip
+    uint32_t    gdo2_line;
+} cc1101_linux_config_t;
+
+/* Backend context: spi_parms_t backend_ctx of the radio */
+typedef struct cc1101_linux_s
+{
+    int               spi_fd;
+    int               line_fd;      // GDO0/GDO2 line request
+    int               timer_fd;     // CSMA backoff timer
+    int               stop_fd;      // eventfd ending the event thread
+    int               epoll_fd;
+    uint32_t          speed_hz;
+    uint32_t          gdo0_line;
+    uint32_t          line_seqno;   // Last line event sequence number
+    uint32_t          events;       // Edge events handled
+    uint32_t          events_lost;  // Edge events dropped by the kernel (event buffer overflow)
+    uint32_t          messages;     // SPI_IOC_MESSAGE calls
+    radio_int_data_t  *radio;
+    pthread_t         thread;
+    pthread_mutex_t   lock;         // Radio lock: held by the event thread and by disable_IT()
+    uint8_t           running;
+} cc1101_linux_t;
+
+extern const cc11xx_backend_t cc1101_linux_backend;
+
+int  cc1101_linux_open(cc1101_linux_t *lx, const cc1101_linux_config_t *config, spi_parms_t *spi_parms);
+int  cc1101_linux_start(cc1101_linux_t *lx, radio_int_data_t *radio);
+void cc1101_linux_close(cc1101_linux_t *lx);
+
+uint64_t cc1101_linux_now_ns(void);
+void     cc1101_linux_sleep_ms(uint32_t ms);
+void     cc1101_linux_sleep_us(uint32_t us);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef __CC1101_PROFILES_H__
+#define __CC1101_PROFILES_H__
+
+/*
+ * Register words for data rate, deviation and channel bandwidth as integer constant expressions.
+ * With constant arguments the compiler folds them, so a whole modem profile can be written as
+ * static const data; with run-time arguments they are plain integer arithmetic (no libm).
+ *
+ *   o DRATE = (Fxosc / 2^28) * (256 + DRATE_M) * 2^DRATE_E
+ *   o CHANBW = Fxosc / (8(4+CHANBW_M) * 2^CHANBW_E)
+ *   o DEVIATION = (Fxosc / 2^17) * (8 + DEVIATION_M) * 2^DEVIATION_E
+ *
+ * Mantissas are truncated as the float formulas do. Out of range requests saturate to the lowest
+ * or highest setting. The deviation of a rate_t and modulation index keeps 16 fractional bits
+ * (CC11xx_MOD_INDEX_Q16) so that it is not truncated to the Hz before its mantissa is.
+ */
+
+#include <stdint.h>
+
+// Crystal the rate table in cc1101_routine.c is built for
+#ifndef CC11xx_F_XTAL
+#define CC11xx_F_XTAL   26000000
+#endif
+
+// (v * 2^s) >= (fx * 2^e): the exponent e is reachable for value v
+#define CC11xx_EXP_FITS(v, s, fx, e)    (((uint64_t) (v) << (s)) >= ((uint64_t) (fx) << (e)))
+
+// Largest exponent 0..7 reachable for value v
+#define CC11xx_EXP8(v, s, fx) \
+    (CC11xx_EXP_FITS(v, s, fx, 7) ? 7 : CC11xx_EXP_FITS(v, s, fx, 6) ? 6 : \
+     CC11xx_EXP_FITS(v, s, fx, 5) ? 5 : CC11xx_EXP_FITS(v, s, fx, 4) ? 4 : \
+     CC11xx_EXP_FITS(v, s, fx, 3) ? 3 : CC11xx_EXP_FITS(v, s, fx, 2) ? 2 : \
+     CC11xx_EXP_FITS(v, s, fx, 1) ? 1 : 0)
+
+// Largest exponent 0..15 reachable for value v
+#define CC11xx_EXP16(v, s, fx) \
+    (CC11xx_EXP_FITS(v, s, fx, 15) ? 15 : CC11xx_EXP_FITS(v, s, fx, 14) ? 14 : \
+     CC11xx_EXP_FITS(v, s, fx, 13) ? 13 : CC11xx_EXP_FITS(v, s, fx, 12) ? 12 : \
+     CC11xx_EXP_FITS(v, s, fx, 11) ? 11 : CC11xx_EXP_FITS(v, s, fx, 10) ? 10 : \
+     CC11xx_EXP_FITS(v, s, fx, 9) ? 9 : CC11xx_EXP_FITS(v, s, fx, 8) ? 8 : \
+     CC11xx_EXP8(v, s, fx))
+
+// Mantissa (v * 2^s) / (fx * 2^e) - base, truncated and clamped to 0..max
+#define CC11xx_MANT_Q(v, s, fx, e)      (((uint64_t) (v) << (s)) / ((uint64_t) (fx) << (e)))
+#define CC11xx_MANT(v, s, fx, e, base, max) \
+    (CC11xx_MANT_Q(v, s, fx, e) < (base) ? 0 : \
+     CC11xx_MANT_Q(v, s, fx, e) - (base) > (max) ? (max) : \
+     CC11xx_MANT_Q(v, s, fx, e) - (base))
+
+// Data rate words for rate (Baud)
+#define CC11xx_DRATE_E(rate, fx)        CC11xx_EXP16(rate, 20, fx)
+#define CC11xx_DRATE_M(rate, fx)        CC11xx_MANT(rate, 28, fx, CC11xx_DRATE_E(rate, fx), 256, 255)
+
+// Deviation words for dev_q16 (Hz * 2^16)
+#define CC11xx_DEVIAT_E_Q16(dev_q16, fx) CC11xx_EXP8(dev_q16, 14, (uint64_t) (fx) << 16)
+#define CC11xx_DEVIAT_M_Q16(dev_q16, fx) \
+    CC11xx_MANT(dev_q16, 17, (uint64_t) (fx) << 16, CC11xx_DEVIAT_E_Q16(dev_q16, fx), 8, 7)
+
+// Deviation words for dev (Hz)
+#define CC11xx_DEVIAT_E(dev, fx)        CC11xx_DEVIAT_E_Q16((uint64_t) (dev) << 16, fx)
+#define CC11xx_DEVIAT_M(dev, fx)        CC11xx_DEVIAT_M_Q16((uint64_t) (dev) << 16, fx)
+
+// Modulation index as a Q16 fixed point number (e.g. 0.5 is 32768), for constant arguments
+#define CC11xx_MOD_INDEX_Q16(h)         ((uint32_t) ((h) * 65536.0f + 0.5f))
+
+// Deviation (Hz * 2^16) of a data rate (Baud) for a Q16 modulation index
+#define CC11xx_RATE_DEVIAT_Q16(rate, h_q16) ((uint64_t) (rate) * (h_q16))
+
+// Channel bandwidth step (4*CHANBW_E + CHANBW_M) for a 26 MHz crystal: widest step below bw (Hz),
+// the narrowest one if none is
+#define CC11xx_CHANBW_INDEX(bw) \
+    ((bw) > 812000 ? 0 : (bw) > 650000 ? 1 : (bw) > 541000 ? 2 : (bw) > 464000 ? 3 : \
+     (bw) > 406000 ? 4 : (bw) > 325000 ? 5 : (bw) > 270000 ? 6 : (bw) > 232000 ? 7 : \
+     (bw) > 203000 ? 8 : (bw) > 162000 ? 9 : (bw) > 135000 ? 10 : (bw) > 116000 ? 11 : \
+     (bw) > 102000 ? 12 : (bw) > 81000 ? 13 : (bw) > 68000 ? 14 : 15)
+#define CC11xx_CHANBW_E(bw)             (CC11xx_CHANBW_INDEX(bw) >> 2)
+#define CC11xx_CHANBW_M(bw)             (CC11xx_CHANBW_INDEX(bw) & 0x03)
+
+// Carson's rule bandwidth for a data rate and deviation
+#define CC11xx_CARSON_BW(rate, dev)     (2 * ((rate) + (dev)))
+
+// Same with the deviation in Hz * 2^16, rounded up to the Hz so that CC11xx_CHANBW_INDEX() picks the
+// step the exact value would
+#define CC11xx_CARSON_BW_Q16(rate, dev_q16) \
+    ((uint32_t) ((2 * (((uint64_t) (rate) << 16) + (dev_q16)) + 0xFFFF) >> 16))
+
+// Whole register values
+#define CC11xx_MDMCFG4_WORD(bw, rate, fx)   ((CC11xx_CHANBW_E(bw) << 6) | (CC11xx_CHANBW_M(bw) << 4) | CC11xx_DRATE_E(rate, fx))
+#define CC11xx_MDMCFG3_WORD(rate, fx)       CC11xx_DRATE_M(rate, fx)
+#define CC11xx_DEVIATN_WORD(dev, fx)        ((CC11xx_DEVIAT_E(dev, fx) << 4) | CC11xx_DEVIAT_M(dev, fx))
+#define CC11xx_DEVIATN_WORD_Q16(dev_q16, fx) ((CC11xx_DEVIAT_E_Q16(dev_q16, fx) << 4) | CC11xx_DEVIAT_M_Q16(dev_q16, fx))
+
+#endif
@@ -1,338 +1,1375 @@
 #include <string.h>
 #include <stdlib.h>
-#include <math.h>
 
 #include "cc1101_routine.h"
+#include "cc1101_profiles.h"
 #include "cc1101_wrapper.h"
 
-#define TX_FIFO_REFILL 58 // With the default FIFO thresholds selected this is the number of bytes to refill the Tx FIFO
-#define RX_FIFO_UNLOAD 59 // With the default FIFO thresholds selected this is the number of bytes to unload from the Rx FIFO
 
-static spi_parms_t spi_parms_it;
-radio_int_data_t radio_int_data;
-static bool init_radio = false;
+static uint8_t radio_count; // Radios set up so far, gives their id
 
-static uint8_t rx_aux_buffer[CC11xx_FIFO_SIZE];
+typedef char rx_ring_depth_is_power_of_two[((CC11xx_RX_RING_DEPTH & (CC11xx_RX_RING_DEPTH - 1)) == 0) ? 1 : -1];
+#ifdef CC11xx_TRACE
+typedef char trace_depth_is_power_of_two[((CC11xx_TRACE_DEPTH & (CC11xx_TRACE_DEPTH - 1)) == 0) ? 1 : -1];
 
-volatile float last_rssi;
-volatile uint8_t last_lqi;
-
-static float chanbw_limits[] = {
-    812000.0, 650000.0, 541000.0, 464000.0, 406000.0, 325000.0, 270000.0, 232000.0,
-    203000.0, 162000.0, 135000.0, 116000.0, 102000.0, 81000.0, 68000.0, 58000.0
+radio_trace_t radio_trace = {
+    .magic   = CC11xx_TRACE_MAGIC,
+    .version = CC11xx_TRACE_VERSION,
+    .depth   = CC11xx_TRACE_DEPTH,
+    .head    = 0,
+#ifdef CC11xx_CYCLES
+    .clock   = 1,
+#else
+    .clock   = 0,
+#endif
+    .entry   = {{0}}
 };
 
-static uint32_t rate_values[] = {
-    50, 110, 300, 600, 1200, 2400, 4800, 9600,
-    14400, 19200, 28800, 38400, 57600, 76800, 115200,
-};
+static void trace_record(radio_int_data_t *radio, uint8_t event, uint32_t arg)
+{
+    radio_trace_entry_t *entry = &radio_trace.entry[radio_trace.head++ & (CC11xx_TRACE_DEPTH - 1)];
+
+#ifdef CC11xx_CYCLES
+    entry->timestamp = CC11xx_CYCLES();
+#else
+    entry->timestamp = CC11xx_TIMESTAMP();
+#endif
+    entry->byte_index = (uint16_t) radio->byte_index;
+    entry->bytes_remaining = (uint16_t) radio->bytes_remaining;
+    entry->event = event;
+    entry->state = radio->spi_parms ? radio->spi_parms->chip_state : 0;
+    entry->arg = (arg > 0xFF) ? 0xFF : (uint8_t) arg;
+    entry->mode = (uint8_t) ((radio->mode & 0x0F) | (radio->id << 4));
+}
 
+#define TRACE_EVENT(radio, event, arg)  trace_record(radio, event, arg)
+#else
+#define TRACE_EVENT(radio, event, arg)  do { } while (0)
+#endif
 
-// ------------------------------------------------------------------------------------------------
-// Processes packets up to 255 bytes
-void gdo0_isr(void)
-// ------------------------------------------------------------------------------------------------
+typedef char tx_queue_depth_is_power_of_two[((CC11xx_TX_QUEUE_DEPTH & (CC11xx_TX_QUEUE_DEPTH - 1)) == 0) ? 1 : -1];
+
+/* The interrupt handlers and completion callbacks queue their transactions without checking the
+ * return of CC_SPISubmit(): their chains follow each other (rx_unloading, rx_eop_pending, one TX
+ * refill at a time) and the longest, the RX restart (SIDLE, SFRX, PKTCTRL0, MCSM1, IOCFG2, SRX),
+ * must fit in the queue. */
+#define SPI_CHAIN_MAX   6
+typedef char spi_queue_holds_longest_chain[(CC11xx_SPI_QUEUE_DEPTH >= SPI_CHAIN_MAX) ? 1 : -1];
+
+/* Backend of a radio: the functions of spi_parms->backend when the application set them, the
+ * cc1101_wrapper.h bindings otherwise */
+
+static int backend_transfer(spi_parms_t *spi_parms, uint8_t *tx, uint8_t *rx, uint8_t len)
 {
-    uint8_t int_line, status;
-    if (init_radio == false){
-        return;
+    if (spi_parms->backend){
+        return spi_parms->backend->spi_transfer(spi_parms->backend_ctx, tx, rx, len);
     }
-    int_line = CC11xx_GDO0(); // Sense interrupt line to determine if it was a raising or falling edge
+    return SPI_TRANSFER(tx, rx, len);
+}
 
-    if (radio_int_data.mode == RADIOMODE_RX){
-        if (int_line){         
-            radio_int_data.byte_index = 0;
-            radio_int_data.rx_count = radio_int_data.radio_parms->packet_length;
-            radio_int_data.bytes_remaining = radio_int_data.rx_count;
-            radio_int_data.packet_receive = 1; // reception is in progress
-        }else{
-            if (radio_int_data.packet_receive){
+static int backend_transfer_sg(spi_parms_t *spi_parms, uint8_t cmd, uint8_t *status, const uint8_t *tx, uint8_t *rx, uint8_t len)
+{
+    if (spi_parms->backend){
+        return spi_parms->backend->spi_transfer_sg(spi_parms->backend_ctx, cmd, status, tx, rx, len);
+    }
+    return SPI_TRANSFER_SG(cmd, status, tx, rx, len);
+}
 
-                CC_SPIReadStatus(radio_int_data.spi_parms, CC11xxRXBYTES, &status);
-                if (status&0x80 == 0x80){ /* Overflow */
-                    radio_turn_idle(radio_int_data.spi_parms);
-                    radio_int_data.mode = RADIOMODE_NONE;
-                    radio_int_data.packet_receive = 0; // reception is done                    
-                }else{
-                    CC_SPIReadBurstReg(radio_int_data.spi_parms, CC11xx_RXFIFO, rx_aux_buffer, radio_int_data.bytes_remaining);
-                    memcpy((uint8_t *) &(radio_int_data.rx_buf[radio_int_data.byte_index]), rx_aux_buffer, radio_int_data.bytes_remaining);
-                    radio_int_data.byte_index += radio_int_data.bytes_remaining;
-                    radio_int_data.bytes_remaining = 0;
-
-                    radio_int_data.mode = RADIOMODE_NONE;
-                    radio_int_data.packet_receive = 0; // reception is done
-    								
-                    /* get lqi and rssi */
-                    CC_SPIReadStatus(radio_int_data.spi_parms, CC11xx_LQI, &status);
-                    if ( (status&0x80) == 0x80){
-                    	radio_int_data.packet_rx_count++;
-                    }
-                    last_lqi = status&0x7F;
-                    CC_SPIReadStatus(radio_int_data.spi_parms, CC11xx_RSSI, &status);
-                    last_rssi = rssi_dbm(status);
-			    }
-                radio_turn_rx_isr(radio_int_data.spi_parms);
-            }
-        }    
-    }else if (radio_int_data.mode == RADIOMODE_TX){
-        if (int_line){
-            radio_int_data.packet_send = 1; // Assert packet transmission after sync has been sent
-        }else{
-            if (radio_int_data.packet_send){
-                CC_SPIReadStatus(radio_int_data.spi_parms, CC11xxTXBYTES, &status);
-                if (status&0x80 == 0x80){ /* Underflow */
-                    radio_int_data.mode = RADIOMODE_NONE;
-                    radio_int_data.packet_send = 0; // De-assert packet transmission after packet has been sent
-                    radio_turn_idle(radio_int_data.spi_parms);
-                }else{
-                    radio_int_data.mode = RADIOMODE_NONE;
-                    radio_int_data.packet_send = 0; // De-assert packet transmission after packet has been sent
-                    radio_int_data.packet_tx_count++;
-                    if ((radio_int_data.bytes_remaining)){
-                        radio_turn_idle(radio_int_data.spi_parms);          
-                    }
-                }
-            }
-            radio_turn_rx_isr(radio_int_data.spi_parms);
+// Start a transfer in the background, CC_SPIAsyncComplete(spi_parms) is called at its end.
+// Returns -1 when the backend can only run it blocking.
+static int backend_start(spi_parms_t *spi_parms, uint8_t cmd, uint8_t *status, const uint8_t *tx, uint8_t *rx, uint8_t len)
+{
+    if (spi_parms->backend){
+        if (spi_parms->backend->spi_start == NULL){
+            return -1;
         }
+        return spi_parms->backend->spi_start(spi_parms->backend_ctx, cmd, status, tx, rx, len, CC_SPIAsyncComplete, spi_parms);
     }
+#ifdef SPI_TRANSFER_SG_START
+    return SPI_TRANSFER_SG_START(cmd, status, tx, rx, len, CC_SPIAsyncComplete, spi_parms);
+#else
+    return -1;
+#endif
 }
 
-// ------------------------------------------------------------------------------------------------
-// Processes packets that do not fit in Rx or Tx FIFOs and 255 bytes long maximum
-// FIFO threshold interrupt handler 
-void gdo2_isr(void)
-// ------------------------------------------------------------------------------------------------
+static void backend_wait(spi_parms_t *spi_parms)
 {
-    uint8_t int_line, bytes_to_send;
-    if (init_radio == false){
+    if (spi_parms->backend){
+        if (spi_parms->backend->spi_wait){
+            spi_parms->backend->spi_wait(spi_parms->backend_ctx);
+        }
         return;
     }
-    int_line = CC11xx_GDO2(); // Sense interrupt line to determine if it was a raising or falling edge
+    CC11xx_SPI_WAIT();
+}
 
-    if ((radio_int_data.mode == RADIOMODE_RX) && (int_line)){
-        if (radio_int_data.packet_receive){
-            /* if this shit wants to write but rx_buf will overload, just break */
-            CC_SPIReadBurstReg(radio_int_data.spi_parms, CC11xx_RXFIFO, rx_aux_buffer, RX_FIFO_UNLOAD);
-            /* Check for status byte in each */
-            memcpy((uint8_t *) &(radio_int_data.rx_buf[radio_int_data.byte_index]), rx_aux_buffer, RX_FIFO_UNLOAD);
-            radio_int_data.byte_index += RX_FIFO_UNLOAD;
-            radio_int_data.bytes_remaining -= RX_FIFO_UNLOAD;    
-            return;        
-        }
+static int backend_gdo0(spi_parms_t *spi_parms)
+{
+    if (spi_parms->backend){
+        return spi_parms->backend->gdo0(spi_parms->backend_ctx);
     }
-    if ((radio_int_data.mode == RADIOMODE_TX) && (!int_line)){
-        if ((radio_int_data.packet_send) && (radio_int_data.bytes_remaining > 0)){
-            if (radio_int_data.bytes_remaining < TX_FIFO_REFILL){
-                bytes_to_send = radio_int_data.bytes_remaining;
-            }else{
-                bytes_to_send = TX_FIFO_REFILL;
-            }
-            CC_SPIWriteBurstReg(radio_int_data.spi_parms, CC11xx_TXFIFO, (uint8_t *) &(radio_int_data.tx_buf[radio_int_data.byte_index]), bytes_to_send);
+    return CC11xx_GDO0();
+}
 
-            /* Check for status byte in each */
-            radio_int_data.byte_index += bytes_to_send;
-            radio_int_data.bytes_remaining -= bytes_to_send;
-            return;
-        }
+static int backend_gdo2(spi_parms_t *spi_parms)
+{
+    if (spi_parms->backend){
+        return spi_parms->backend->gdo2(spi_parms->backend_ctx);
     }
+    return CC11xx_GDO2();
 }
 
-int set_freq_parameters(float freq_hz, float freq_if, float freq_off, radio_parms_t * radio_parms)
+static void backend_it_disable(spi_parms_t *spi_parms)
 {
-    radio_parms->freq_hz        = freq_hz;
-    radio_parms->f_if           = freq_if;
-		radio_parms->f_off 					= freq_off;
-
-    /* Set the nominal parameters */
-    radio_parms->f_xtal        = 26000000;
-    radio_parms->chanspc_m     = 0;                // Do not use channel spacing for the moment defaulting to 0
-    radio_parms->chanspc_e     = 0;                // Do not use channel spacing for the moment defaulting to 0
-		
-		return 0;
+    if (spi_parms->backend){
+        spi_parms->backend->it_disable(spi_parms->backend_ctx);
+        return;
+    }
+    CC11xx_IT_DISABLE();
 }
 
-int set_sync_parameters(preamble_t preamble, sync_word_t sync_word, uint32_t timeout_ms, radio_parms_t * radio_parms)
+static void backend_it_enable(spi_parms_t *spi_parms)
 {
-    radio_parms->preamble       = preamble;
-    radio_parms->sync_ctl       = sync_word;
-		radio_parms->timeout 				= timeout_ms;
-	
-		return 0;
+    if (spi_parms->backend){
+        spi_parms->backend->it_enable(spi_parms->backend_ctx);
+        return;
+    }
+    CC11xx_IT_ENABLE();
 }
 
-int set_packet_parameters(uint8_t packet_length, bool fec, bool white, radio_parms_t * radio_parms)
+// Returns 1 when there is no backoff timer
+static int backend_timer_start(spi_parms_t *spi_parms, uint32_t us)
 {
-		radio_parms->packet_length  = packet_length;
-		radio_parms->fec            = (uint8_t) fec;
-    radio_parms->whitening      = (uint8_t) white;
-		
-		return 0;
+    if (spi_parms->backend){
+        if (spi_parms->backend->timer_start == NULL){
+            return 1;
+        }
+        spi_parms->backend->timer_start(spi_parms->backend_ctx, us);
+        return 0;
+    }
+#ifdef CC11xx_TIMER_START
+    CC11xx_TIMER_START(us);
+    return 0;
+#else
+    (void) us;
+    return 1;
+#endif
 }
-int set_modulation_parameters(radio_modulation_t mod, rate_t data_rate, float mod_index, radio_parms_t * radio_parms)
+
+
+static void radio_send_block(radio_int_data_t *radio, const uint8_t *data, uint8_t count, uint8_t in_tx);
+static void radio_turnaround_hold(radio_int_data_t *radio);
+static void radio_send_stream_block(radio_int_data_t *radio, const uint8_t *data, uint32_t length);
+static void tx_queue_run(radio_int_data_t *radio);
+static void gdo0_handle(radio_int_data_t *radio);
+static void gdo2_handle(radio_int_data_t *radio);
+static void rx_unload_header_done(spi_parms_t *spi_parms, void *ctx);
+static void rx_unload_done(spi_parms_t *spi_parms, void *ctx);
+static void rx_level_start(radio_int_data_t *radio);
+static uint8_t mcsm1_rx_word(radio_int_data_t *radio);
+static void spi_async_plug(spi_parms_t *spi_parms);
+static void spi_async_unplug(spi_parms_t *spi_parms);
+static void spi_async_run(spi_parms_t *spi_parms);
+static bool shadow_cacheable(uint8_t addr);
+static void cal_count_return(spi_parms_t *spi_parms, uint8_t off_mode);
+static void shadow_update(spi_parms_t *spi_parms, uint8_t addr, uint8_t byte);
+
+/* Configuration register values after reset (SWRS061) */
+static const uint8_t config_reset_values[CC11xx_NUM_CONFIG_REGS] = {
+    0x29, 0x2E, 0x3F, 0x07, 0xD3, 0x91, 0xFF, 0x04, 0x45, 0x00, 0x00, 0x0F, 0x00, 0x1E, 0xC4, 0xEC,
+    0x8C, 0x22, 0x02, 0x22, 0xF8, 0x47, 0x07, 0x30, 0x04, 0x36, 0x6C, 0x03, 0x40, 0x91, 0x87, 0x6B,
+    0xF8, 0x56, 0x10, 0xA9, 0x0A, 0x20, 0x0D, 0x41, 0x00, 0x59, 0x7F, 0x3F, 0x88, 0x31, 0x0B
+};
+
+/* Data rate words for each rate_t, folded at compile time for CC11xx_F_XTAL */
+typedef struct rate_words_s
 {
-    radio_parms->modulation     = mod;
-    radio_parms->drate          = data_rate;
-    radio_parms->mod_index      = mod_index;
+    uint32_t rate;
+    uint8_t  drate_e;
+    uint8_t  drate_m;
+} rate_words_t;
 
-		return 0;
+#define RATE_WORDS(rate) { rate, CC11xx_DRATE_E(rate, CC11xx_F_XTAL), CC11xx_DRATE_M(rate, CC11xx_F_XTAL) }
+
+static const rate_words_t rate_words[] = {
+    RATE_WORDS(50), RATE_WORDS(110), RATE_WORDS(300), RATE_WORDS(600), RATE_WORDS(1200),
+    RATE_WORDS(2400), RATE_WORDS(4800), RATE_WORDS(9600), RATE_WORDS(14400), RATE_WORDS(19200),
+    RATE_WORDS(28800), RATE_WORDS(38400), RATE_WORDS(57600), RATE_WORDS(76800), RATE_WORDS(115200),
+};
+
+typedef char rate_words_match_rate_t[(sizeof(rate_words) / sizeof(rate_words[0]) == NUM_RATE) ? 1 : -1];
+
+// ------------------------------------------------------------------------------------------------
+// Slot the next received packet is written to. The drop slot is used when the application has
+// not released enough slots yet.
+static radio_rx_slot_t *rx_ring_acquire(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_rx_ring_t *ring = (radio_rx_ring_t *) &radio->rx_ring;
+
+    if (ring->head - ring->tail >= CC11xx_RX_RING_DEPTH){
+        return (radio_rx_slot_t *) &radio->rx_drop_slot;
+    }
+    return &ring->slot[ring->head & (CC11xx_RX_RING_DEPTH - 1)];
 }
 
-int init_radio_config(spi_parms_t * spi_parms, radio_parms_t * radio_parms)
+// ------------------------------------------------------------------------------------------------
+// Publish the slot filled by the ISR to the application
+static void rx_ring_commit(radio_int_data_t *radio, radio_rx_slot_t *slot)
+// ------------------------------------------------------------------------------------------------
 {
-    uint8_t  reg_word;
-    // Write register settings
-    disable_IT();
+    if (slot == &radio->rx_drop_slot){
+        radio->rx_ring.overruns++;
+        return;
+    }
+    CC11xx_MEMORY_BARRIER(); // Slot contents visible before the new head
+    radio->rx_ring.head++;
+}
 
-    CC_PowerupResetCCxxxx(spi_parms);
-    
-    /* Patable Write here? */
+// ------------------------------------------------------------------------------------------------
+// PKTCTRL0 value for the configured whitening and packet length mode, CRC enabled
+static uint8_t pktctrl0_word(radio_parms_t *radio_parms)
+// ------------------------------------------------------------------------------------------------
+{
+    return (radio_parms->whitening<<6) + 0x04 + (radio_parms->length_mode & 0x03);
+}
 
-    // IOCFG2 = 0x00: Set in Rx mode (0x02 for Tx mode)
-    // o 0x00: Asserts when RX FIFO is filled at or above the RX FIFO threshold. 
-    //         De-asserts when RX FIFO is drained below the same threshold.
-    // o 0x02: Asserts when the TX FIFO is filled at or above the TX FIFO threshold.
-    //         De-asserts when the TX FIFO is below the same threshold.
-    // GDO2 changes depending on the mode
-    CC_SPIWriteReg(spi_parms, CC11xx_IOCFG2,   0x00); // GDO2 output pin config.
+/* Statistics are written from interrupt context only (or with the GDO interrupts masked) and read
+ * by the application without locking: writers make stats_seq odd for the duration, readers retry
+ * until they see the same even value before and after their copy. Writers nest (SPI completion
+ * preempting a GDO interrupt), only the outermost one moves stats_seq. */
 
-    // IOCFG0 = 0x06: Asserts when sync word has been sent / received, and de-asserts at the
-    // end of the packet. In RX, the pin will de-assert when the optional address
-    // check fails or the RX FIFO overflows. In TX the pin will de-assert if the TX
-    // FIFO underflows:    
-    // GDO0 never changes 
-    CC_SPIWriteReg(spi_parms, CC11xx_IOCFG0,   0x06); // GDO0 output pin config.
+static uint32_t stats_cycles(void);
 
-    // FIFO_THR = 14: 
-    // o 5 bytes in TX FIFO (55 available spaces)
-    // o 60 bytes in the RX FIFO
-    CC_SPIWriteReg(spi_parms, CC11xx_FIFOTHR,  0x0E); // FIFO threshold.
+static uint32_t stats_begin(radio_int_data_t *radio)
+{
+    if (radio->stats_depth++ == 0){
+        radio->stats_seq++;
+        CC11xx_MEMORY_BARRIER();
+    }
+    return stats_cycles();
+}
 
-    // PKTLEN: packet length up to 255 bytes. 
-    CC_SPIWriteReg(spi_parms, CC11xx_PKTLEN, radio_parms->packet_length); // Packet length.
-    
-    // PKTCTRL0: Packet automation control #0
-    // . bit  7:   unused
-    // . bit  6:   0  -> whitening off
-    // . bits 5:4: 00 -> normal mode use FIFOs for Rx and Tx
-    // . bit  3:   unused
-    // . bit  2:   1  -> CRC enabled
-    // . bits 1:0: xx -> Packet length mode. Set to FIXED at 255.
-    // CRC enabled by default
-    reg_word = (radio_parms->whitening<<6) + 0x04;
-    CC_SPIWriteReg(spi_parms, CC11xx_PKTCTRL0, reg_word); // Packet automation control.
+static void stats_time(radio_isr_time_t *isr_time, uint32_t start)
+{
+#ifdef CC11xx_CYCLES
+    uint32_t cycles = CC11xx_CYCLES() - start;
 
-    // PKTCTRL1: Packet automation control #1
-    // . bits 7:5: 000 -> Preamble quality estimator threshold
-    // . bit  4:   unused
-    // . bit  3:   0   -> Automatic flush of Rx FIFO disabled (too many side constraints see doc)
-    // . bit  2:   1   -> Append two status bytes to the payload (RSSI and LQI + CRC OK)
-    // . bits 1:0: 00  -> No address check of received packets
-    CC_SPIWriteReg(spi_parms, CC11xx_PKTCTRL1, 0x00); // Packet automation control.
+    if ((isr_time->count == 0) || (cycles < isr_time->min)){
+        isr_time->min = cycles;
+    }
+    if (cycles > isr_time->max){
+        isr_time->max = cycles;
+    }
+    isr_time->total += cycles;
+    isr_time->count++;
+#else
+    (void) isr_time;
+    (void) start;
+#endif
+}
 
-    CC_SPIWriteReg(spi_parms, CC11xx_ADDR,     0x00); // Device address for packet filtration (unused, see just above).
-    CC_SPIWriteReg(spi_parms, CC11xx_CHANNR,   0x00); // Channel number (unused, use direct frequency programming).
+static uint32_t stats_cycles(void)
+{
+#ifdef CC11xx_CYCLES
+    return CC11xx_CYCLES();
+#else
+    return 0;
+#endif
+}
 
-    // FSCTRL0: Frequency offset added to the base frequency before being used by the
-    // frequency synthesizer. (2s-complement). Multiplied by Fxtal/2^14
-		reg_word = get_offset_word(radio_parms->f_xtal, radio_parms->f_off);
-    CC_SPIWriteReg(spi_parms, CC11xx_FSCTRL0,  reg_word); // Freq synthesizer control.
+static void stats_end(radio_int_data_t *radio, radio_isr_time_t *isr_time, uint32_t start)
+{
+    if (isr_time){
+        stats_time(isr_time, start);
+    }
+    if (--radio->stats_depth == 0){
+        CC11xx_MEMORY_BARRIER();
+        radio->stats_seq++;
+    }
+}
 
-    // FSCTRL1: The desired IF frequency to employ in RX. Subtracted from FS base frequency
-    // in RX and controls the digital complex mixer in the demodulator. Multiplied by Fxtal/2^10
-    // Here 0.3046875 MHz (lowest point below 310 kHz)
-    radio_parms->if_word = get_if_word(radio_parms->f_xtal, radio_parms->f_if);
-    CC_SPIWriteReg(spi_parms, CC11xx_FSCTRL1, (radio_parms->if_word & 0x1F)); // Freq synthesizer control.
+// SPI cost of a packet: from when it starts being received or is handed to the chip to its end
+static void stats_packet_start(radio_int_data_t *radio)
+{
+    radio->pkt_spi_mark = radio->spi_parms->transactions;
+    radio->pkt_spi_bytes_mark = radio->spi_parms->bytes;
+}
 
-    // FREQ2..0: Base frequency for the frequency sythesizer
-    // Fo = (Fxosc / 2^16) * FREQ[23..0]
-    // FREQ2 is FREQ[23..16]
-    // FREQ1 is FREQ[15..8]
-    // FREQ0 is FREQ[7..0]
-    // Fxtal = 26 MHz and FREQ = 0x10A762 => Fo = 432.99981689453125 MHz
-    radio_parms->freq_word = get_freq_word(radio_parms->f_xtal, radio_parms->freq_hz);
-    CC_SPIWriteReg(spi_parms, CC11xx_FREQ2,    ((radio_parms->freq_word>>16) & 0xFF)); // Freq control word, high byte
-    CC_SPIWriteReg(spi_parms, CC11xx_FREQ1,    ((radio_parms->freq_word>>8)  & 0xFF)); // Freq control word, mid byte.
-    CC_SPIWriteReg(spi_parms, CC11xx_FREQ0,    (radio_parms->freq_word & 0xFF));       // Freq control word, low byte.
+static void stats_packet_end(radio_int_data_t *radio)
+{
+    radio_stats_t *stats = (radio_stats_t *) &radio->stats;
 
-    get_rate_words(radio_parms->drate, radio_parms->mod_index, radio_parms);
-    // MODCFG4 Modem configuration - bandwidth and data rate exponent
-    // High nibble: Sets the decimation ratio for the delta-sigma ADC input stream hence the channel bandwidth
-    // . bits 7:6: 0  -> CHANBW_E: exponent parameter (see next)
-    // . bits 5:4: 2  -> CHANBW_M: mantissa parameter as per:
-    //      BW = Fxosc / 8(4+CHANBW_M).2^CHANBW_E => Here: BW = 26/48 MHz = 541.67 kHz
-    //      Factory defaults: M=0, E=1 => BW = 26/128 ~ 203 kHz
-    // Low nibble:
-    // . bits 3:0: 13 -> DRATE_E: data rate base 2 exponent => here 13 (multiply by 8192)
-    reg_word = (radio_parms->chanbw_e<<6) + (radio_parms->chanbw_m<<4) + radio_parms->drate_e;
-    CC_SPIWriteReg(spi_parms, CC11xx_MDMCFG4,  reg_word); // Modem configuration.
+    stats->pkt_spi_transactions = radio->spi_parms->transactions - radio->pkt_spi_mark;
+    stats->pkt_spi_bytes = radio->spi_parms->bytes - radio->pkt_spi_bytes_mark;
+    if (stats->pkt_spi_transactions > stats->pkt_spi_transactions_max){
+        stats->pkt_spi_transactions_max = stats->pkt_spi_transactions;
+    }
+    if (stats->pkt_spi_bytes > stats->pkt_spi_bytes_max){
+        stats->pkt_spi_bytes_max = stats->pkt_spi_bytes;
+    }
+}
 
-    // MODCFG3 Modem configuration: DRATE_M data rate mantissa as per formula:
-    //    Rate = (256 + DRATE_M).2^DRATE_E.Fxosc / 2^28 
-    // Here DRATE_M = 59, DRATE_E = 13 => Rate = 250 kBaud
-    CC_SPIWriteReg(spi_parms, CC11xx_MDMCFG3,  radio_parms->drate_m); // Modem configuration.
+// ------------------------------------------------------------------------------------------------
+// The length header of the packet or stream in reception has been read
+static void rx_length_known(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    radio->bytes_remaining = radio->rx_header;
+    if (radio->radio_parms->length_mode != PACKET_LENGTH_INFINITE){
+        radio->rx_slot->length = radio->rx_header;
+        return;
+    }
+    radio->stream_length = radio->rx_header;
+    if (radio->stream_length > radio->stream_rx_size){
+        radio->rx_ptr = NULL; // No room for it, drained and dropped
+    }
+    // Packet ends when the byte counter modulo 256 matches PKTLEN after the switch to fixed length
+    radio->rx_pktlen = (radio->stream_length + 2) & 0xFF;
+    CC_SPISubmitReg(radio->spi_parms, CC11xx_PKTLEN, (uint8_t *) &radio->rx_pktlen, NULL, NULL);
+}
 
-    // MODCFG2 Modem configuration: DC block, modulation, Manchester, sync word
-    // o bit 7:    0   -> Enable DC blocking (1: disable)
-    // o bits 6:4: xxx -> (provided)
-    // o bit 3:    0   -> Manchester disabled (1: enable)
-    // o bits 2:0: 011 -> Sync word qualifier is 30/32 (static init in radio interface)
-    reg_word = ((radio_parms->modulation)<<4) + radio_parms->sync_ctl;
-    CC_SPIWriteReg(spi_parms, CC11xx_MDMCFG2,  reg_word); // Modem configuration.
+// ------------------------------------------------------------------------------------------------
+// Switch the stream in reception to fixed length once less than 256 bytes are left on air. They
+// must not be in the FIFO already: with fewer than a FIFO worth left the end can not be caught.
+// Returns 1 when the stream has to be given up.
+static int rx_stream_check(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    if (radio->stream_fixed || radio->rx_length_pending){
+        return 0;
+    }
+    if (radio->bytes_remaining <= CC11xx_FIFO_SIZE){
+        return 1;
+    }
+    if (radio->bytes_remaining <= CC11xx_PACKET_COUNT_SIZE){
+        radio->stream_pktctrl0 = pktctrl0_word(radio->radio_parms) & 0xFC;
+        CC_SPISubmitReg(radio->spi_parms, CC11xx_PKTCTRL0, (uint8_t *) &radio->stream_pktctrl0, NULL, NULL);
+        radio->stream_fixed = 1;
+        TRACE_EVENT(radio, TRACE_RX_STREAM_FIXED, 0);
+    }
+    return 0;
+}
 
-    // MODCFG1 Modem configuration: FEC, Preamble, exponent for channel spacing
-    // o bit 7:    0   -> FEC disabled (1: enable)
-    // o bits 6:4: 2   -> number of preamble bytes (0:2, 1:3, 2:4, 3:6, 4:8, 5:12, 6:16, 7:24)
-    // o bits 3:2: unused
-    // o bits 1:0: CHANSPC_E: exponent of channel spacing (here: 2)
-    reg_word = (radio_parms->fec<<7) + (((int) radio_parms->preamble)<<4) + (radio_parms->chanspc_e);
-    CC_SPIWriteReg(spi_parms, CC11xx_MDMCFG1,  reg_word); // Modem configuration.
+// ------------------------------------------------------------------------------------------------
+// Same on the transmit side: the switch is made while the end of the stream is still to be
+// written to the FIFO.
+static void tx_stream_check(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    if (radio->stream_fixed){
+        return;
+    }
+    if (radio->bytes_remaining <= CC11xx_PACKET_COUNT_SIZE + 1 - CC11xx_FIFO_SIZE){
+        radio->stream_pktctrl0 = pktctrl0_word(radio->radio_parms) & 0xFC;
+        CC_SPISubmitReg(radio->spi_parms, CC11xx_PKTCTRL0, (uint8_t *) &radio->stream_pktctrl0, NULL, NULL);
+        radio->stream_fixed = 1;
+        TRACE_EVENT(radio, TRACE_TX_STREAM_FIXED, 0);
+    }
+}
 
-    // MODCFG0 Modem configuration: CHANSPC_M: mantissa of channel spacing following this formula:
-    //    Df = (Fxosc / 2^18) * (256 + CHANSPC_M) * 2^CHANSPC_E
-    //    Here: (26 /  ) * 2016 = 0.199951171875 MHz (200 kHz)
-    CC_SPIWriteReg(spi_parms, CC11xx_MDMCFG0,  radio_parms->chanspc_m); // Modem configuration.
+// ------------------------------------------------------------------------------------------------
+// The TX queue is not run from completion callbacks: its assessment and the TX start wait for the
+// bus, which belongs to the interrupt the callback runs in. The backoff timer runs it instead, or
+// radio_tx_process() without one.
+static void tx_queue_defer(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_tx_queue_t *queue = (radio_tx_queue_t *) &radio->tx_queue;
 
-    // DEVIATN: Modem deviation
-    // o bit 7:    0   -> not used
-    // o bits 6:4: 0   -> DEVIATION_E: deviation exponent
-    // o bit 3:    0   -> not used
-    // o bits 2:0: 0   -> DEVIATION_M: deviation mantissa
-    //
-    //   Modulation  Formula
-    //
-    //   2-FSK    |  
-    //   4-FSK    :  Df = (Fxosc / 2^17) * (8 + DEVIATION_M) * 2^DEVIATION_E : Here: 1.5869140625 kHz
-    //   GFSK     |
-    //
-    //   MSK      :  Tx: not well documented, Rx: no effect
-    //
-    //   OOK      : No effect
-    //    
-    reg_word = (radio_parms->deviat_e<<4) + (radio_parms->deviat_m);
-    CC_SPIWriteReg(spi_parms, CC11xx_DEVIATN,  reg_word); // Modem dev (when FSK mod en)
+    if ((queue->head == queue->tail) || (queue->backoff && !radio->turnaround_hold)){
+        return; // Nothing to send, or the running backoff ends with a queue run
+    }
+    queue->backoff = 1;
+    if (backend_timer_start(radio->spi_parms, 0) != 0){
+        queue->backoff = 0;
+    }
+}
 
-    // MCSM2: Main Radio State Machine. See documentation.
-    CC_SPIWriteReg(spi_parms, CC11xx_MCSM2 ,   0x00); //MainRadio Cntrl State Machine
+static void rx_restart_done(spi_parms_t *spi_parms, void *ctx)
+{
+    (void) spi_parms;
+    tx_queue_defer((radio_int_data_t *) ctx);
+}
 
-    // MCSM1: Main Radio State Machine. 
-    // o bits 7:6: not used
-    // o bits 5:4: CCA_MODE: Clear Channel Indicator 
-    //   0 (00): Always clear
-    //   1 (01): Clear if RSSI below threshold
-    //   2 (10): Always claar unless receiving a packet
-    //   3 (11): Claar if RSSI below threshold unless receiving a packet
-    // o bits 3:2: RXOFF_MODE: Select to what state it should go when a packet has been received
-    //   0 (00): IDLE <== 
-    //   1 (01): FSTXON
-    //   2 (10): TX
-    //   3 (11): RX (stay)
-    // o bits 1:0: TXOFF_MODE: Select what should happen when a packet has been sent
-    //   0 (00): IDLE <==
-    //   1 (01): FSTXON
-    //   2 (10): TX (stay)
-    //   3 (11): RX 
-    CC_SPIWriteReg(spi_parms, CC11xx_MCSM1 ,   0x30); //MainRadio Cntrl State Machine
+// ------------------------------------------------------------------------------------------------
+// Back to RX from a completion callback, as queued transactions ending with SRX: IDLE and RX FIFO
+// flush first when flush is set (overflow or stream given up), then what radio_turn_rx_isr()
+// writes, registers holding the value already left out. The TX queue runs once SRX is out.
+static void rx_restart(radio_int_data_t *radio, uint8_t flush)
+// ------------------------------------------------------------------------------------------------
+{
+    static const uint8_t iocfg2_rx = 0x00; // GDO2 output pin config RX mode
+    spi_parms_t *spi = radio->spi_parms;
+
+    if (flush){
+        CC_SPISubmit(spi, CC11xx_SIDLE, NULL, NULL, 0, NULL, NULL);
+        CC_SPISubmit(spi, CC11xx_SFRX, NULL, NULL, 0, NULL, NULL);
+    }
+    if (radio->stream_fixed){
+        radio->restart_pktctrl0 = pktctrl0_word(radio->radio_parms); // Back to infinite length
+        CC_SPISubmitReg(spi, CC11xx_PKTCTRL0, (uint8_t *) &radio->restart_pktctrl0, NULL, NULL);
+        radio->stream_fixed = 0;
+    }
+    radio->restart_mcsm1 = mcsm1_rx_word(radio);
+    CC_SPISubmitReg(spi, CC11xx_MCSM1, (uint8_t *) &radio->restart_mcsm1, NULL, NULL);
+    CC_SPISubmitReg(spi, CC11xx_IOCFG2, &iocfg2_rx, NULL, NULL);
+    radio->packet_receive = 0;
+    radio->packet_send = 0;
+    radio->mode = RADIOMODE_RX;
+    CC_SPISubmit(spi, CC11xx_SRX, NULL, NULL, 0, rx_restart_done, (void *) radio);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Queue the reads of the current FIFO unload on the SPI engine, in place into the packet slot or
+// stream buffer. The length header (the length byte in variable length mode, 2 bytes big endian
+// for streams) is read on its own first: it sets the payload length and is not stored.
+static void rx_unload_step(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    spi_parms_t *spi = radio->spi_parms;
+    uint8_t n, drop;
+
+    if (radio->rx_length_pending && radio->rx_unload_left > 0){
+        n = (radio->rx_unload_left < radio->rx_length_pending) ? radio->rx_unload_left : radio->rx_length_pending;
+        radio->rx_unload_left -= n;
+        radio->rx_header_count = n;
+        CC_SPISubmit(spi, CC11xx_RXFIFO | CC11xx_READ_BURST, NULL, (uint8_t *) radio->rx_header_bytes, n, rx_unload_header_done, (void *) radio);
+        return;
+    }
+    n = (radio->rx_unload_left > radio->bytes_remaining) ? radio->bytes_remaining : radio->rx_unload_left;
+    drop = radio->rx_unload_left - n; // Past the packet end
+    radio->rx_unload_left = 0;
+    if (n > 0){
+        CC_SPISubmit(spi, CC11xx_RXFIFO | CC11xx_READ_BURST, NULL, radio->rx_ptr ? &(radio->rx_ptr[radio->byte_index]) : (uint8_t *) radio->rx_aux, n,
+                     drop ? NULL : rx_unload_done, (void *) radio);
+        radio->byte_index += n;
+        radio->bytes_remaining -= n;
+        TRACE_EVENT(radio, TRACE_RX_UNLOAD, n);
+    }
+    if (drop > 0){
+        CC_SPISubmit(spi, CC11xx_RXFIFO | CC11xx_READ_BURST, NULL, (uint8_t *) radio->rx_aux, drop, rx_unload_done, (void *) radio);
+    }
+    if (n == 0 && drop == 0){
+        rx_unload_done(spi, (void *) radio);
+    }
+}
+
+static void rx_unload_header_done(spi_parms_t *spi_parms, void *ctx)
+{
+    radio_int_data_t *radio = (radio_int_data_t *) ctx;
+    uint8_t i;
+
+    (void) spi_parms;
+    for (i=0; i<radio->rx_header_count; i++){
+        radio->rx_header = (radio->rx_header << 8) | radio->rx_header_bytes[i];
+        if (--radio->rx_length_pending == 0){
+            rx_length_known(radio);
+            TRACE_EVENT(radio, TRACE_RX_HEADER, radio->rx_header);
+        }
+    }
+    rx_unload_step(radio);
+}
+
+static void rx_unload_done(spi_parms_t *spi_parms, void *ctx)
+{
+    radio_int_data_t *radio = (radio_int_data_t *) ctx;
+
+    (void) spi_parms;
+    radio->rx_unloading = 0;
+    if (radio->rx_unload_next){
+        radio->rx_unload_next(radio);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Unload count bytes from the RX FIFO, next (may be NULL) is called once they are read
+static void rx_unload_start(radio_int_data_t *radio, uint8_t count, void (*next)(radio_int_data_t *radio))
+// ------------------------------------------------------------------------------------------------
+{
+    radio->rx_unloading = 1;
+    radio->rx_unload_left = count;
+    radio->rx_unload_next = next;
+    rx_unload_step(radio);
+}
+
+// ------------------------------------------------------------------------------------------------
+// End of packet, run from completion callbacks: RXBYTES, FIFO unload, LQI, RSSI then back to RX
+// (through IDLE with the RX FIFO flushed after an overflow), or in turnaround mode after a good
+// packet, wait in FSTXON for the reply (RXOFF_MODE=FSTXON)
+static void rx_eop_finish(radio_int_data_t *radio, uint8_t good, uint8_t overflow)
+// ------------------------------------------------------------------------------------------------
+{
+    stats_packet_end(radio);
+    if (!overflow){
+        cal_count_return(radio->spi_parms, (radio->spi_parms->shadow[CC11xx_MCSM1] >> 2) & 0x03);
+    }
+    if (radio->turnaround_us && good){
+        radio_turnaround_hold(radio);
+        tx_queue_defer(radio);
+    }else{
+        rx_restart(radio, overflow);
+    }
+}
+
+static void rx_eop_status(spi_parms_t *spi_parms, void *ctx)
+{
+    radio_int_data_t *radio = (radio_int_data_t *) ctx;
+    uint8_t status = radio->rx_status;
+
+    if (spi_parms->chip_state == CC11xx_STATUS_RXFIFO_OVERFLOW){ // Status byte of the RSSI read
+        radio->stats.rx_overflows++;
+        TRACE_EVENT(radio, TRACE_RX_OVERFLOW, 0);
+        rx_eop_finish(radio, 0, 1);
+        return;
+    }
+    if ( (status&0x80) == 0x80){
+    	radio->packet_rx_count++;
+        radio->stats.rx_packets++;
+    }else{
+        radio->stats.rx_crc_errors++;
+    }
+    radio->last_lqi = status&0x7F;
+    TRACE_EVENT(radio, TRACE_RX_DONE, status);
+    if (radio->radio_parms->length_mode == PACKET_LENGTH_INFINITE){
+        if (radio->rx_ptr && radio->stream_callback){
+            radio->stream_callback(radio, radio->rx_ptr, radio->stream_length, (status&0x80) ? 1 : 0);
+        }else{
+            radio->stats.rx_stream_drops++; // No buffer to take it
+        }
+        rx_eop_finish(radio, (status&0x80) ? 1 : 0, 0);
+        return;
+    }
+    radio->rx_slot->crc_ok = (status&0x80) ? 1 : 0;
+    radio->rx_slot->lqi = radio->last_lqi;
+    radio->last_rssi = rssi_dbm(radio->rx_rssi);
+    radio->rx_slot->rssi = radio->last_rssi;
+    radio->rx_slot->timestamp = CC11xx_TIMESTAMP();
+    rx_ring_commit(radio, radio->rx_slot);
+    rx_eop_finish(radio, radio->rx_slot->crc_ok, 0);
+}
+
+static void rx_eop_unloaded(radio_int_data_t *radio)
+{
+    /* get lqi and rssi, both queued: the RSSI read is wasted after an overflow */
+    CC_SPISubmit(radio->spi_parms, CC11xx_LQI | CC11xx_READ_BURST, NULL, (uint8_t *) &radio->rx_status, 1, NULL, NULL);
+    CC_SPISubmit(radio->spi_parms, CC11xx_RSSI | CC11xx_READ_BURST, NULL, (uint8_t *) &radio->rx_rssi, 1, rx_eop_status, (void *) radio);
+}
+
+static void rx_eop_rxbytes(spi_parms_t *spi_parms, void *ctx)
+{
+    radio_int_data_t *radio = (radio_int_data_t *) ctx;
+    uint8_t status = radio->rx_status;
+
+    (void) spi_parms;
+    if ((status&0x80) == 0x80){ /* Overflow */
+        radio->stats.rx_overflows++;
+        TRACE_EVENT(radio, TRACE_RX_OVERFLOW, status);
+        rx_eop_finish(radio, 0, 1);
+    }else{
+        rx_unload_start(radio, status & CC11xx_NUM_RXBYTES, rx_eop_unloaded); // Whole packet still in the FIFO
+    }
+}
+
+// The FIFO count is only needed while the length is unknown. Otherwise the remaining bytes are read
+// straight away and an overflow shows in the status bytes of the LQI and RSSI reads, queued right
+// behind them (a single unload step) so that a batching backend does them all at once.
+static void rx_eop_start(radio_int_data_t *radio)
+{
+    radio->rx_eop_pending = 0;
+    TRACE_EVENT(radio, TRACE_RX_EOP, 0);
+    if (radio->rx_length_pending){
+        CC_SPISubmit(radio->spi_parms, CC11xx_RXBYTES | CC11xx_READ_BURST, NULL, (uint8_t *) &radio->rx_status, 1, rx_eop_rxbytes, (void *) radio);
+    }else{
+        rx_unload_start(radio, radio->bytes_remaining, NULL);
+        rx_eop_unloaded(radio);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// RX FIFO threshold unload done: switch a stream to fixed length when due, unload again if the
+// FIFO is still above the threshold and start the end of packet if it came meanwhile
+static void rx_threshold_done(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    if (radio->rx_eop_pending){
+        rx_eop_start(radio);
+        return;
+    }
+    if (!radio->packet_receive){
+        return;
+    }
+    if ((radio->radio_parms->length_mode == PACKET_LENGTH_INFINITE) && rx_stream_check(radio)){
+        radio->stats.rx_stream_drops++; // End of stream missed, give it up
+        rx_restart(radio, 1);
+        return;
+    }
+    if (backend_gdo2(radio->spi_parms)){
+        rx_level_start(radio);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// FIFO threshold in RX: unload what RXBYTES reports, bounded by what is left of the packet. One
+// byte stays in the FIFO while the packet is coming in (SWRZ020 RX FIFO read errata).
+static void rx_level_done(spi_parms_t *spi_parms, void *ctx)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_int_data_t *radio = (radio_int_data_t *) ctx;
+    uint32_t count = radio->fifo_level & CC11xx_NUM_RXBYTES;
+
+    (void) spi_parms;
+    radio->rx_unloading = 0;
+    TRACE_EVENT(radio, TRACE_RX_LEVEL, radio->fifo_level);
+    if (radio->rx_eop_pending){
+        rx_eop_start(radio);
+        return;
+    }
+    if ((radio->fifo_level & 0x80) == 0x80){ /* Overflow, the packet is lost */
+        radio->stats.rx_overflows++;
+        TRACE_EVENT(radio, TRACE_RX_OVERFLOW, radio->fifo_level);
+        rx_restart(radio, 1);
+        return;
+    }
+    if (count > 0){
+        count--;
+    }
+    if (!radio->rx_length_pending && count > radio->bytes_remaining){
+        count = radio->bytes_remaining;
+    }
+    rx_unload_start(radio, count, rx_threshold_done);
+}
+
+static void rx_level_start(radio_int_data_t *radio)
+{
+    radio->rx_unloading = 1; // Covers the RXBYTES read as well
+    CC_SPISubmit(radio->spi_parms, CC11xx_RXBYTES | CC11xx_READ_BURST, NULL, (uint8_t *) &radio->fifo_level, 1, rx_level_done, (void *) radio);
+}
+
+// ------------------------------------------------------------------------------------------------
+// FIFO threshold in TX: top the FIFO up to what TXBYTES leaves free, bounded by what is left of
+// the frame
+static void tx_level_done(spi_parms_t *spi_parms, void *ctx)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_int_data_t *radio = (radio_int_data_t *) ctx;
+    uint32_t count;
+
+    TRACE_EVENT(radio, TRACE_TX_LEVEL, radio->fifo_level);
+    if (((radio->fifo_level & 0x80) == 0x80) || !radio->packet_send){
+        return; // Underflow, gdo0_isr() ends the frame
+    }
+    count = CC11xx_FIFO_SIZE - 1 - (radio->fifo_level & CC11xx_NUM_RXBYTES);
+    if (count > radio->bytes_remaining){
+        count = radio->bytes_remaining;
+    }
+    if (count == 0){
+        return;
+    }
+    CC_SPISubmit(spi_parms, CC11xx_TXFIFO | CC11xx_WRITE_BURST, &(radio->tx_ptr[radio->byte_index]), NULL, count, NULL, NULL);
+    radio->byte_index += count;
+    radio->bytes_remaining -= count;
+    TRACE_EVENT(radio, TRACE_TX_REFILL, count);
+    if (radio->radio_parms->length_mode == PACKET_LENGTH_INFINITE){
+        tx_stream_check(radio);
+    }
+}
+
+// Next number of the backoff generator of the queue (xorshift32): radios sharing a channel draw
+// their own sequences, nothing shared with the application's rand()
+static uint32_t tx_random(radio_tx_queue_t *queue)
+{
+    uint32_t x = queue->prng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    queue->prng = x;
+    return x;
+}
+
+// Data rate of the DRATE words in Baud, rounded down
+static uint32_t rate_baud(const radio_parms_t *radio_parms)
+{
+    return (uint32_t) ((((uint64_t) radio_parms->f_xtal * (256 + radio_parms->drate_m)) << radio_parms->drate_e) >> 28);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Wait a random number of slots out of 2^be before the next clear channel assessment: on the
+// backoff timer when the backend has one (radio_csma_timer_isr() then runs the queue), otherwise
+// rounded up to the next CC11xx_TIMESTAMP() tick for radio_tx_process()
+static void tx_backoff(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_tx_queue_t *queue = (radio_tx_queue_t *) &radio->tx_queue;
+    uint32_t slots = tx_random(queue) & ((1UL << queue->be) - 1);
+    uint32_t us = slots * queue->slot_us;
+
+    queue->csma_stats.backoff_slots += slots;
+    TRACE_EVENT(radio, TRACE_BACKOFF, slots);
+    queue->backoff = 1;
+    if (backend_timer_start(radio->spi_parms, us) != 0){
+        queue->backoff = 0;
+        queue->next_cca = CC11xx_TIMESTAMP() + (us + 999) / 1000;
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// CSMA/CA start for the frame at tail: slot time from the current data rate, smallest window
+static void tx_csma_start(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_tx_queue_t *queue = (radio_tx_queue_t *) &radio->tx_queue;
+
+    if (queue->csma.slot_us){
+        queue->slot_us = queue->csma.slot_us;
+    }else{
+        queue->slot_us = (CC11xx_CSMA_SLOT_BITS * 1000000UL) / rate_baud(radio->radio_parms) + 1;
+    }
+    queue->cca_count = 0;
+    queue->be = queue->csma.min_be;
+    tx_backoff(radio);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Retire the frame at the tail of the TX queue and notify the application
+static void tx_queue_complete(radio_int_data_t *radio, radio_tx_status_t status)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_tx_queue_t *queue = (radio_tx_queue_t *) &radio->tx_queue;
+    uint32_t ticket = queue->tail;
+
+    queue->status[ticket & (CC11xx_TX_QUEUE_DEPTH - 1)] = (uint8_t) status;
+    TRACE_EVENT(radio, TRACE_TX_DONE, status);
+    switch (status){
+        case RADIO_TX_SENT:         radio->stats.tx_packets++; break;
+        case RADIO_TX_UNDERFLOW:    radio->stats.tx_underflows++; break;
+        case RADIO_TX_CCA_FAILED:   radio->stats.tx_cca_failures++; break;
+        case RADIO_TX_TIMEOUT:      radio->stats.tx_timeouts++; break;
+        default:                    break;
+    }
+    if (queue->on_air){
+        stats_packet_end(radio);
+    }
+    queue->on_air = 0;
+    CC11xx_MEMORY_BARRIER(); // Status visible before the slot is handed back
+    queue->tail++;
+    if ((queue->head != queue->tail) && !queue->chained){
+        tx_csma_start(radio);
+    }
+    if (queue->callback){
+        queue->callback(radio, ticket, status);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Airtime of a frame of length bytes (length byte included) at the current data rate, counting the
+// sync word and CRC at their largest
+static uint32_t tx_airtime_us(radio_int_data_t *radio, uint8_t length)
+// ------------------------------------------------------------------------------------------------
+{
+    static const uint8_t preamble_bytes[8] = {2, 3, 4, 6, 8, 12, 16, 24};
+    radio_parms_t *radio_parms = radio->radio_parms;
+    uint32_t bytes = preamble_bytes[radio_parms->preamble & 0x07] + 4 + length + 2;
+
+    if (radio_parms->fec){
+        bytes *= 2;
+    }
+    return (uint32_t) (((uint64_t) bytes * 8 * 1000000) / rate_baud(radio_parms)) + 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Burst: whether the frame at tail being handed to the chip is followed by the next one without a
+// new assessment, i.e. the next one is queued, in time and within the burst airtime. The chip then
+// stays in TX (TXOFF_MODE=TX) and sends preamble until gdo0_isr() loads the next frame.
+static uint8_t tx_burst_chain(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_tx_queue_t *queue = (radio_tx_queue_t *) &radio->tx_queue;
+    radio_tx_frame_t *next = &queue->frame[(queue->tail + 1) & (CC11xx_TX_QUEUE_DEPTH - 1)];
+    uint32_t airtime;
+
+    queue->chained = 0;
+    if ((queue->csma.burst_us == 0) || (queue->head - queue->tail < 2) || next->stream){
+        return 0;
+    }
+    airtime = tx_airtime_us(radio, next->length);
+    if ((queue->burst_airtime_us + airtime > queue->csma.burst_us) || ((int32_t) (CC11xx_TIMESTAMP() - next->deadline) > 0)){
+        return 0;
+    }
+    queue->burst_airtime_us += airtime;
+    queue->chained = 1;
+    return 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Burst: the previous frame is out and the chip still in TX, hand it the frame now at tail
+static void tx_burst_next(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_tx_queue_t *queue = (radio_tx_queue_t *) &radio->tx_queue;
+    radio_tx_frame_t *frame = &queue->frame[queue->tail & (CC11xx_TX_QUEUE_DEPTH - 1)];
+
+    queue->csma_stats.chained++;
+    stats_packet_start(radio);
+    queue->on_air = 1;
+    radio_send_block(radio, frame->data, frame->length, 1);
+    TRACE_EVENT(radio, TRACE_TX_START, radio->byte_index);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Drain the TX queue: drop frames past their deadline, assess the channel once the backoff has
+// elapsed and hand the next frame to the chip. Never waits; called from gdo0_isr() at the end of
+// each packet and from radio_tx_process() with GDO interrupts masked.
+static void tx_queue_run(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_tx_queue_t *queue = (radio_tx_queue_t *) &radio->tx_queue;
+    radio_tx_frame_t *frame;
+    uint32_t now;
+    uint8_t  pktstatus;
+
+    if (radio->turnaround_hold){
+        if ((queue->head != queue->tail) && !queue->on_air){
+            /* Reply to the packet just received: straight from FSTXON, no assessment nor backoff */
+            frame = &queue->frame[queue->tail & (CC11xx_TX_QUEUE_DEPTH - 1)];
+            radio->turnaround_hold = 0;
+            stats_packet_start(radio);
+            queue->on_air = 1;
+            if (frame->stream){
+                radio_send_stream_block(radio, frame->stream, frame->stream_length);
+            }else{
+                queue->burst_airtime_us = tx_airtime_us(radio, frame->length);
+                radio_send_block(radio, frame->data, frame->length, 0);
+            }
+            stats_time((radio_isr_time_t *) &radio->stats.turnaround, radio->rx_end_cycles);
+            TRACE_EVENT(radio, TRACE_TX_START, radio->byte_index);
+            return;
+        }
+        if (queue->backoff || ((int32_t) (CC11xx_TIMESTAMP() - radio->turnaround_until) < 0)){
+            return; // Still waiting for the reply
+        }
+        radio->turnaround_hold = 0;
+        radio_turn_rx_isr(radio); // FSTXON to RX, no calibration
+    }
+
+    while ((queue->head != queue->tail) && !queue->on_air){
+        frame = &queue->frame[queue->tail & (CC11xx_TX_QUEUE_DEPTH - 1)];
+        now = CC11xx_TIMESTAMP();
+
+        if ((int32_t) (now - frame->deadline) > 0){
+            tx_queue_complete(radio, RADIO_TX_TIMEOUT);
+            continue;
+        }
+        if ((radio->mode != RADIOMODE_RX) || radio->packet_receive){
+            return; // Busy, the end of packet interrupt will call again
+        }
+        if (queue->backoff || ((int32_t) (now - queue->next_cca) < 0)){
+            return; // Still backing off
+        }
+
+        /* CCA bit of PKTSTATUS follows MCSM1.CCA_MODE while in RX, GDO2 stays on the RX FIFO */
+        CC_SPIReadStatus(radio->spi_parms, CC11xx_PKTSTATUS, &pktstatus);
+        queue->cca_count++;
+        queue->csma_stats.assessments++;
+        TRACE_EVENT(radio, TRACE_CCA, (pktstatus & 0x10) ? 1 : 0);
+        if ((pktstatus & 0x10) == 0){
+            queue->csma_stats.busy++;
+            if (queue->cca_count >= queue->csma.max_attempts){
+                queue->csma_stats.failures++;
+                tx_queue_complete(radio, RADIO_TX_CCA_FAILED);
+                continue;
+            }
+            if (queue->be < queue->csma.max_be){
+                queue->be++;
+            }
+            tx_backoff(radio);
+            return;
+        }
+        queue->csma_stats.clear_at[queue->cca_count - 1]++;
+
+        stats_packet_start(radio);
+        if (!radio->turnaround_us){
+            radio_turn_idle(radio->spi_parms);
+        } // else straight from RX to TX, the synthesizer stays on
+        queue->on_air = 1;
+        if (frame->stream){
+            radio_send_stream_block(radio, frame->stream, frame->stream_length);
+        }else{
+            queue->burst_airtime_us = tx_airtime_us(radio, frame->length);
+            radio_send_block(radio, frame->data, frame->length, 0); // Queue slot held until completion
+            if (queue->chained){
+                queue->csma_stats.bursts++;
+            }
+        }
+        TRACE_EVENT(radio, TRACE_TX_START, radio->byte_index);
+    }
+}
+
+
+// ------------------------------------------------------------------------------------------------
+// Processes packets up to 255 bytes and the start and end of streams
+void gdo0_isr(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t start;
+
+    if (!radio->init){
+        return;
+    }
+    start = stats_begin(radio);
+    spi_async_plug(radio->spi_parms);
+    gdo0_handle(radio);
+    spi_async_unplug(radio->spi_parms);
+    stats_end(radio, (radio_isr_time_t *) &radio->stats.gdo0, start);
+}
+
+static void gdo0_handle(radio_int_data_t *radio)
+{
+    uint8_t int_line;
+
+    int_line = backend_gdo0(radio->spi_parms); // Sense interrupt line to determine if it was a raising or falling edge
+    TRACE_EVENT(radio, int_line ? TRACE_GDO0_RISE : TRACE_GDO0_FALL, radio->mode);
+
+    if (radio->mode == RADIOMODE_RX){
+        if (int_line){         
+            stats_packet_start(radio);
+            radio->byte_index = 0;
+            radio->rx_header = 0;
+            if (radio->radio_parms->length_mode == PACKET_LENGTH_INFINITE){
+                radio->rx_ptr = radio->stream_rx_buf;
+                radio->rx_length_pending = 2; // Known once the stream header is read
+                radio->bytes_remaining = 0;
+            }else{
+                radio->rx_slot = rx_ring_acquire(radio);
+                radio->rx_ptr = radio->rx_slot->data;
+                if (radio->radio_parms->length_mode == PACKET_LENGTH_VARIABLE){
+                    radio->rx_slot->length = 0;
+                    radio->rx_length_pending = 1; // Known once the length byte is read
+                }else{
+                    radio->rx_slot->length = radio->radio_parms->packet_length;
+                    radio->rx_length_pending = 0;
+                }
+                radio->bytes_remaining = radio->rx_slot->length;
+            }
+            radio->packet_receive = 1; // reception is in progress
+        }else{
+            if (radio->packet_receive){
+                /* The rest is chained on the SPI engine, see rx_eop_start() */
+                radio->rx_end_cycles = stats_cycles();
+                radio->mode = RADIOMODE_NONE;
+                radio->packet_receive = 0; // reception is done
+                if (radio->rx_unloading){
+                    radio->rx_eop_pending = 1; // After the threshold unload
+                }else{
+                    rx_eop_start(radio);
+                }
+            }
+        }    
+    }else if (radio->mode == RADIOMODE_TX){
+        if (int_line){
+            radio->packet_send = 1; // Assert packet transmission after sync has been sent
+        }else{
+            if (radio->packet_send){
+                CC_SPIRefreshStatus(radio->spi_parms);
+                if (radio->spi_parms->chip_state == CC11xx_STATUS_TXFIFO_UNDERFLOW){
+                    radio->mode = RADIOMODE_NONE;
+                    radio->packet_send = 0; // De-assert packet transmission after packet has been sent
+                    radio->tx_queue.chained = 0; // The burst ends here
+                    radio_turn_idle(radio->spi_parms);
+                    tx_queue_complete(radio, RADIO_TX_UNDERFLOW);
+                }else{
+                    radio->mode = RADIOMODE_NONE;
+                    radio->packet_send = 0; // De-assert packet transmission after packet has been sent
+                    radio->packet_tx_count++;
+                    if (radio->tx_queue.chained){
+                        tx_queue_complete(radio, RADIO_TX_SENT);
+                        tx_burst_next(radio); // Chip sending preamble meanwhile
+                        return;
+                    }else{
+                        cal_count_return(radio->spi_parms, radio->spi_parms->shadow[CC11xx_MCSM1] & 0x03);
+                    }
+                    if ((radio->bytes_remaining)){
+                        radio_turn_idle(radio->spi_parms);          
+                    }
+                    tx_queue_complete(radio, RADIO_TX_SENT);
+                }
+            }
+            radio_turn_rx_isr(radio);
+            tx_queue_run(radio);
+        }
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Processes packets and streams that do not fit in Rx or Tx FIFOs
+// FIFO threshold interrupt handler 
+void gdo2_isr(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t start;
+
+    if (!radio->init){
+        return;
+    }
+    start = stats_begin(radio);
+    spi_async_plug(radio->spi_parms);
+    gdo2_handle(radio);
+    spi_async_unplug(radio->spi_parms);
+    stats_end(radio, (radio_isr_time_t *) &radio->stats.gdo2, start);
+}
+
+static void gdo2_handle(radio_int_data_t *radio)
+{
+    uint8_t int_line;
+
+    int_line = backend_gdo2(radio->spi_parms); // Sense interrupt line to determine if it was a raising or falling edge
+    TRACE_EVENT(radio, int_line ? TRACE_GDO2_RISE : TRACE_GDO2_FALL, radio->mode);
+
+    if ((radio->mode == RADIOMODE_RX) && (int_line)){
+        if (radio->packet_receive && !radio->rx_unloading){
+            rx_level_start(radio);
+            return;        
+        }
+    }
+    if ((radio->mode == RADIOMODE_TX) && (!int_line)){
+        if ((radio->packet_send) && (radio->bytes_remaining > 0)){
+            CC_SPISubmit(radio->spi_parms, CC11xx_TXBYTES | CC11xx_READ_BURST, NULL, (uint8_t *) &radio->fifo_level, 1, tx_level_done, (void *) radio);
+            return;
+        }
+    }
+}
+
+int set_freq_parameters(float freq_hz, float freq_if, float freq_off, radio_parms_t * radio_parms)
+{
+    radio_parms->freq_hz        = freq_hz;
+    radio_parms->f_if           = freq_if;
+		radio_parms->f_off 					= freq_off;
+
+    /* Set the nominal parameters */
+    radio_parms->f_xtal        = 26000000;
+    radio_parms->chanspc_m     = 0;                // No channel plan: channel 0 only, see set_channel_plan()
+    radio_parms->chanspc_e     = 0;
+    radio_parms->chanspc_hz    = 0;
+    radio_parms->chan_count    = 1;
+    radio_parms->channr        = 0;
+    radio_parms->fifo_thr      = CC11xx_FIFO_THR_DEFAULT;
+		
+		return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Channel plan: count channels spacing_hz apart from base_hz (channel 0), selected by CHANNR with
+// radio_set_channel(). Call after set_freq_parameters(). CHANSPC_M/E are the closest to spacing_hz:
+//    Df = (Fxosc / 2^18) * (256 + CHANSPC_M) * 2^CHANSPC_E
+// that is 25.4 to 405 kHz in steps of 0.1 to 0.8 kHz with a 26 MHz crystal. Returns 1 if the
+// spacing is out of that range or count does not fit CHANNR.
+int set_channel_plan(float base_hz, uint32_t spacing_hz, uint16_t count, radio_parms_t * radio_parms)
+// ------------------------------------------------------------------------------------------------
+{
+    uint64_t scaled = (uint64_t) spacing_hz << 18;
+    uint32_t step, m, best_hz = 0;
+    int32_t err, best_err = INT32_MAX;
+    uint8_t e;
+
+    if ((count == 0) || (count > 256)){
+        return 1;
+    }
+    for (e = 0; e < 4; e++){
+        step = radio_parms->f_xtal << e;                     // Df for 256 + M = 1, times 2^18
+        m = (uint32_t) ((scaled + step / 2) / step);
+        if ((m < 256) || (m > 511)){
+            continue;
+        }
+        err = (int32_t) ((((uint64_t) step * m) >> 18) - spacing_hz);
+        if (err < 0){
+            err = -err;
+        }
+        if (err < best_err){
+            best_err = err;
+            best_hz = (uint32_t) (((uint64_t) step * m) >> 18);
+            radio_parms->chanspc_e = e;
+            radio_parms->chanspc_m = (uint8_t) (m - 256);
+        }
+    }
+    if (best_err == INT32_MAX){
+        return 1;
+    }
+    radio_parms->freq_hz    = base_hz;
+    radio_parms->chanspc_hz = best_hz;
+    radio_parms->chan_count = count;
+    radio_parms->channr     = 0;
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Synthesizer calibration policy, RADIO_CAL_EVERY in a zeroed radio_parms. A calibration takes
+// about 720 us; fewer of them shorten the way out of IDLE but let the synthesizer drift with the
+// temperature. RADIO_CAL_PERIODIC calibrates every period_ms and when the temperature given to
+// radio_cal_temperature() has moved by temp_delta degrees (0 turns either trigger off). Returns 1
+// for an unknown policy or RADIO_CAL_PERIODIC without a trigger.
+int set_cal_policy(radio_cal_policy_t policy, uint32_t period_ms, uint8_t temp_delta, radio_parms_t * radio_parms)
+// ------------------------------------------------------------------------------------------------
+{
+    if ((policy >= NUM_RADIO_CAL) || ((policy == RADIO_CAL_PERIODIC) && (period_ms == 0) && (temp_delta == 0))){
+        return 1;
+    }
+    radio_parms->cal_policy     = policy;
+    radio_parms->cal_period_ms  = (policy == RADIO_CAL_PERIODIC) ? period_ms : 0;
+    radio_parms->cal_temp_delta = (policy == RADIO_CAL_PERIODIC) ? temp_delta : 0;
+    return 0;
+}
+
+int set_sync_parameters(preamble_t preamble, sync_word_t sync_word, uint32_t timeout_ms, radio_parms_t * radio_parms)
+{
+    radio_parms->preamble       = preamble;
+    radio_parms->sync_ctl       = sync_word;
+		radio_parms->timeout 				= timeout_ms;
+	
+		return 0;
+}
+
+int set_packet_parameters(uint8_t packet_length, bool fec, bool white, radio_parms_t * radio_parms)
+{
+		radio_parms->packet_length  = packet_length;
+		radio_parms->fec            = (uint8_t) fec;
+    radio_parms->whitening      = (uint8_t) white;
+		
+		return 0;
+}
+
+int set_packet_length_mode(packet_length_t length_mode, radio_parms_t * radio_parms)
+{
+    if (length_mode >= NUM_PACKET_LENGTH){
+        return 1;
+    }
+    radio_parms->length_mode    = length_mode;
+
+    return 0;
+}
+
+// FIFO threshold (FIFOTHR.FIFO_THR 0..15), after set_freq_parameters(). Higher values mean fewer
+// threshold interrupts, lower values more time to serve each one before the FIFO overflows
+// (RX) or runs dry (TX): (64 - 4*(n+1)) resp. (61 - 4*n) byte times.
+int set_fifo_threshold(uint8_t fifo_thr, radio_parms_t * radio_parms)
+{
+    if (fifo_thr > 0x0F){
+        return 1;
+    }
+    radio_parms->fifo_thr       = fifo_thr;
+
+    return 0;
+}
+
+int set_modulation_parameters(radio_modulation_t mod, rate_t data_rate, float mod_index, radio_parms_t * radio_parms)
+{
+    radio_parms->modulation     = mod;
+    radio_parms->drate          = data_rate;
+    radio_parms->mod_index_q16  = CC11xx_MOD_INDEX_Q16(mod_index); // Once here, get_rate_words() stays integer
+    radio_parms->drate_hz       = 0;
+
+		return 0;
+}
+
+// Any data rate and deviation: the closest register words are searched by radio_solve_rate() with
+// the frequency and crystal already set. Returns 1, leaving radio_parms untouched, when no fit is
+// found. fit (optional) receives the achieved values.
+int set_rate_parameters(radio_modulation_t mod, uint32_t baud, uint32_t deviation_hz, uint32_t ppm, radio_parms_t * radio_parms, radio_rate_fit_t *fit)
+{
+    radio_rate_fit_t best;
+
+    if (radio_solve_rate(radio_parms->f_xtal, (uint32_t) radio_parms->freq_hz, baud, deviation_hz, ppm, &best)){
+        return 1;
+    }
+    radio_parms->modulation     = mod;
+    radio_parms->drate_hz       = baud;
+    radio_parms->mod_index_q16  = (uint32_t) (((uint64_t) deviation_hz << 16) / baud);
+    radio_parms->drate_e        = best.drate_e;
+    radio_parms->drate_m        = best.drate_m;
+    radio_parms->deviat_e       = best.deviat_e;
+    radio_parms->deviat_m       = best.deviat_m;
+    radio_parms->chanbw_e       = best.chanbw_e;
+    radio_parms->chanbw_m       = best.chanbw_m;
+    if (fit){
+        *fit = best;
+    }
+    return 0;
+}
+
+#define CC11xx_MCSM0_AUTOCAL     0x18   // MCSM0 of RADIO_CAL_EVERY: calibrate from IDLE to RX/TX
+#define CC11xx_MCSM0_AUTOCAL_4TH 0x38   // ... of RADIO_CAL_EVERY_4TH: every 4th time back to IDLE
+#define CC11xx_MCSM0_NO_AUTOCAL  0x08   // ... with FS_AUTOCAL never
+
+// MCSM0 of the calibration policy, PO_TIMEOUT 64 in all cases
+static uint8_t cal_mcsm0(const radio_parms_t *radio_parms)
+{
+    switch (radio_parms->cal_policy){
+        case RADIO_CAL_EVERY_4TH:
+            return CC11xx_MCSM0_AUTOCAL_4TH;
+        case RADIO_CAL_PERIODIC:
+        case RADIO_CAL_NEVER:
+            return CC11xx_MCSM0_NO_AUTOCAL;
+        default:
+            return CC11xx_MCSM0_AUTOCAL;
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Register image IOCFG2..TEST0 for radio_parms. Registers not set here keep their reset value.
+void radio_build_config(radio_parms_t * radio_parms, uint8_t image[CC11xx_NUM_CONFIG_REGS])
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  reg_word;
+
+    memcpy(image, config_reset_values, CC11xx_NUM_CONFIG_REGS);
+
+    // IOCFG2 = 0x00: Set in Rx mode (0x02 for Tx mode)
+    // o 0x00: Asserts when RX FIFO is filled at or above the RX FIFO threshold. 
+    //         De-asserts when RX FIFO is drained below the same threshold.
+    // o 0x02: Asserts when the TX FIFO is filled at or above the TX FIFO threshold.
+    //         De-asserts when the TX FIFO is below the same threshold.
+    // GDO2 changes depending on the mode
+    image[CC11xx_IOCFG2] = 0x00; // GDO2 output pin config.
+
+    // IOCFG0 = 0x06: Asserts when sync word has been sent / received, and de-asserts at the
+    // end of the packet. In RX, the pin will de-assert when the optional address
+    // check fails or the RX FIFO overflows. In TX the pin will de-assert if the TX
+    // FIFO underflows:    
+    // GDO0 never changes 
+    image[CC11xx_IOCFG0] = 0x06; // GDO0 output pin config.
+
+    // FIFO_THR = fifo_thr, 14 by default:
+    // o 5 bytes in TX FIFO (55 available spaces)
+    // o 60 bytes in the RX FIFO
+    image[CC11xx_FIFOTHR] = radio_parms->fifo_thr & 0x0F; // FIFO threshold.
+
+    // PKTLEN: packet length up to 255 bytes. Maximum accepted length in variable length mode.
+    image[CC11xx_PKTLEN] = radio_parms->packet_length; // Packet length.
+    
+    // PKTCTRL0: Packet automation control #0
+    // . bit  7:   unused
+    // . bit  6:   0  -> whitening off
+    // . bits 5:4: 00 -> normal mode use FIFOs for Rx and Tx
+    // . bit  3:   unused
+    // . bit  2:   1  -> CRC enabled
+    // . bits 1:0: xx -> Packet length mode. 00: FIXED (PKTLEN), 01: VARIABLE (first byte, up to PKTLEN),
+    //                   10: INFINITE (streams, switched to FIXED for their last bytes).
+    // CRC enabled by default
+    reg_word = pktctrl0_word(radio_parms);
+    image[CC11xx_PKTCTRL0] = reg_word; // Packet automation control.
+
+    // PKTCTRL1: Packet automation control #1
+    // . bits 7:5: 000 -> Preamble quality estimator threshold
+    // . bit  4:   unused
+    // . bit  3:   0   -> Automatic flush of Rx FIFO disabled (too many side constraints see doc)
+    // . bit  2:   1   -> Append two status bytes to the payload (RSSI and LQI + CRC OK)
+    // . bits 1:0: 00  -> No address check of received packets
+    image[CC11xx_PKTCTRL1] = 0x00; // Packet automation control.
+
+    image[CC11xx_ADDR] = 0x00; // Device address for packet filtration (unused, see just above).
+    image[CC11xx_CHANNR] = radio_parms->channr; // Channel number, see set_channel_plan().
+
+    // FSCTRL0: Frequency offset added to the base frequency before being used by the
+    // frequency synthesizer. (2s-complement). Multiplied by Fxtal/2^14
+		reg_word = get_offset_word(radio_parms->f_xtal, radio_parms->f_off);
+    image[CC11xx_FSCTRL0] = reg_word; // Freq synthesizer control.
+
+    // FSCTRL1: The desired IF frequency to employ in RX. Subtracted from FS base frequency
+    // in RX and controls the digital complex mixer in the demodulator. Multiplied by Fxtal/2^10
+    // Here 0.3046875 MHz (lowest point below 310 kHz)
+    radio_parms->if_word = get_if_word(radio_parms->f_xtal, radio_parms->f_if);
+    image[CC11xx_FSCTRL1] = (radio_parms->if_word & 0x1F); // Freq synthesizer control.
+
+    // FREQ2..0: Base frequency for the frequency sythesizer
+    // Fo = (Fxosc / 2^16) * FREQ[23..0]
+    // FREQ2 is FREQ[23..16]
+    // FREQ1 is FREQ[15..8]
+    // FREQ0 is FREQ[7..0]
+    // Fxtal = 26 MHz and FREQ = 0x10A762 => Fo = 432.99981689453125 MHz
+    radio_parms->freq_word = get_freq_word(radio_parms->f_xtal, radio_parms->freq_hz);
+    image[CC11xx_FREQ2] = ((radio_parms->freq_word>>16) & 0xFF); // Freq control word, high byte
+    image[CC11xx_FREQ1] = ((radio_parms->freq_word>>8)  & 0xFF); // Freq control word, mid byte.
+    image[CC11xx_FREQ0] = (radio_parms->freq_word & 0xFF);       // Freq control word, low byte.
+
+    if (radio_parms->drate_hz == 0){
+        get_rate_words(radio_parms->drate, radio_parms->mod_index_q16, radio_parms); // Otherwise solved already
+    }
+    // MODCFG4 Modem configuration - bandwidth and data rate exponent
+    // High nibble: Sets the decimation ratio for the delta-sigma ADC input stream hence the channel bandwidth
+    // . bits 7:6: 0  -> CHANBW_E: exponent parameter (see next)
+    // . bits 5:4: 2  -> CHANBW_M: mantissa parameter as per:
+    //      BW = Fxosc / 8(4+CHANBW_M).2^CHANBW_E => Here: BW = 26/48 MHz = 541.67 kHz
+    //      Factory defaults: M=0, E=1 => BW = 26/128 ~ 203 kHz
+    // Low nibble:
+    // . bits 3:0: 13 -> DRATE_E: data rate base 2 exponent => here 13 (multiply by 8192)
+    reg_word = (radio_parms->chanbw_e<<6) + (radio_parms->chanbw_m<<4) + radio_parms->drate_e;
+    image[CC11xx_MDMCFG4] = reg_word; // Modem configuration.
+
+    // MODCFG3 Modem configuration: DRATE_M data rate mantissa as per formula:
+    //    Rate = (256 + DRATE_M).2^DRATE_E.Fxosc / 2^28 
+    // Here DRATE_M = 59, DRATE_E = 13 => Rate = 250 kBaud
+    image[CC11xx_MDMCFG3] = radio_parms->drate_m; // Modem configuration.
+
+    // MODCFG2 Modem configuration: DC block, modulation, Manchester, sync word
+    // o bit 7:    0   -> Enable DC blocking (1: disable)
+    // o bits 6:4: xxx -> (provided)
+    // o bit 3:    0   -> Manchester disabled (1: enable)
+    // o bits 2:0: 011 -> Sync word qualifier is 30/32 (static init in radio interface)
+    reg_word = ((radio_parms->modulation)<<4) + radio_parms->sync_ctl;
+    image[CC11xx_MDMCFG2] = reg_word; // Modem configuration.
+
+    // MODCFG1 Modem configuration: FEC, Preamble, exponent for channel spacing
+    // o bit 7:    0   -> FEC disabled (1: enable)
+    // o bits 6:4: 2   -> number of preamble bytes (0:2, 1:3, 2:4, 3:6, 4:8, 5:12, 6:16, 7:24)
+    // o bits 3:2: unused
+    // o bits 1:0: CHANSPC_E: exponent of channel spacing, see set_channel_plan()
+    reg_word = (radio_parms->fec<<7) + (((int) radio_parms->preamble)<<4) + (radio_parms->chanspc_e);
+    image[CC11xx_MDMCFG1] = reg_word; // Modem configuration.
+
+    // MODCFG0 Modem configuration: CHANSPC_M: mantissa of channel spacing following this formula:
+    //    Df = (Fxosc / 2^18) * (256 + CHANSPC_M) * 2^CHANSPC_E
+    image[CC11xx_MDMCFG0] = radio_parms->chanspc_m; // Modem configuration.
+
+    // DEVIATN: Modem deviation
+    // o bit 7:    0   -> not used
+    // o bits 6:4: 0   -> DEVIATION_E: deviation exponent
+    // o bit 3:    0   -> not used
+    // o bits 2:0: 0   -> DEVIATION_M: deviation mantissa
+    //
+    //   Modulation  Formula
+    //
+    //   2-FSK    |  
+    //   4-FSK    :  Df = (Fxosc / 2^17) * (8 + DEVIATION_M) * 2^DEVIATION_E : Here: 1.5869140625 kHz
+    //   GFSK     |
+    //
+    //   MSK      :  Tx: not well documented, Rx: no effect
+    //
+    //   OOK      : No effect
+    //    
+    reg_word = (radio_parms->deviat_e<<4) + (radio_parms->deviat_m);
+    image[CC11xx_DEVIATN] = reg_word; // Modem dev (when FSK mod en)
+
+    // MCSM2: Main Radio State Machine. See documentation.
+    image[CC11xx_MCSM2] = 0x00; //MainRadio Cntrl State Machine
+
+    // MCSM1: Main Radio State Machine. 
+    // o bits 7:6: not used
+    // o bits 5:4: CCA_MODE: Clear Channel Indicator 
+    //   0 (00): Always clear
+    //   1 (01): Clear if RSSI below threshold
+    //   2 (10): Always claar unless receiving a packet
+    //   3 (11): Claar if RSSI below threshold unless receiving a packet
+    // o bits 3:2: RXOFF_MODE: Select to what state it should go when a packet has been received
+    //   0 (00): IDLE <== 
+    //   1 (01): FSTXON
+    //   2 (10): TX
+    //   3 (11): RX (stay)
+    // o bits 1:0: TXOFF_MODE: Select what should happen when a packet has been sent
+    //   0 (00): IDLE <==
+    //   1 (01): FSTXON
+    //   2 (10): TX (stay)
+    //   3 (11): RX 
+    image[CC11xx_MCSM1] = 0x30; //MainRadio Cntrl State Machine
 
     // MCSM0: Main Radio State Machine.
     // o bits 7:6: not used
@@ -349,502 +1386,1836 @@ int init_radio_config(spi_parms_t * spi_parms, radio_parms_t * radio_parms)
     //   3 (11): 256: Approx. 597 – 620 μs
     // o bit 1: PIN_CTRL_EN:   Enables the pin radio control option
     // o bit 0: XOSC_FORCE_ON: Force the XOSC to stay on in the SLEEP state.
-    CC_SPIWriteReg(spi_parms, CC11xx_MCSM0 ,   0x18); //MainRadio Cntrl State Machine
+    image[CC11xx_MCSM0] = cal_mcsm0(radio_parms); // FS_AUTOCAL from the calibration policy
+
+    // FOCCFG: Frequency Offset Compensation Configuration.
+    // o bits 7:6: not used
+    // o bit 5:    If set, the demodulator freezes the frequency offset compensation and clock
+    //             recovery feedback loops until the CS signal goes high.
+    // o bits 4:3: The frequency compensation loop gain to be used before a sync word is detected.
+    //   0 (00): K
+    //   1 (01): 2K
+    //   2 (10): 3K
+    //   3 (11): 4K
+    // o bit 2: FOC_POST_K: The frequency compensation loop gain to be used after a sync word is detected.
+    //   0: Same as FOC_PRE_K
+    //   1: K/2
+    // o bits 1:0: FOC_LIMIT: The saturation point for the frequency offset compensation algorithm:
+    //   0 (00): ±0 (no frequency offset compensation)
+    //   1 (01): ±BW CHAN /8
+    //   2 (10): ±BW CHAN /4
+    //   3 (11): ±BW CHAN /2
+    image[CC11xx_FOCCFG] = 0x1D; // Freq Offset Compens. Config
+
+    // BSCFG:Bit Synchronization Configuration
+    // o bits 7:6: BS_PRE_KI: Clock recovery loop integral gain before sync word
+    //   0 (00): Ki
+    //   1 (01): 2Ki
+    //   2 (10): 3Ki
+    //   3 (11): 4Ki
+    // o bits 5:4: BS_PRE_KP: Clock recovery loop proportional gain before sync word
+    //   0 (00): Kp
+    //   1 (01): 2Kp
+    //   2 (10): 3Kp
+    //   3 (11): 4Kp
+    // o bit 3: BS_POST_KI: Clock recovery loop integral gain after sync word
+    //   0: Same as BS_PRE_KI
+    //   1: Ki/2
+    // o bit 2: BS_POST_KP: Clock recovery loop proportional gain after sync word
+    //   0: Same as BS_PRE_KP
+    //   1: Kp
+    // o bits 1:0: BS_LIMIT: Data rate offset saturation (max data rate difference)
+    //   0 (00): ±0 (No data rate offset compensation performed)
+    //   1 (01): ±3.125 % data rate offset
+    //   2 (10): ±6.25 % data rate offset
+    //   3 (11): ±12.5 % data rate offset
+    image[CC11xx_BSCFG] = 0x1C; //  Bit synchronization config.
+
+    // AGCCTRL2: AGC Control
+    // o bits 7:6: MAX_DVGA_GAIN. Allowable DVGA settings
+    //   0 (00): All gain settings can be used
+    //   1 (01): The highest gain setting can not be used
+    //   2 (10): The 2 highest gain settings can not be used
+    //   3 (11): The 3 highest gain settings can not be used
+    // o bits 5:3: MAX_LNA_GAIN. Maximum allowable LNA + LNA 2 gain relative to the maximum possible gain.
+    //   0 (000): Maximum possible LNA + LNA 2 gain
+    //   1 (001): Approx. 2.6 dB below maximum possible gain
+    //   2 (010): Approx. 6.1 dB below maximum possible gain
+    //   3 (011): Approx. 7.4 dB below maximum possible gain
+    //   4 (100): Approx. 9.2 dB below maximum possible gain
+    //   5 (101): Approx. 11.5 dB below maximum possible gain
+    //   6 (110): Approx. 14.6 dB below maximum possible gain
+    //   7 (111): Approx. 17.1 dB below maximum possible gain
+    // o bits 2:0: MAGN_TARGET: target value for the averaged amplitude from the digital channel filter (1 LSB = 0 dB).
+    //   0 (000): 24 dB
+    //   1 (001): 27 dB
+    //   2 (010): 30 dB
+    //   3 (011): 33 dB
+    //   4 (100): 36 dB
+    //   5 (101): 38 dB
+    //   6 (110): 40 dB
+    //   7 (111): 42 dB
+    image[CC11xx_AGCCTRL2] = 0xC7; // AGC control.
+
+    // AGCCTRL1: AGC Control
+    // o bit 7: not used
+    // o bit 6: AGC_LNA_PRIORITY: Selects between two different strategies for LNA and LNA 2 gain
+    //   0: the LNA 2 gain is decreased to minimum before decreasing LNA gain
+    //   1: the LNA gain is decreased first.
+    // o bits 5:4: CARRIER_SENSE_REL_THR: Sets the relative change threshold for asserting carrier sense
+    //   0 (00): Relative carrier sense threshold disabled
+    //   1 (01): 6 dB increase in RSSI value
+    //   2 (10): 10 dB increase in RSSI value
+    //   3 (11): 14 dB increase in RSSI value
+    // o bits 3:0: CARRIER_SENSE_ABS_THR: Sets the absolute RSSI threshold for asserting carrier sense. 
+    //   The 2-complement signed threshold is programmed in steps of 1 dB and is relative to the MAGN_TARGET setting.
+    //   0 is at MAGN_TARGET setting.
+    image[CC11xx_AGCCTRL1] = 0x00; // AGC control.
+
+    // AGCCTRL0: AGC Control
+    // o bits 7:6: HYST_LEVEL: Sets the level of hysteresis on the magnitude deviation
+    //   0 (00): No hysteresis, small symmetric dead zone, high gain
+    //   1 (01): Low hysteresis, small asymmetric dead zone, medium gain
+    //   2 (10): Medium hysteresis, medium asymmetric dead zone, medium gain
+    //   3 (11): Large hysteresis, large asymmetric dead zone, low gain
+    // o bits 5:4: WAIT_TIME: Sets the number of channel filter samples from a gain adjustment has
+    //   been made until the AGC algorithm starts accumulating new samples.
+    //   0 (00):  8
+    //   1 (01): 16
+    //   2 (10): 24
+    //   3 (11): 32
+    // o bits 3:2: AGC_FREEZE: Control when the AGC gain should be frozen.
+    //   0 (00): Normal operation. Always adjust gain when required.
+    //   1 (01): The gain setting is frozen when a sync word has been found.
+    //   2 (10): Manually freeze the analogue gain setting and continue to adjust the digital gain. 
+    //   3 (11): Manually freezes both the analogue and the digital gain setting. Used for manually overriding the gain.
+    // o bits 0:1: FILTER_LENGTH: 
+    //   2-FSK, 4-FSK, MSK: Sets the averaging length for the amplitude from the channel filter.    |  
+    //   ASK ,OOK: Sets the OOK/ASK decision boundary for OOK/ASK reception.
+    //   Value : #samples: OOK/ASK decixion boundary
+    //   0 (00):        8: 4 dB
+    //   1 (01):       16: 8 dB
+    //   2 (10):       32: 12 dB
+    //   3 (11):       64: 16 dB  
+    image[CC11xx_AGCCTRL0] = 0xB2; // AGC control.
+
+    // FREND1: Front End RX Configuration
+    // o bits 7:6: LNA_CURRENT: Adjusts front-end LNA PTAT current output
+    // o bits 5:4: LNA2MIX_CURRENT: Adjusts front-end PTAT outputs
+    // o bits 3:2: LODIV_BUF_CURRENT_RX: Adjusts current in RX LO buffer (LO input to mixer)
+    // o bits 1:0: MIX_CURRENT: Adjusts current in mixer
+    image[CC11xx_FREND1] = 0xB6; // Front end RX configuration.
+
+    // FREND0: Front End TX Configuration
+    // o bits 7:6: not used
+    // o bits 5:4: LODIV_BUF_CURRENT_TX: Adjusts current TX LO buffer (input to PA). The value to use
+    //   in this field is given by the SmartRF Studio software
+    // o bit 3: not used
+    // o bits 1:0: PA_POWER: Selects PA power setting. This value is an index to the PATABLE, 
+    //   which can be programmed with up to 8 different PA settings. In OOK/ASK mode, this selects the PATABLE
+    //   index to use when transmitting a ‘1’. PATABLE index zero is used in OOK/ASK when transmitting a ‘0’. 
+    //   The PATABLE settings from index ‘0’ to the PA_POWER value are used for ASK TX shaping, 
+    //   and for power ramp-up/ramp-down at the start/end of transmission in all TX modulation formats.
+    image[CC11xx_FREND0] = 0x10; // Front end RX configuration.
+
+    // FSCAL3: Frequency Synthesizer Calibration
+    // o bits 7:6: The value to write in this field before calibration is given by the SmartRF
+    //   Studio software.
+    // o bits 5:4: CHP_CURR_CAL_EN: Disable charge pump calibration stage when 0.
+    // o bits 3:0: FSCAL3: Frequency synthesizer calibration result register.
+    image[CC11xx_FSCAL3] = 0xEA; // Frequency synthesizer cal.
+
+    // FSCAL2: Frequency Synthesizer Calibration
+    image[CC11xx_FSCAL2] = 0x0A; // Frequency synthesizer cal.
+    image[CC11xx_FSCAL1] = 0x00; // Frequency synthesizer cal.
+    image[CC11xx_FSCAL0] = 0x11; // Frequency synthesizer cal.
+    image[CC11xx_FSTEST] = 0x59; // Frequency synthesizer cal.
+
+    // TEST2: Various test settings. The value to write in this field is given by the SmartRF Studio software.
+    image[CC11xx_TEST2] = 0x88; // Various test settings.
+
+    // TEST1: Various test settings. The value to write in this field is given by the SmartRF Studio software.
+    image[CC11xx_TEST1] = 0x31; // Various test settings.
+
+    // TEST0: Various test settings. The value to write in this field is given by the SmartRF Studio software.
+    image[CC11xx_TEST0] = 0x09; // Various test settings.
+}
+
+// ------------------------------------------------------------------------------------------------
+// Reset the chip and write the whole configuration in a single burst. CC_SPIWriteBurstReg() sends
+// the image straight from the stack through SPI_TRANSFER_SG, after the header byte.
+int init_radio_config(spi_parms_t * spi_parms, radio_parms_t * radio_parms)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  image[CC11xx_NUM_CONFIG_REGS];
+    int      ret;
+
+    radio_build_config(radio_parms, image);
+
+    // Write register settings
+    backend_it_disable(spi_parms);
+
+    CC_PowerupResetCCxxxx(spi_parms);
+    
+    /* Patable Write here? */
+
+    ret = CC_SPIWriteBurstReg(spi_parms, CC11xx_IOCFG2, image, CC11xx_NUM_CONFIG_REGS);
+
+    backend_it_enable(spi_parms);
+
+    return ret;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Read back IOCFG2..TEST0 in a single burst, e.g. to check it against radio_build_config(). FSCAL3..1
+// hold calibration results and differ from the written image once the synthesizer has calibrated.
+int radio_read_config(spi_parms_t * spi_parms, uint8_t image[CC11xx_NUM_CONFIG_REGS])
+// ------------------------------------------------------------------------------------------------
+{
+    return CC_SPIReadBurstReg(spi_parms, CC11xx_IOCFG2, image, CC11xx_NUM_CONFIG_REGS);
+}
+
+
+int set_freq(spi_parms_t * spi_parms, radio_parms_t * radio_parms)
+{
+    // FREQ2..0: Base frequency for the frequency sythesizer
+    // Fo = (Fxosc / 2^16) * FREQ[23..0]
+    // FREQ2 is FREQ[23..16]
+    // FREQ1 is FREQ[15..8]
+    // FREQ0 is FREQ[7..0]
+    // Fxtal = 26 MHz and FREQ = 0x10A762 => Fo = 432.99981689453125 MHz
+    cc11xx_batch_t batch;
+
+    radio_parms->freq_word = get_freq_word(radio_parms->f_xtal, radio_parms->freq_hz);
+    CC_BatchInit(&batch, spi_parms);
+    CC_BatchWriteReg(&batch, CC11xx_FREQ2,    ((radio_parms->freq_word>>16) & 0xFF)); // Freq control word, high byte
+    CC_BatchWriteReg(&batch, CC11xx_FREQ1,    ((radio_parms->freq_word>>8)  & 0xFF)); // Freq control word, mid byte.
+    CC_BatchWriteReg(&batch, CC11xx_FREQ0,    (radio_parms->freq_word & 0xFF));       // Freq control word, low byte.
+    return CC_BatchRun(&batch);
+}
+
+/* Calibration cache. FS_AUTOCAL (MCSM0) calibrates the synthesizer on every IDLE to RX/TX
+ * transition, about 720 us. For hopping, each channel is calibrated once with SCAL and its
+ * FSCAL3..1 kept; a hop turns autocalibration off and writes the channel and FSCAL3..1 back
+ * (DN505), so the transition only takes the settling time. Calibrate again when the temperature
+ * has drifted by more than a few tens of degrees. A channel is FREQ2..0 with CHANNR. */
+
+static radio_cal_entry_t *cal_lookup(radio_cal_cache_t *cal, const uint8_t freq[3], uint8_t channr)
+{
+    uint8_t i;
+
+    for (i = 0; i < cal->count; i++){
+        if ((memcmp(cal->entry[i].freq, freq, 3) == 0) && (cal->entry[i].channr == channr)){
+            return &cal->entry[i];
+        }
+    }
+    return NULL;
+}
+
+static void cal_freq_bytes(uint32_t word, uint8_t freq[3])
+{
+    freq[0] = (word >> 16) & 0xFF;
+    freq[1] = (word >> 8) & 0xFF;
+    freq[2] = word & 0xFF;
+}
+
+static uint32_t cal_cycles(void)
+{
+#ifdef CC11xx_CYCLES
+    return CC11xx_CYCLES();
+#else
+    return 0;
+#endif
+}
+
+// Calibrate on FREQ2..0 freq and channel channr and store the result, the radio goes back to RX
+// on its current channel. Interrupts masked by the caller.
+static int cal_store(radio_int_data_t *radio, const uint8_t freq[3], uint8_t channr)
+{
+    radio_cal_cache_t *cal = (radio_cal_cache_t *) &radio->cal;
+    radio_cal_entry_t *entry;
+    cc11xx_batch_t batch;
+    uint8_t saved_freq[3], saved_fscal[3];
+    uint32_t start;
+    int ret;
+
+    if ((radio->mode != RADIOMODE_RX) || radio->packet_receive){
+        return 1;
+    }
+    entry = cal_lookup(cal, freq, channr); // Calibrated again if already there
+    if (entry == NULL){
+        if (cal->count >= CC11xx_CAL_CHANNELS){
+            return 1;
+        }
+        entry = &cal->entry[cal->count]; // Counted once calibrated
+        memcpy(entry->freq, freq, 3);
+        entry->channr = channr;
+    }
+    CC_BatchInit(&batch, radio->spi_parms);
+    CC_BatchStrobe(&batch, CC11xx_SIDLE);
+    CC_BatchReadBurst(&batch, CC11xx_FREQ2, saved_freq, 3);   // Current channel, restored afterwards
+    CC_BatchReadBurst(&batch, CC11xx_FSCAL3, saved_fscal, 3);
+    CC_BatchWriteBurst(&batch, CC11xx_FREQ2, entry->freq, 3);
+    CC_BatchWriteReg(&batch, CC11xx_CHANNR, channr);
+    CC_BatchStrobe(&batch, CC11xx_SCAL);
+    start = stats_begin(radio);
+    ret = CC_BatchRun(&batch);
+    wait_for_state(radio->spi_parms, CC11xx_STATE_IDLE, 2);
+    stats_end(radio, (radio_isr_time_t *) &radio->stats.calibration, start);
+
+    CC_BatchInit(&batch, radio->spi_parms);
+    CC_BatchReadBurst(&batch, CC11xx_FSCAL3, entry->fscal, 3);
+    CC_BatchWriteBurst(&batch, CC11xx_FREQ2, saved_freq, 3);
+    CC_BatchWriteReg(&batch, CC11xx_CHANNR, radio->radio_parms->channr);
+    CC_BatchWriteBurst(&batch, CC11xx_FSCAL3, saved_fscal, 3);
+    CC_BatchStrobe(&batch, CC11xx_SFRX);
+    ret |= CC_BatchRun(&batch);
+    if ((ret == 0) && (entry == &cal->entry[cal->count])){
+        cal->count++;
+    }
+    radio_turn_rx_isr(radio);
+    return ret;
+}
+
+// Start SCAL on the current channel through IDLE, RX FIFO flushed. The chip is left calibrating.
+static int cal_scal_start(radio_int_data_t *radio)
+{
+    cc11xx_batch_t batch;
+
+    CC_BatchInit(&batch, radio->spi_parms);
+    CC_BatchStrobe(&batch, CC11xx_SIDLE);
+    CC_BatchStrobe(&batch, CC11xx_SFRX);
+    CC_BatchStrobe(&batch, CC11xx_SCAL);
+    return CC_BatchRun(&batch);
+}
+
+// Restart the RADIO_CAL_PERIODIC triggers after a calibration
+static void cal_rearm(radio_int_data_t *radio)
+{
+    radio->cal_next = CC11xx_TIMESTAMP() + radio->radio_parms->cal_period_ms;
+    radio->cal_temp_ref = radio->cal_temp;
+}
+
+// Calibrate the synthesizer on the current channel with SCAL and wait for it (about 720 us), the
+// radio is left in IDLE. Restarts the RADIO_CAL_PERIODIC triggers. Interrupts masked by the caller.
+static int cal_scal(radio_int_data_t *radio)
+{
+    uint32_t start;
+    int ret;
+
+    start = stats_begin(radio);
+    ret = cal_scal_start(radio);
+    wait_for_state(radio->spi_parms, CC11xx_STATE_IDLE, 2);
+    stats_end(radio, (radio_isr_time_t *) &radio->stats.calibration, start);
+    cal_rearm(radio);
+    return ret;
+}
+
+// Retune to FREQ2..0 freq and channel channr and go back to RX: with autocalibration off and the
+// FSCAL3..1 of entry, or calibrating as the policy says when entry is NULL (SCAL unless it is
+// RADIO_CAL_EVERY). Registers holding the value
+// already are not written. Interrupts masked by the caller.
+static int cal_retune(radio_int_data_t *radio, const uint8_t freq[3], uint8_t channr, const radio_cal_entry_t *entry, uint32_t *hop_us)
+{
+    radio_cal_cache_t *cal = (radio_cal_cache_t *) &radio->cal;
+    cc11xx_batch_t batch;
+    uint8_t mcsm0 = entry ? CC11xx_MCSM0_NO_AUTOCAL : cal_mcsm0(radio->radio_parms);
+    uint32_t start;
+    int ret;
+
+    start = cal_cycles();
+    CC_BatchInit(&batch, radio->spi_parms);
+    CC_BatchStrobe(&batch, CC11xx_SIDLE);
+    CC_BatchWriteReg(&batch, CC11xx_MCSM0, mcsm0);
+    CC_BatchWriteReg(&batch, CC11xx_FREQ2, freq[0]);
+    CC_BatchWriteReg(&batch, CC11xx_FREQ1, freq[1]);
+    CC_BatchWriteReg(&batch, CC11xx_FREQ0, freq[2]);
+    CC_BatchWriteReg(&batch, CC11xx_CHANNR, channr);
+    if (entry){
+        CC_BatchWriteBurst(&batch, CC11xx_FSCAL3, entry->fscal, 3);
+    }
+    CC_BatchStrobe(&batch, CC11xx_SFRX); // Whatever came in before the sync word
+    ret = CC_BatchRun(&batch);
+    if (!entry && (mcsm0 != CC11xx_MCSM0_AUTOCAL)){
+        ret |= cal_scal(radio);
+    }
+    radio->radio_parms->freq_word = ((uint32_t) freq[0] << 16) | ((uint32_t) freq[1] << 8) | freq[2];
+    radio->radio_parms->channr = channr;
+    radio_turn_rx_isr(radio);
+    wait_for_state(radio->spi_parms, CC11xx_STATE_RX, (mcsm0 == CC11xx_MCSM0_AUTOCAL) ? 2 : 1);
+#ifdef CC11xx_CYCLES_PER_US
+    cal->last_hop_us = (cal_cycles() - start) / CC11xx_CYCLES_PER_US;
+#else
+    (void) start;
+#endif
+    cal->active = (entry != NULL);
+    if (hop_us){
+        *hop_us = cal->last_hop_us;
+    }
+    return ret;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Calibrate the synthesizer on freq_hz (on the current CHANNR) and keep the result for
+// radio_hop(). Run at startup for every channel of the hopping sequence; the radio goes back to
+// RX on its current channel. Takes about a calibration time with the interrupts masked. Returns 1
+// if the cache is full or a packet is on the way.
+int radio_cal_channel(radio_int_data_t *radio, float freq_hz)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t freq[3];
+    int ret;
+
+    cal_freq_bytes(get_freq_word(radio->radio_parms->f_xtal, freq_hz), freq);
+    disable_IT(radio);
+    ret = cal_store(radio, freq, radio->radio_parms->channr);
+    enable_IT(radio);
+    return ret;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Calibrate every channel of the channel plan (set_channel_plan()) for radio_set_channel(), as
+// many as the cache holds. Returns 1 if some were left out.
+int radio_cal_plan(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t freq[3];
+    uint16_t channel;
+    int ret = 0;
+
+    cal_freq_bytes(radio->radio_parms->freq_word, freq);
+    for (channel = 0; channel < radio->radio_parms->chan_count; channel++){
+        disable_IT(radio);
+        ret |= cal_store(radio, freq, (uint8_t) channel);
+        enable_IT(radio);
+    }
+    return ret;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Retune to a channel calibrated by radio_cal_channel(): IDLE, FREQ2..0 and FSCAL3..1 restored
+// with autocalibration off, then back to RX. The time from IDLE to RX is returned in hop_us (may
+// be NULL). Returns 1 if the channel is not calibrated or a packet is on the way, the radio then
+// stays where it is.
+int radio_hop(radio_int_data_t *radio, float freq_hz, uint32_t *hop_us)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_cal_entry_t *entry;
+    uint8_t freq[3];
+    int ret;
+
+    cal_freq_bytes(get_freq_word(radio->radio_parms->f_xtal, freq_hz), freq);
+    disable_IT(radio);
+    entry = cal_lookup((radio_cal_cache_t *) &radio->cal, freq, radio->radio_parms->channr);
+    if ((entry == NULL) || (radio->mode != RADIOMODE_RX) || radio->packet_receive){
+        enable_IT(radio);
+        return 1;
+    }
+    ret = cal_retune(radio, freq, radio->radio_parms->channr, entry, hop_us);
+    radio->radio_parms->freq_hz = freq_hz;
+    radio->cal.hops++;
+    enable_IT(radio);
+    return ret;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Switch to channel of the channel plan and go back to RX. Only CHANNR changes (plus FSCAL3..1
+// when the channel is in the calibration cache, see radio_cal_plan(), otherwise the chip
+// calibrates on the way to RX). The time from IDLE to RX is returned in hop_us (may be NULL).
+// Returns 1 if the channel is out of the plan or a packet is on the way.
+int radio_set_channel(radio_int_data_t *radio, uint8_t channel, uint32_t *hop_us)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t freq[3];
+    int ret;
+
+    if (channel >= radio->radio_parms->chan_count){
+        return 1;
+    }
+    cal_freq_bytes(radio->radio_parms->freq_word, freq);
+    disable_IT(radio);
+    if ((radio->mode != RADIOMODE_RX) || radio->packet_receive){
+        enable_IT(radio);
+        return 1;
+    }
+    ret = cal_retune(radio, freq, channel, cal_lookup((radio_cal_cache_t *) &radio->cal, freq, channel), hop_us);
+    radio->cal.hops++;
+    enable_IT(radio);
+    return ret;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Forget the calibrated channels and give MCSM0 back to the calibration policy
+void radio_cal_clear(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    disable_IT(radio);
+    radio->cal.count = 0;
+    if (radio->cal.active){
+        CC_SPIWriteReg(radio->spi_parms, CC11xx_MCSM0, cal_mcsm0(radio->radio_parms));
+        radio->cal.active = 0;
+    }
+    enable_IT(radio);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Chip temperature for the RADIO_CAL_PERIODIC temperature trigger, in degrees. The CC1101 sensor
+// is analog only (GDO0 with PTEST), so the application measures it and reports it here; the
+// calibration itself is done by radio_tx_process().
+void radio_cal_temperature(radio_int_data_t *radio, int16_t temp_c)
+// ------------------------------------------------------------------------------------------------
+{
+    disable_IT(radio);
+    radio->cal_temp = temp_c;
+    if (!radio->cal_temp_valid){
+        radio->cal_temp_ref = temp_c; // First reading: the calibration at startup was done at it
+        radio->cal_temp_valid = 1;
+    }
+    enable_IT(radio);
+}
+
+// RADIO_CAL_PERIODIC: calibrate when the period has elapsed or the temperature has drifted, if
+// the radio is only listening. Does not wait for the calibration: SCAL is started here with the
+// radio in RADIOMODE_CAL (GDO lines ignored, TX queue held), a later call finds the chip back in
+// IDLE with one status read and returns to RX. Interrupts masked by the caller.
+static void cal_poll(radio_int_data_t *radio)
+{
+    radio_parms_t *radio_parms = radio->radio_parms;
+    int32_t drift = (int32_t) radio->cal_temp - radio->cal_temp_ref;
+    uint8_t due;
+
+    if (radio->mode == RADIOMODE_CAL){
+        if (CC_SPIRefreshStatus(radio->spi_parms) || (radio->spi_parms->chip_state != CC11xx_STATUS_IDLE)){
+            return; // Still calibrating
+        }
+        cal_rearm(radio);
+        radio_turn_rx_isr(radio);
+        return;
+    }
+    if ((radio_parms->cal_policy != RADIO_CAL_PERIODIC) || (radio->mode != RADIOMODE_RX) || radio->packet_receive
+        || radio->packet_send || radio->tx_queue.on_air || radio->turnaround_hold){
+        return;
+    }
+    due = (radio_parms->cal_period_ms != 0) && ((int32_t) (CC11xx_TIMESTAMP() - radio->cal_next) >= 0);
+    if (radio->cal_temp_valid && (radio_parms->cal_temp_delta != 0)){
+        due |= (drift >= radio_parms->cal_temp_delta) || (-drift >= radio_parms->cal_temp_delta);
+    }
+    if (due){
+        if (cal_scal_start(radio) == 0){
+            radio->mode = RADIOMODE_CAL;
+        }else{
+            radio_turn_rx_isr(radio); // Try again on the next call
+        }
+    }
+}
+
+/* RSSI scan. The radio leaves packet reception (RADIOMODE_SCAN, the interrupts ignore the GDO
+ * lines and the TX queue waits) and steps through a list of channels of the channel plan: IDLE,
+ * CHANNR and the cached FSCAL3..1 in one batch, RX, a fixed wait, then one RSSI read. No state
+ * polling, so a point takes the settling time plus a few SPI transactions. */
+
+// ------------------------------------------------------------------------------------------------
+// Wait from SRX to a valid RSSI: synthesizer settling, then two RSSI updates of 8 channel filter
+// samples each, taken at about the channel filter bandwidth
+uint32_t radio_scan_settle_us(const radio_parms_t *radio_parms)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t chanbw_hz = radio_parms->f_xtal / (8 * (4 + radio_parms->chanbw_m) * (1 << radio_parms->chanbw_e));
+
+    return CC11xx_SCAN_FS_SETTLE_US + (2 * 8 * 1000000 + chanbw_hz - 1) / chanbw_hz;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Enter the RSSI scan on count channels (CHANNR values), raw RSSI readings go to rssi. Channels
+// not in the calibration cache are calibrated now as far as it has room, the others calibrate on
+// each point. Returns 1 if a packet is on the way or a channel is out of the plan.
+int radio_scan_start(radio_int_data_t *radio, radio_scan_t *scan, const uint8_t *channels, uint16_t count, uint8_t *rssi)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t freq[3];
+    uint16_t i;
+
+    for (i = 0; i < count; i++){
+        if (channels[i] >= radio->radio_parms->chan_count){
+            return 1;
+        }
+    }
+    scan->channels = channels;
+    scan->count = count;
+    scan->rssi = rssi;
+    scan->settle_us = radio_scan_settle_us(radio->radio_parms);
+    scan->sweeps = 0;
+    scan->sweep_us = 0;
+
+    cal_freq_bytes(radio->radio_parms->freq_word, freq);
+    for (i = 0; i < count; i++){
+        disable_IT(radio);
+        if (!cal_lookup((radio_cal_cache_t *) &radio->cal, freq, channels[i])){
+            cal_store(radio, freq, channels[i]); // Full cache: calibrated on each point
+        }
+        enable_IT(radio);
+    }
+    disable_IT(radio);
+    if ((radio->mode != RADIOMODE_RX) || radio->packet_receive){
+        enable_IT(radio);
+        return 1;
+    }
+    radio->mode = RADIOMODE_SCAN;
+    enable_IT(radio);
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// One sweep over the channels of the scan, the raw RSSI of each point in scan->rssi (convert with
+// radio_scan_dbm()). Channels missing from the calibration cache are calibrated as the policy says,
+// as on a hop. Returns 1 if the radio is not scanning or an SPI access failed.
+int radio_scan_sweep(radio_int_data_t *radio, radio_scan_t *scan)
+// ------------------------------------------------------------------------------------------------
+{
+    const radio_cal_entry_t *entry;
+    cc11xx_batch_t batch;
+    uint8_t freq[3];
+    uint8_t mcsm0, scal;
+    uint32_t start;
+    uint16_t i;
+    int ret = 0;
+
+    if (radio->mode != RADIOMODE_SCAN){
+        return 1;
+    }
+    cal_freq_bytes(radio->radio_parms->freq_word, freq);
+    start = cal_cycles();
+    for (i = 0; i < scan->count; i++){
+        entry = cal_lookup((radio_cal_cache_t *) &radio->cal, freq, scan->channels[i]);
+        mcsm0 = entry ? CC11xx_MCSM0_NO_AUTOCAL : cal_mcsm0(radio->radio_parms);
+        scal = !entry && (mcsm0 != CC11xx_MCSM0_AUTOCAL);
+        disable_IT(radio);
+        CC_BatchInit(&batch, radio->spi_parms);
+        CC_BatchStrobe(&batch, CC11xx_SIDLE);
+        CC_BatchWriteReg(&batch, CC11xx_MCSM0, mcsm0);
+        CC_BatchWriteReg(&batch, CC11xx_CHANNR, scan->channels[i]);
+        if (entry){
+            CC_BatchWriteBurst(&batch, CC11xx_FSCAL3, entry->fscal, 3);
+        }
+        CC_BatchStrobe(&batch, CC11xx_SFRX);
+        if (!scal){
+            CC_BatchStrobe(&batch, CC11xx_SRX);
+        }
+        ret |= CC_BatchRun(&batch);
+        if (scal){
+            ret |= cal_scal(radio); // Autocalibration off: SCAL first, as cal_retune() does
+            ret |= CC_SPIStrobe(radio->spi_parms, CC11xx_SRX);
+        }
+        enable_IT(radio);
+        USLEEP(scan->settle_us + ((mcsm0 == CC11xx_MCSM0_AUTOCAL) ? CC11xx_SCAN_CAL_US : 0));
+        disable_IT(radio);
+        ret |= CC_SPIReadStatus(radio->spi_parms, CC11xx_RSSI, &scan->rssi[i]);
+        enable_IT(radio);
+    }
+#ifdef CC11xx_CYCLES_PER_US
+    scan->sweep_us = (cal_cycles() - start) / CC11xx_CYCLES_PER_US;
+#else
+    (void) start;
+#endif
+    scan->sweeps++;
+    return ret;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Leave the RSSI scan: back to RX on the current channel of the plan
+void radio_scan_stop(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t freq[3];
+    uint8_t channr = radio->radio_parms->channr;
+
+    if (radio->mode != RADIOMODE_SCAN){
+        return;
+    }
+    cal_freq_bytes(radio->radio_parms->freq_word, freq);
+    disable_IT(radio);
+    cal_retune(radio, freq, channr, cal_lookup((radio_cal_cache_t *) &radio->cal, freq, channr), NULL);
+    enable_IT(radio);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Convert the raw RSSI of the last sweep to dBm, count values into dbm
+void radio_scan_dbm(const radio_scan_t *scan, float *dbm)
+// ------------------------------------------------------------------------------------------------
+{
+    uint16_t i;
+
+    for (i = 0; i < scan->count; i++){
+        dbm[i] = rssi_dbm(scan->rssi[i]);
+    }
+}
+
+
+// ------------------------------------------------------------------------------------------------
+// Calculate RSSI in dBm from decimal RSSI read out of RSSI status register
+float rssi_dbm(uint8_t rssi_dec)
+// ------------------------------------------------------------------------------------------------
+{
+    if (rssi_dec < 128)
+    {
+        return (rssi_dec / 2.0) - 74.0;
+    }
+    else
+    {
+        return ((rssi_dec - 256) / 2.0) - 74.0;
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Calculate frequency word FREQ[23..0]
+uint32_t get_freq_word(uint32_t freq_xtal, uint32_t freq_hz)
+// ------------------------------------------------------------------------------------------------
+{
+    uint64_t res; // calculate on 64 bits to save precision
+    res = ((uint64_t) freq_hz * (uint64_t) (1<<16)) / ((uint64_t) freq_xtal);
+    return (uint32_t) res;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Calculate frequency word FREQ[23..0]
+uint32_t get_if_word(uint32_t freq_xtal, uint32_t if_hz)
+// ------------------------------------------------------------------------------------------------
+{
+    return (if_hz * (1<<10)) / freq_xtal;
+}
+
+uint8_t get_offset_word(uint32_t freq_xtal, uint32_t offset_hz)
+{
+		return ((offset_hz * (1 << 14)) / freq_xtal) &0xFF;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Calculate CHANBW words according to CC1101 bandwidth steps
+void get_chanbw_words(float bw, radio_parms_t *radio_parms)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t bw_hz = (uint32_t) bw;
+
+    radio_parms->chanbw_e = CC11xx_CHANBW_E(bw_hz);
+    radio_parms->chanbw_m = CC11xx_CHANBW_M(bw_hz);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Calculate data rate, channel bandwidth and deviation words, see cc1101_profiles.h. Data rate words
+// come from the rate table for the default crystal. mod_index_q16 is the modulation index in Q16
+// (CC11xx_MOD_INDEX_Q16()), integer arithmetic only.
+void get_rate_words(rate_t data_rate, uint32_t mod_index_q16, radio_parms_t *radio_parms)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t drate, f_xtal, bw;
+    uint64_t deviat_q16;
+
+    drate = rate_words[data_rate].rate;
+    deviat_q16 = CC11xx_RATE_DEVIAT_Q16(drate, mod_index_q16);
+    f_xtal = radio_parms->f_xtal;
+
+    bw = CC11xx_CARSON_BW_Q16(drate, deviat_q16); // Apply Carson's rule for bandwidth
+    radio_parms->chanbw_e = CC11xx_CHANBW_E(bw);
+    radio_parms->chanbw_m = CC11xx_CHANBW_M(bw);
+
+    if (f_xtal == CC11xx_F_XTAL){
+        radio_parms->drate_e = rate_words[data_rate].drate_e;
+        radio_parms->drate_m = rate_words[data_rate].drate_m;
+    }else{
+        radio_parms->drate_e = CC11xx_DRATE_E(drate, f_xtal);
+        radio_parms->drate_m = CC11xx_DRATE_M(drate, f_xtal);
+    }
+
+    radio_parms->deviat_e = CC11xx_DEVIAT_E_Q16(deviat_q16, f_xtal);
+    radio_parms->deviat_m = CC11xx_DEVIAT_M_Q16(deviat_q16, f_xtal);
+
+    radio_parms->chanspc_e &= 0x03; // it is 2 bits long
+}
+
+// ------------------------------------------------------------------------------------------------
+// Error of (base + m) * 2^e * f_xtal / 2^shift against target, in ppm of the target
+static int32_t word_error_ppm(uint32_t f_xtal, uint32_t base, uint8_t m, uint8_t e, uint8_t shift, uint32_t target)
+// ------------------------------------------------------------------------------------------------
+{
+    int64_t achieved = ((int64_t) f_xtal * (base + m)) << e;
+    int64_t wanted = (int64_t) target << shift;
+    int64_t ppm;
+
+    if (target == 0){
+        return 0;
+    }
+    ppm = ((achieved - wanted) * 1000) / (wanted / 1000);
+    if (ppm > INT32_MAX){
+        return INT32_MAX;
+    }
+    return (int32_t) ppm; // Never below -1000000
+}
+
+// ------------------------------------------------------------------------------------------------
+// Search all DRATE, DEVIATION and CHANBW words for a data rate (Baud) and deviation (Hz): the closest
+// data rate and deviation, and the narrowest channel filter that holds Carson's bandwidth plus the
+// drift of two crystals off by ppm at freq_hz. Returns 1 when the data rate can not be reached
+// within 1%, a deviation within 10% (the mantissa steps are up to 12.5% apart) or no filter is
+// wide enough; fit still holds the closest words and what they achieve.
+int radio_solve_rate(uint32_t f_xtal, uint32_t freq_hz, uint32_t baud, uint32_t deviation_hz, uint32_t ppm, radio_rate_fit_t *fit)
+// ------------------------------------------------------------------------------------------------
+{
+    int32_t  err;
+    uint32_t bw, m, e;
+    int      ret = 0;
+
+    if (baud == 0){
+        return 1;
+    }
+    memset(fit, 0, sizeof(*fit));
+    fit->drate_ppm = INT32_MAX;
+    for (e=0; e<16; e++){
+        for (m=0; m<256; m++){
+            err = word_error_ppm(f_xtal, 256, m, e, 28, baud);
+            if (abs(err) < abs(fit->drate_ppm)){
+                fit->drate_ppm = err;
+                fit->drate_e = e;
+                fit->drate_m = m;
+            }
+        }
+    }
+    fit->drate_hz = (uint32_t) ((((uint64_t) f_xtal * (256 + fit->drate_m)) << fit->drate_e) >> 28);
+
+    fit->deviat_ppm = INT32_MAX;
+    for (e=0; e<8; e++){
+        for (m=0; m<8; m++){
+            err = word_error_ppm(f_xtal, 8, m, e, 17, deviation_hz);
+            if (abs(err) < abs(fit->deviat_ppm) || (deviation_hz == 0 && e == 0 && m == 0)){
+                fit->deviat_ppm = err;
+                fit->deviat_e = e;
+                fit->deviat_m = m;
+            }
+        }
+    }
+    fit->deviat_hz = (uint32_t) ((((uint64_t) f_xtal * (8 + fit->deviat_m)) << fit->deviat_e) >> 17);
+
+    // Both ends may be off by ppm in opposite directions
+    fit->required_bw_hz = CC11xx_CARSON_BW(baud, deviation_hz) + (uint32_t) (((uint64_t) freq_hz * ppm * 4) / 1000000);
+    fit->chanbw_hz = 0;
+    for (e=0; e<4; e++){
+        for (m=0; m<4; m++){
+            bw = f_xtal / (8 * (4 + m) * (1 << e));
+            if (bw >= fit->required_bw_hz && (fit->chanbw_hz == 0 || bw < fit->chanbw_hz)){
+                fit->chanbw_hz = bw;
+                fit->chanbw_e = e;
+                fit->chanbw_m = m;
+            }
+        }
+    }
+    if (fit->chanbw_hz == 0){
+        fit->chanbw_hz = f_xtal / (8 * 4); // Widest, E = M = 0
+        ret = 1;
+    }
+    if (abs(fit->drate_ppm) > 10000){
+        ret = 1;
+    }
+    if ((deviation_hz != 0) && (abs(fit->deviat_ppm) > 100000)){
+        ret = 1; // Below 1.6 kHz or above 380 kHz with a 26 MHz crystal
+    }
+    return ret;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Status byte state standing for a MARCSTATE state, -1 if it does not tell it apart
+static int status_state_of(CC11xx_state_t state)
+// ------------------------------------------------------------------------------------------------
+{
+    switch (state){
+        case CC11xx_STATE_IDLE:             return CC11xx_STATUS_IDLE;
+        case CC11xx_STATE_RX:               return CC11xx_STATUS_RX;
+        case CC11xx_STATE_TX:               return CC11xx_STATUS_TX;
+        case CC11xx_STATE_FSTXON:           return CC11xx_STATUS_FSTXON;
+        case CC11xx_STATE_RXFIFO_OVERFLOW:  return CC11xx_STATUS_RXFIFO_OVERFLOW;
+        case CC11xx_STATE_TXFIFO_UNDERFLOW: return CC11xx_STATUS_TXFIFO_UNDERFLOW;
+        default:                            return -1;
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Wait for given state until timeout (ms). Polls the status byte with one byte SNOP accesses every
+// CC11xx_STATE_POLL_US, so it returns within a few microseconds of the state being reached without
+// holding the bus; MARCSTATE is read only for states the status byte does not show.
+void wait_for_state(spi_parms_t *spi_parms, CC11xx_state_t state, uint32_t timeout)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t start = CC11xx_TIMESTAMP();
+    int      status_state = status_state_of(state);
+    uint8_t  fsm_state = 0x00;
+
+    for (;;)
+    {
+        if (status_state >= 0){
+            CC_SPIRefreshStatus(spi_parms);
+            if (spi_parms->chip_state == (uint8_t) status_state){
+                break;
+            }
+            fsm_state = (spi_parms->chip_state == CC11xx_STATUS_RXFIFO_OVERFLOW) ? CC11xx_STATE_RXFIFO_OVERFLOW : 0x00;
+        }else{
+            CC_SPIReadStatus(spi_parms, CC11xx_MARCSTATE, &fsm_state);
+            fsm_state &= 0x1F;
+            if (fsm_state == (uint8_t) state){
+                break;
+            }
+        }
+
+        if ((uint32_t) (CC11xx_TIMESTAMP() - start) >= timeout)
+        {
+            if (fsm_state == CC11xx_STATE_RXFIFO_OVERFLOW)
+            {
+                radio_flush_fifos(spi_parms);
+            }
+            break;
+        }
+        USLEEP(CC11xx_STATE_POLL_US);
+    }
+}
+
+// MCSM1 in RX: CCA_MODE for the PKTSTATUS assessments, RXOFF_MODE IDLE or FSTXON in turnaround
+// mode, TXOFF_MODE IDLE or RX in turnaround mode
+static uint8_t mcsm1_rx_word(radio_int_data_t *radio)
+{
+    return radio->turnaround_us ? 0x37 : 0x30;
+}
+
+// MCSM1 in TX: TXOFF_MODE TX when the next frame of a burst follows, else IDLE or RX in turnaround
+// mode. CCA_MODE always in turnaround mode so that STX from RX is not held back by the chip (the
+// channel has been assessed already).
+static uint8_t mcsm1_tx_word(radio_int_data_t *radio, uint8_t chain)
+{
+    if (radio->turnaround_us){
+        return chain ? 0x06 : 0x07;
+    }
+    return chain ? 0x02 : 0x00;
+}
+
+// Turnaround mode, after a good packet: the chip went to FSTXON by itself, wait there for a reply
+// until the backoff timer or CC11xx_TIMESTAMP() says turnaround_us is over
+static void radio_turnaround_hold(radio_int_data_t *radio)
+{
+    radio_tx_queue_t *queue = (radio_tx_queue_t *) &radio->tx_queue;
+
+    radio->turnaround_hold = 1;
+    radio->turnaround_until = CC11xx_TIMESTAMP();
+    queue->backoff = 1;
+    if (backend_timer_start(radio->spi_parms, radio->turnaround_us) != 0){
+        queue->backoff = 0;
+        radio->turnaround_until += (radio->turnaround_us + 999) / 1000;
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Inhibit operations by returning to IDLE state
+void radio_turn_idle(spi_parms_t *spi_parms)
+// ------------------------------------------------------------------------------------------------
+{
+    cc11xx_batch_t batch;
+
+    CC_BatchInit(&batch, spi_parms);
+    CC_BatchStrobe(&batch, CC11xx_SIDLE);
+    CC_BatchStrobe(&batch, CC11xx_SFRX); // Flush Rx FIFO
+    CC_BatchStrobe(&batch, CC11xx_SFTX); // Flush Tx FIFO
+    CC_BatchRun(&batch);
+}
+
+void radio_turn_rx_isr(radio_int_data_t *radio)
+{
+    cc11xx_batch_t batch;
+
+    CC_BatchInit(&batch, radio->spi_parms);
+    if (radio->stream_fixed){
+        CC_BatchWriteReg(&batch, CC11xx_PKTCTRL0, pktctrl0_word(radio->radio_parms)); // Back to infinite length
+        radio->stream_fixed = 0;
+    }
+		CC_BatchWriteReg(&batch, CC11xx_MCSM1, mcsm1_rx_word(radio));
+    CC_BatchWriteReg(&batch, CC11xx_IOCFG2, 0x00); // GDO2 output pin config RX mode
+    radio->packet_receive = 0;
+		radio->packet_send = 0;
+    radio->mode = RADIOMODE_RX;   
+    CC_BatchStrobe(&batch, CC11xx_SRX);
+    CC_BatchRun(&batch);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Allow Rx operations by returning to Rx state
+void radio_turn_rx(spi_parms_t *spi_parms)
+// ------------------------------------------------------------------------------------------------
+{
+    CC_SPIStrobe(spi_parms, CC11xx_SRX);
+    wait_for_state(spi_parms, CC11xx_STATE_RX, 10); // Wait max 10ms
+}
+
+// ------------------------------------------------------------------------------------------------
+// Initialize for Rx mode
+void radio_init_rx(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    cc11xx_batch_t batch;
+
+    radio->mode = RADIOMODE_RX;
+    radio->packet_receive = 0;    
+    CC_BatchInit(&batch, radio->spi_parms);
+    CC_BatchWriteReg(&batch, CC11xx_PKTLEN, radio->radio_parms->packet_length); // Packet length.
+		CC_BatchWriteReg(&batch, CC11xx_MCSM1, mcsm1_rx_word(radio));
+    CC_BatchWriteReg(&batch, CC11xx_IOCFG2, 0x00); // GDO2 output pin config RX mode
+    CC_BatchRun(&batch);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Flush Rx and Tx FIFOs
+void radio_flush_fifos(spi_parms_t *spi_parms)
+// ------------------------------------------------------------------------------------------------
+{
+    cc11xx_batch_t batch;
 
-    // FOCCFG: Frequency Offset Compensation Configuration.
-    // o bits 7:6: not used
-    // o bit 5:    If set, the demodulator freezes the frequency offset compensation and clock
-    //             recovery feedback loops until the CS signal goes high.
-    // o bits 4:3: The frequency compensation loop gain to be used before a sync word is detected.
-    //   0 (00): K
-    //   1 (01): 2K
-    //   2 (10): 3K
-    //   3 (11): 4K
-    // o bit 2: FOC_POST_K: The frequency compensation loop gain to be used after a sync word is detected.
-    //   0: Same as FOC_PRE_K
-    //   1: K/2
-    // o bits 1:0: FOC_LIMIT: The saturation point for the frequency offset compensation algorithm:
-    //   0 (00): ±0 (no frequency offset compensation)
-    //   1 (01): ±BW CHAN /8
-    //   2 (10): ±BW CHAN /4
-    //   3 (11): ±BW CHAN /2
-    CC_SPIWriteReg(spi_parms, CC11xx_FOCCFG,   0x1D); // Freq Offset Compens. Config
+    CC_BatchInit(&batch, spi_parms);
+    CC_BatchStrobe(&batch, CC11xx_SFRX); // Flush Rx FIFO
+    CC_BatchStrobe(&batch, CC11xx_SFTX); // Flush Tx FIFO
+    CC_BatchRun(&batch);
+}
 
-    // BSCFG:Bit Synchronization Configuration
-    // o bits 7:6: BS_PRE_KI: Clock recovery loop integral gain before sync word
-    //   0 (00): Ki
-    //   1 (01): 2Ki
-    //   2 (10): 3Ki
-    //   3 (11): 4Ki
-    // o bits 5:4: BS_PRE_KP: Clock recovery loop proportional gain before sync word
-    //   0 (00): Kp
-    //   1 (01): 2Kp
-    //   2 (10): 3Kp
-    //   3 (11): 4Kp
-    // o bit 3: BS_POST_KI: Clock recovery loop integral gain after sync word
-    //   0: Same as BS_PRE_KI
-    //   1: Ki/2
-    // o bit 2: BS_POST_KP: Clock recovery loop proportional gain after sync word
-    //   0: Same as BS_PRE_KP
-    //   1: Kp
-    // o bits 1:0: BS_LIMIT: Data rate offset saturation (max data rate difference)
-    //   0 (00): ±0 (No data rate offset compensation performed)
-    //   1 (01): ±3.125 % data rate offset
-    //   2 (10): ±6.25 % data rate offset
-    //   3 (11): ±12.5 % data rate offset
-    CC_SPIWriteReg(spi_parms, CC11xx_BSCFG,    0x1C); //  Bit synchronization config.
+// ------------------------------------------------------------------------------------------------
+// Set packet length
+int radio_set_packet_length(spi_parms_t *spi_parms, uint8_t pkt_len)
+// ------------------------------------------------------------------------------------------------
+{
+    return CC_SPIWriteReg(spi_parms, CC11xx_PKTLEN, pkt_len); // Packet length.
+}
 
-    // AGCCTRL2: AGC Control
-    // o bits 7:6: MAX_DVGA_GAIN. Allowable DVGA settings
-    //   0 (00): All gain settings can be used
-    //   1 (01): The highest gain setting can not be used
-    //   2 (10): The 2 highest gain settings can not be used
-    //   3 (11): The 3 highest gain settings can not be used
-    // o bits 5:3: MAX_LNA_GAIN. Maximum allowable LNA + LNA 2 gain relative to the maximum possible gain.
-    //   0 (000): Maximum possible LNA + LNA 2 gain
-    //   1 (001): Approx. 2.6 dB below maximum possible gain
-    //   2 (010): Approx. 6.1 dB below maximum possible gain
-    //   3 (011): Approx. 7.4 dB below maximum possible gain
-    //   4 (100): Approx. 9.2 dB below maximum possible gain
-    //   5 (101): Approx. 11.5 dB below maximum possible gain
-    //   6 (110): Approx. 14.6 dB below maximum possible gain
-    //   7 (111): Approx. 17.1 dB below maximum possible gain
-    // o bits 2:0: MAGN_TARGET: target value for the averaged amplitude from the digital channel filter (1 LSB = 0 dB).
-    //   0 (000): 24 dB
-    //   1 (001): 27 dB
-    //   2 (010): 30 dB
-    //   3 (011): 33 dB
-    //   4 (100): 36 dB
-    //   5 (101): 38 dB
-    //   6 (110): 40 dB
-    //   7 (111): 42 dB
-    CC_SPIWriteReg(spi_parms, CC11xx_AGCCTRL2, 0xC7); // AGC control.
+// ------------------------------------------------------------------------------------------------
+// Get packet length
+uint8_t radio_get_packet_length(spi_parms_t *spi_parms)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t pkt_len;
+    CC_SPIReadReg(spi_parms, CC11xx_PKTLEN, &pkt_len); // Packet length.
+    return pkt_len;
+}
 
-    // AGCCTRL1: AGC Control
-    // o bit 7: not used
-    // o bit 6: AGC_LNA_PRIORITY: Selects between two different strategies for LNA and LNA 2 gain
-    //   0: the LNA 2 gain is decreased to minimum before decreasing LNA gain
-    //   1: the LNA gain is decreased first.
-    // o bits 5:4: CARRIER_SENSE_REL_THR: Sets the relative change threshold for asserting carrier sense
-    //   0 (00): Relative carrier sense threshold disabled
-    //   1 (01): 6 dB increase in RSSI value
-    //   2 (10): 10 dB increase in RSSI value
-    //   3 (11): 14 dB increase in RSSI value
-    // o bits 3:0: CARRIER_SENSE_ABS_THR: Sets the absolute RSSI threshold for asserting carrier sense. 
-    //   The 2-complement signed threshold is programmed in steps of 1 dB and is relative to the MAGN_TARGET setting.
-    //   0 is at MAGN_TARGET setting.
-    CC_SPIWriteReg(spi_parms, CC11xx_AGCCTRL1, 0x00); // AGC control.
+// ------------------------------------------------------------------------------------------------
+// Get the actual data rate in Bauds
+float radio_get_rate(radio_parms_t *radio_parms)
+// ------------------------------------------------------------------------------------------------
+{
+    return ((float) (radio_parms->f_xtal) / (1<<28)) * (256 + radio_parms->drate_m) * (1<<radio_parms->drate_e);
+}
 
-    // AGCCTRL0: AGC Control
-    // o bits 7:6: HYST_LEVEL: Sets the level of hysteresis on the magnitude deviation
-    //   0 (00): No hysteresis, small symmetric dead zone, high gain
-    //   1 (01): Low hysteresis, small asymmetric dead zone, medium gain
-    //   2 (10): Medium hysteresis, medium asymmetric dead zone, medium gain
-    //   3 (11): Large hysteresis, large asymmetric dead zone, low gain
-    // o bits 5:4: WAIT_TIME: Sets the number of channel filter samples from a gain adjustment has
-    //   been made until the AGC algorithm starts accumulating new samples.
-    //   0 (00):  8
-    //   1 (01): 16
-    //   2 (10): 24
-    //   3 (11): 32
-    // o bits 3:2: AGC_FREEZE: Control when the AGC gain should be frozen.
-    //   0 (00): Normal operation. Always adjust gain when required.
-    //   1 (01): The gain setting is frozen when a sync word has been found.
-    //   2 (10): Manually freeze the analogue gain setting and continue to adjust the digital gain. 
-    //   3 (11): Manually freezes both the analogue and the digital gain setting. Used for manually overriding the gain.
-    // o bits 0:1: FILTER_LENGTH: 
-    //   2-FSK, 4-FSK, MSK: Sets the averaging length for the amplitude from the channel filter.    |  
-    //   ASK ,OOK: Sets the OOK/ASK decision boundary for OOK/ASK reception.
-    //   Value : #samples: OOK/ASK decixion boundary
-    //   0 (00):        8: 4 dB
-    //   1 (01):       16: 8 dB
-    //   2 (10):       32: 12 dB
-    //   3 (11):       64: 16 dB  
-    CC_SPIWriteReg(spi_parms, CC11xx_AGCCTRL0, 0xB2); // AGC control.
+// ------------------------------------------------------------------------------------------------
+// Transmission of a block, written to the FIFO straight from data. The channel has been assessed
+// clear and the chip is in IDLE, or in TX after the previous frame of a burst (in_tx).
+static void radio_send_block(radio_int_data_t *radio, const uint8_t *data, uint8_t count, uint8_t in_tx)
+// ------------------------------------------------------------------------------------------------
+{
+    cc11xx_batch_t batch;
+    uint8_t  initial_tx_count; // Number of bytes to send in first batch
 
-    // FREND1: Front End RX Configuration
-    // o bits 7:6: LNA_CURRENT: Adjusts front-end LNA PTAT current output
-    // o bits 5:4: LNA2MIX_CURRENT: Adjusts front-end PTAT outputs
-    // o bits 3:2: LODIV_BUF_CURRENT_RX: Adjusts current in RX LO buffer (LO input to mixer)
-    // o bits 1:0: MIX_CURRENT: Adjusts current in mixer
-    CC_SPIWriteReg(spi_parms, CC11xx_FREND1,   0xB6); // Front end RX configuration.
+    radio->mode = RADIOMODE_NONE;
+    radio->packet_send = 0;
+    radio->tx_count = count;
 
-    // FREND0: Front End TX Configuration
-    // o bits 7:6: not used
-    // o bits 5:4: LODIV_BUF_CURRENT_TX: Adjusts current TX LO buffer (input to PA). The value to use
-    //   in this field is given by the SmartRF Studio software
-    // o bit 3: not used
-    // o bits 1:0: PA_POWER: Selects PA power setting. This value is an index to the PATABLE, 
-    //   which can be programmed with up to 8 different PA settings. In OOK/ASK mode, this selects the PATABLE
-    //   index to use when transmitting a ‘1’. PATABLE index zero is used in OOK/ASK when transmitting a ‘0’. 
-    //   The PATABLE settings from index ‘0’ to the PA_POWER value are used for ASK TX shaping, 
-    //   and for power ramp-up/ramp-down at the start/end of transmission in all TX modulation formats.
-    CC_SPIWriteReg(spi_parms, CC11xx_FREND0,   0x10); // Front end RX configuration.
+    CC_BatchInit(&batch, radio->spi_parms);
+    if (radio->radio_parms->length_mode == PACKET_LENGTH_FIXED){
+        CC_BatchWriteReg(&batch, CC11xx_PKTLEN, radio->tx_count); // Packet length.
+    }
 
-    // FSCAL3: Frequency Synthesizer Calibration
-    // o bits 7:6: The value to write in this field before calibration is given by the SmartRF
-    //   Studio software.
-    // o bits 5:4: CHP_CURR_CAL_EN: Disable charge pump calibration stage when 0.
-    // o bits 3:0: FSCAL3: Frequency synthesizer calibration result register.
-    CC_SPIWriteReg(spi_parms, CC11xx_FSCAL3,   0xEA); // Frequency synthesizer cal.
+		/* Here is TX: back to IDLE (RX in turnaround mode) after the frame, or staying in TX for the next one of a burst */
+		CC_BatchWriteReg(&batch, CC11xx_MCSM1, 	 mcsm1_tx_word(radio, tx_burst_chain(radio)));
+		CC_BatchWriteReg(&batch, CC11xx_IOCFG2,   0x02); // GDO2 output pin config TX mode
+    radio->mode = RADIOMODE_TX;
+    // Initial number of bytes to put in FIFO is either the number of bytes to send or the FIFO size whichever is
+    // the smallest. Actual size blocks you need to take size minus one byte.
+    initial_tx_count = (radio->tx_count > CC11xx_FIFO_SIZE-1 ? CC11xx_FIFO_SIZE-1 : radio->tx_count);
+    // Initial fill of TX FIFO
+    CC_BatchWriteBurst(&batch, CC11xx_TXFIFO, data, initial_tx_count);
+    radio->tx_ptr = data;
+    radio->byte_index = initial_tx_count;
+    radio->bytes_remaining = radio->tx_count - initial_tx_count;
+    if (!in_tx){
+		    CC_BatchStrobe(&batch, CC11xx_STX); // Kick-off Tx
+    }
+    CC_BatchRun(&batch);
+}
 
-    // FSCAL2: Frequency Synthesizer Calibration
-    CC_SPIWriteReg(spi_parms, CC11xx_FSCAL2,   0x0A); // Frequency synthesizer cal.
-    CC_SPIWriteReg(spi_parms, CC11xx_FSCAL1,   0x00); // Frequency synthesizer cal.
-    CC_SPIWriteReg(spi_parms, CC11xx_FSCAL0,   0x11); // Frequency synthesizer cal.
-    CC_SPIWriteReg(spi_parms, CC11xx_FSTEST,   0x59); // Frequency synthesizer cal.
+// ------------------------------------------------------------------------------------------------
+// Transmission of a stream in infinite packet length mode, straight from the application buffer.
+// The 2 byte length header goes first; the chip is switched to fixed length when the last bytes
+// are written to the FIFO.
+static void radio_send_stream_block(radio_int_data_t *radio, const uint8_t *data, uint32_t length)
+// ------------------------------------------------------------------------------------------------
+{
+    cc11xx_batch_t batch;
+    uint8_t  header[2];
+    uint8_t  initial_tx_count; // Number of bytes to send in first batch
 
-    // TEST2: Various test settings. The value to write in this field is given by the SmartRF Studio software.
-    CC_SPIWriteReg(spi_parms, CC11xx_TEST2,    0x88); // Various test settings.
+    radio->mode = RADIOMODE_NONE;
+    radio->packet_send = 0;
+    radio->stream_fixed = 0;
+
+    // Packet ends when the byte counter modulo 256 matches PKTLEN after the switch to fixed length
+    CC_BatchInit(&batch, radio->spi_parms);
+    CC_BatchWriteReg(&batch, CC11xx_PKTLEN, (length + 2) & 0xFF);
+		CC_BatchWriteReg(&batch, CC11xx_MCSM1, 	 mcsm1_tx_word(radio, 0));
+		CC_BatchWriteReg(&batch, CC11xx_IOCFG2,   0x02); // GDO2 output pin config TX mode
+    radio->mode = RADIOMODE_TX;
+    header[0] = (length >> 8) & 0xFF;
+    header[1] = length & 0xFF;
+    CC_BatchWriteBurst(&batch, CC11xx_TXFIFO, header, 2);
+    initial_tx_count = CC11xx_FIFO_SIZE - 1 - 2;
+    CC_BatchWriteBurst(&batch, CC11xx_TXFIFO, data, initial_tx_count);
+    radio->tx_ptr = data;
+    radio->byte_index = initial_tx_count;
+    radio->bytes_remaining = length - initial_tx_count;
+    tx_stream_check(radio); // Written ahead of the batch, the chip is in IDLE
+		CC_BatchStrobe(&batch, CC11xx_STX); // Kick-off Tx
+    CC_BatchRun(&batch);
+}
 
-    // TEST1: Various test settings. The value to write in this field is given by the SmartRF Studio software.
-    CC_SPIWriteReg(spi_parms, CC11xx_TEST1,    0x31); // Various test settings.
+// ------------------------------------------------------------------------------------------------
+// Publish the frame at head, starting CSMA/CA if it is the only one. The driver side only runs
+// with GDO interrupts masked here.
+static void tx_queue_push(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_tx_queue_t *queue = (radio_tx_queue_t *) &radio->tx_queue;
 
-    // TEST0: Various test settings. The value to write in this field is given by the SmartRF Studio software.
-    CC_SPIWriteReg(spi_parms, CC11xx_TEST0,    0x09); // Various test settings.
+    uint32_t start;
+
+    CC11xx_MEMORY_BARRIER(); // Frame complete before it becomes visible to the driver
+    disable_IT(radio);
+    if (queue->head++ == queue->tail){
+        if (radio->turnaround_hold){
+            start = stats_begin(radio);
+            tx_queue_run(radio); // Reply sent right away
+            stats_end(radio, NULL, start);
+        }else{
+            tx_csma_start(radio);
+        }
+    }
+    enable_IT(radio);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Transmission of a packet: queued, sent with CCA as soon as the channel is free
+int radio_send_packet(radio_int_data_t *radio, uint8_t *packet, uint8_t size)
+// ------------------------------------------------------------------------------------------------
+{
+    return radio_tx_enqueue(radio, packet, size, NULL);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Queue a frame for transmission. In fixed length mode the frame is padded to the packet length,
+// in variable length mode it is prefixed with its length byte. ticket
+// (optional) identifies the frame in radio_tx_status() and in the completion callback.
+// Returns 1 when the queue is full or the frame is longer than the packet length.
+int radio_tx_enqueue(radio_int_data_t *radio, const uint8_t *packet, uint8_t size, uint32_t *ticket)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_tx_queue_t *queue = (radio_tx_queue_t *) &radio->tx_queue;
+    radio_parms_t *radio_parms = radio->radio_parms;
+    radio_tx_frame_t *frame;
+
+    if (queue->head - queue->tail >= CC11xx_TX_QUEUE_DEPTH){
+        return 1;
+    }
+    if (radio_parms->length_mode == PACKET_LENGTH_INFINITE){
+        return 1; // Streams only, see radio_send_stream()
+    }
+    if (size > radio_parms->packet_length){
+        return 1;
+    }
+    if ((radio_parms->length_mode == PACKET_LENGTH_VARIABLE) && (size > CC11xx_PACKET_COUNT_SIZE - 1)){
+        return 1; // No room for the length byte
+    }
+    frame = &queue->frame[queue->head & (CC11xx_TX_QUEUE_DEPTH - 1)];
+    if (radio_parms->length_mode == PACKET_LENGTH_VARIABLE){
+        frame->data[0] = size;
+        memcpy(&frame->data[1], packet, size);
+        frame->length = size + 1;
+    }else{
+        frame->length = radio_parms->packet_length; // same block size for all
+        memset(frame->data, 0, radio_parms->packet_length);
+        memcpy(frame->data, packet, size);
+    }
+    frame->stream = NULL;
+    frame->deadline = CC11xx_TIMESTAMP() + radio_parms->timeout;
+    queue->status[queue->head & (CC11xx_TX_QUEUE_DEPTH - 1)] = RADIO_TX_PENDING;
+    if (ticket){
+        *ticket = queue->head;
+    }
+    tx_queue_push(radio);
+
+    radio_tx_process(radio);
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Queue a stream for transmission in infinite packet length mode. The data is not copied: it must
+// stay untouched until the frame completes. Returns 1 when the queue is full, the radio is not in
+// infinite length mode or the length is out of the stream range.
+int radio_send_stream(radio_int_data_t *radio, const uint8_t *data, uint32_t length, uint32_t *ticket)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_tx_queue_t *queue = (radio_tx_queue_t *) &radio->tx_queue;
+    radio_parms_t *radio_parms = radio->radio_parms;
+    radio_tx_frame_t *frame;
+
+    if (queue->head - queue->tail >= CC11xx_TX_QUEUE_DEPTH){
+        return 1;
+    }
+    if (radio_parms->length_mode != PACKET_LENGTH_INFINITE){
+        return 1;
+    }
+    if (length < CC11xx_STREAM_MIN_LENGTH || length > CC11xx_STREAM_MAX_LENGTH){
+        return 1;
+    }
+    frame = &queue->frame[queue->head & (CC11xx_TX_QUEUE_DEPTH - 1)];
+    frame->stream = data;
+    frame->stream_length = length;
+    frame->length = 0;
+    frame->deadline = CC11xx_TIMESTAMP() + radio_parms->timeout;
+    queue->status[queue->head & (CC11xx_TX_QUEUE_DEPTH - 1)] = RADIO_TX_PENDING;
+    if (ticket){
+        *ticket = queue->head;
+    }
+    tx_queue_push(radio);
+
+    radio_tx_process(radio);
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Buffer received streams are written to. Streams longer than size are dropped. The callback runs
+// in interrupt context and the buffer is reused for the next stream once it returns.
+void radio_stream_rx_buffer(radio_int_data_t *radio, uint8_t *buffer, uint32_t size, radio_stream_callback_t callback)
+// ------------------------------------------------------------------------------------------------
+{
+    disable_IT(radio);
+    radio->stream_rx_buf = buffer;
+    radio->stream_rx_size = buffer ? size : 0;
+    radio->stream_callback = callback;
+    enable_IT(radio);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Status of a frame queued with radio_tx_enqueue()
+radio_tx_status_t radio_tx_status(radio_int_data_t *radio, uint32_t ticket)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_tx_queue_t *queue = (radio_tx_queue_t *) &radio->tx_queue;
+    uint32_t head = queue->head;
+
+    if ((head - ticket) == 0 || (head - ticket) > CC11xx_TX_QUEUE_DEPTH){
+        return RADIO_TX_UNKNOWN;
+    }
+    if ((int32_t) (ticket - queue->tail) >= 0){
+        return RADIO_TX_PENDING;
+    }
+    CC11xx_MEMORY_BARRIER();
+    return (radio_tx_status_t) queue->status[ticket & (CC11xx_TX_QUEUE_DEPTH - 1)];
+}
+
+// ------------------------------------------------------------------------------------------------
+// Frame completion notification, called from interrupt context
+void radio_tx_set_callback(radio_int_data_t *radio, radio_tx_callback_t callback)
+// ------------------------------------------------------------------------------------------------
+{
+    radio->tx_queue.callback = callback;
+}
+
+// ------------------------------------------------------------------------------------------------
+// CSMA/CA settings, NULL for the defaults. They apply from the next frame. Returns 1 if out of range.
+int radio_csma_config(radio_int_data_t *radio, const radio_csma_parms_t *parms)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_csma_parms_t csma = {0, CC11xx_CSMA_MIN_BE, CC11xx_CSMA_MAX_BE, CC11xx_CSMA_ATTEMPTS, 0};
 
-    enable_IT();
+    if (parms){
+        csma = *parms;
+    }
+    if ((csma.min_be > csma.max_be) || (csma.max_be > CC11xx_CSMA_BE_LIMIT) ||
+        (csma.max_attempts == 0) || (csma.max_attempts > CC11xx_CSMA_MAX_ATTEMPTS)){
+        return 1;
+    }
+    disable_IT(radio);
+    radio->tx_queue.csma = csma;
+    enable_IT(radio);
+    return 0;
+}
 
+// ------------------------------------------------------------------------------------------------
+// Turnaround mode for request/response exchanges, hold_us > 0: the chip never goes through IDLE.
+// After a good packet it goes to FSTXON by itself (MCSM1 RXOFF_MODE) and waits there up to hold_us
+// for a reply: a frame queued meanwhile is sent at once, without assessment nor backoff. Other
+// frames go from RX to TX straight after the assessment, and the chip returns to RX by itself
+// after each frame (TXOFF_MODE). Neither way recalibrates. radio_get_stats() times the replies in
+// turnaround. hold_us = 0 goes back to IDLE transitions. Returns 1 if the radio is busy.
+int radio_turnaround_config(radio_int_data_t *radio, uint32_t hold_us)
+// ------------------------------------------------------------------------------------------------
+{
+    disable_IT(radio);
+    if ((radio->mode != RADIOMODE_RX) || radio->packet_receive || radio->turnaround_hold){
+        enable_IT(radio);
+        return 1;
+    }
+    radio->turnaround_us = hold_us;
+    CC_SPIWriteReg(radio->spi_parms, CC11xx_MCSM1, mcsm1_rx_word(radio));
+    enable_IT(radio);
     return 0;
 }
 
-int set_freq(spi_parms_t * spi_parms, radio_parms_t * radio_parms)
+// ------------------------------------------------------------------------------------------------
+// Copy of the CSMA/CA counters
+void radio_csma_stats(radio_int_data_t *radio, radio_csma_stats_t *stats)
+// ------------------------------------------------------------------------------------------------
+{
+    disable_IT(radio);
+    *stats = radio->tx_queue.csma_stats;
+    enable_IT(radio);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Backoff timer expiry of the radio, started with CC11xx_TIMER_START or the backend timer_start.
+// The timer interrupt must not preempt nor be preempted by the GDO interrupts of the radio and
+// must be masked along with them.
+void radio_csma_timer_isr(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t start;
+
+    if (!radio->init){
+        return;
+    }
+    start = stats_begin(radio);
+    TRACE_EVENT(radio, TRACE_BACKOFF_END, 0);
+    radio->tx_queue.backoff = 0;
+    spi_async_plug(radio->spi_parms);
+    tx_queue_run(radio);
+    spi_async_unplug(radio->spi_parms);
+    stats_end(radio, NULL, start);
+}
+
+// Time spent calibrating: the SCALs the driver waited for as measured, the others at their mean,
+// or at CC11xx_CAL_US when none was measured
+static uint32_t cal_estimate_us(const radio_stats_t *stats)
+{
+    uint32_t mean_us = CC11xx_CAL_US;
+    uint32_t measured_us = 0;
+    uint32_t others = stats->calibrations;
+
+#ifdef CC11xx_CYCLES_PER_US
+    if (stats->calibration.count){
+        measured_us = (uint32_t) (stats->calibration.total / CC11xx_CYCLES_PER_US);
+        mean_us = measured_us / stats->calibration.count;
+        others = (others > stats->calibration.count) ? others - stats->calibration.count : 0;
+    }
+#endif
+    return measured_us + others * mean_us;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Consistent copy of the driver counters, lock free: may be called from any context but an
+// interrupt the driver runs in
+void radio_get_stats(radio_int_data_t *radio, radio_stats_t *stats)
+// ------------------------------------------------------------------------------------------------
 {
-    // FREQ2..0: Base frequency for the frequency sythesizer
-    // Fo = (Fxosc / 2^16) * FREQ[23..0]
-    // FREQ2 is FREQ[23..16]
-    // FREQ1 is FREQ[15..8]
-    // FREQ0 is FREQ[7..0]
-    // Fxtal = 26 MHz and FREQ = 0x10A762 => Fo = 432.99981689453125 MHz
-    radio_parms->freq_word = get_freq_word(radio_parms->f_xtal, radio_parms->freq_hz);
-    CC_SPIWriteReg(spi_parms, CC11xx_FREQ2,    ((radio_parms->freq_word>>16) & 0xFF)); // Freq control word, high byte
-    CC_SPIWriteReg(spi_parms, CC11xx_FREQ1,    ((radio_parms->freq_word>>8)  & 0xFF)); // Freq control word, mid byte.
-    CC_SPIWriteReg(spi_parms, CC11xx_FREQ0,    (radio_parms->freq_word & 0xFF));       // Freq control word, low byte.
-    return 0;
+    uint32_t seq;
+
+    do{
+        seq = radio->stats_seq;
+        CC11xx_MEMORY_BARRIER();
+        memcpy(stats, (const void *) &radio->stats, sizeof(radio_stats_t));
+        stats->spi_transactions = radio->spi.transactions;
+        stats->spi_bytes = radio->spi.bytes;
+        stats->spi_batches = radio->spi.batches;
+        stats->calibrations = radio->spi.calibrations;
+        CC11xx_MEMORY_BARRIER();
+    }while ((seq & 1) || (seq != radio->stats_seq));
+    stats->cal_us = cal_estimate_us(stats);
 }
 
+#ifdef CC11xx_TRACE
+// ------------------------------------------------------------------------------------------------
+// Empty the trace ring. It is shared by all radios and not masked here: events recorded meanwhile
+// may be kept.
+void radio_trace_clear(void)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_trace.head = 0;
+    memset(radio_trace.entry, 0, sizeof(radio_trace.entry));
+}
+#endif
 
 // ------------------------------------------------------------------------------------------------
-// Calculate RSSI in dBm from decimal RSSI read out of RSSI status register
-float rssi_dbm(uint8_t rssi_dec)
+// Clear the driver counters
+void radio_reset_stats(radio_int_data_t *radio)
 // ------------------------------------------------------------------------------------------------
 {
-    if (rssi_dec < 128)
-    {
-        return (rssi_dec / 2.0) - 74.0;
-    }
-    else
-    {
-        return ((rssi_dec - 256) / 2.0) - 74.0;
+    uint32_t start;
+
+    disable_IT(radio);
+    start = stats_begin(radio);
+    memset((void *) &radio->stats, 0, sizeof(radio_stats_t));
+    radio->spi.transactions = 0;
+    radio->spi.bytes = 0;
+    radio->spi.batches = 0;
+    radio->spi.calibrations = 0;
+    if (radio->init){
+        stats_packet_start(radio);
     }
+    stats_end(radio, NULL, start);
+    enable_IT(radio);
 }
 
 // ------------------------------------------------------------------------------------------------
-// Calculate frequency word FREQ[23..0]
-uint32_t get_freq_word(uint32_t freq_xtal, uint32_t freq_hz)
+// Let queued frames go out once their backoff has elapsed, and run the RADIO_CAL_PERIODIC
+// calibrations (started on one call, back to RX on a later one). Call it from the main loop; it
+// only does a few SPI transactions and never waits.
+void radio_tx_process(radio_int_data_t *radio)
 // ------------------------------------------------------------------------------------------------
 {
-    uint64_t res; // calculate on 64 bits to save precision
-    res = ((uint64_t) freq_hz * (uint64_t) (1<<16)) / ((uint64_t) freq_xtal);
-    return (uint32_t) res;
+    uint32_t start;
+
+    if (!radio->init){
+        return;
+    }
+    disable_IT(radio);
+    start = stats_begin(radio);
+    tx_queue_run(radio);
+    cal_poll(radio);
+    stats_end(radio, NULL, start);
+    enable_IT(radio);
 }
 
 // ------------------------------------------------------------------------------------------------
-// Calculate frequency word FREQ[23..0]
-uint32_t get_if_word(uint32_t freq_xtal, uint32_t if_hz)
+// Set up the radio handle for the chip on spi (configured by init_radio_config()) and start RX.
+// The driver keeps its own copy of spi: transfer buffers, backend and register shadow. Its GDO
+// and backoff timer interrupts must call gdo0_isr(), gdo2_isr() and radio_csma_timer_isr() with
+// this handle.
+void enable_isr_routine(radio_int_data_t *radio, spi_parms_t * spi, radio_parms_t * radio_parms)
 // ------------------------------------------------------------------------------------------------
 {
-    return (if_hz * (1<<10)) / freq_xtal;
+	if (!radio->init){
+	    radio->id = radio_count++;
+	}
+	radio->mode = RADIOMODE_NONE;
+	radio->packet_rx_count = 0;
+	radio->packet_tx_count = 0;
+	radio->rx_ring.head = 0;
+	radio->rx_ring.tail = 0;
+	radio->rx_ring.overruns = 0;
+	radio->rx_slot = (radio_rx_slot_t *) &radio->rx_drop_slot;
+	radio->rx_ptr = NULL;
+	radio->stream_fixed = 0;
+	radio->tx_queue.head = 0;
+	radio->tx_queue.tail = 0;
+	radio->tx_queue.on_air = 0;
+	radio->tx_queue.chained = 0;
+	radio->turnaround_hold = 0;
+	radio->tx_queue.cca_count = 0;
+	radio->tx_queue.backoff = 0;
+	radio->tx_queue.next_cca = CC11xx_TIMESTAMP();
+	radio->tx_queue.prng = (((uint32_t) radio->id + 1) * 2654435761UL) ^ radio->tx_queue.next_cca; // Own sequence per radio
+	if (radio->tx_queue.prng == 0){
+	    radio->tx_queue.prng = 1; // xorshift stays at 0
+	}
+	radio->cal.active = 0; // init_radio_config() gave MCSM0 back to the policy, the channels stay
+	if (radio->tx_queue.csma.max_attempts == 0){
+	    radio_csma_config(radio, NULL);
+	}
+	*(spi_parms_t *) &radio->spi = *spi; // Own transfer buffers for the driver, same device and register shadow
+	radio->spi.radio = radio;
+	radio->spi_parms = (spi_parms_t *) &radio->spi;
+	radio->radio_parms = radio_parms;
+	radio->init = true;
+	radio->cal_temp_valid = 0;
+	if (cal_mcsm0(radio_parms) != CC11xx_MCSM0_AUTOCAL){
+	    cal_scal(radio); // The chip would not calibrate on its way to RX
+	}else{
+	    radio->cal_next = CC11xx_TIMESTAMP();
+	}
+	/* enable RX! */
+	radio_init_rx(radio);
+	radio_turn_rx(radio->spi_parms);
 }
 
-uint8_t get_offset_word(uint32_t freq_xtal, uint32_t offset_hz)
+// ------------------------------------------------------------------------------------------------
+// Number of received packets waiting in the ring
+uint32_t radio_rx_available(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
 {
-		return ((offset_hz * (1 << 14)) / freq_xtal) &0xFF;
+    return radio->rx_ring.head - radio->rx_ring.tail;
 }
 
 // ------------------------------------------------------------------------------------------------
-// Calculate CHANBW words according to CC1101 bandwidth steps
-void get_chanbw_words(float bw, radio_parms_t *radio_parms)
+// Oldest received packet, left in place until radio_rx_release(). NULL when the ring is empty.
+radio_rx_slot_t *radio_rx_peek(radio_int_data_t *radio)
 // ------------------------------------------------------------------------------------------------
 {
-    uint8_t e_index, m_index;
+    radio_rx_ring_t *ring = (radio_rx_ring_t *) &radio->rx_ring;
 
-    for (e_index=0; e_index<4; e_index++)
-    {
-        for (m_index=0; m_index<4; m_index++)
-        {
-            if (bw > chanbw_limits[4*e_index + m_index])
-            {
-                radio_parms->chanbw_e = e_index;
-                radio_parms->chanbw_m = m_index;
-                return;
-            }
-        }
+    if (radio_rx_available(radio) == 0){
+        return NULL;
     }
+    CC11xx_MEMORY_BARRIER(); // Head read before the slot contents
+    return &ring->slot[ring->tail & (CC11xx_RX_RING_DEPTH - 1)];
 }
 
 // ------------------------------------------------------------------------------------------------
-// Calculate data rate, channel bandwidth and deviation words. Assumes 26 MHz crystal.
-//   o DRATE = (Fxosc / 2^28) * (256 + DRATE_M) * 2^DRATE_E
-//   o CHANBW = Fxosc / (8(4+CHANBW_M) * 2^CHANBW_E)
-//   o DEVIATION = (Fxosc / 2^17) * (8 + DEVIATION_M) * 2^DEVIATION_E
-void get_rate_words(rate_t data_rate, float mod_index, radio_parms_t *radio_parms)
+// Give the oldest slot back to the ISR
+void radio_rx_release(radio_int_data_t *radio)
 // ------------------------------------------------------------------------------------------------
 {
-    float drate, deviat, f_xtal;
+    if (radio_rx_available(radio) == 0){
+        return;
+    }
+    CC11xx_MEMORY_BARRIER(); // Done with the slot before the ISR may reuse it
+    radio->rx_ring.tail++;
+}
 
-    drate = (float) rate_values[data_rate];
+// ------------------------------------------------------------------------------------------------
+// Copy out and release the oldest received packet. packet must hold CC11xx_PACKET_COUNT_SIZE
+// bytes, info (optional) receives RSSI/LQI/CRC/timestamp. Returns 1 when no packet is waiting.
+int radio_receive_packet(radio_int_data_t *radio, uint8_t *packet, uint8_t *size, radio_rx_slot_t *info)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_rx_slot_t *slot = radio_rx_peek(radio);
 
-    deviat = drate * mod_index;
-    f_xtal = (float) radio_parms->f_xtal;
+    if (slot == NULL){
+        return 1;
+    }
+    memcpy(packet, slot->data, slot->length);
+    *size = slot->length;
+    if (info){
+        *info = *slot;
+    }
+    radio_rx_release(radio);
+    return 0;
+}
 
-    get_chanbw_words(2.0f*(deviat + drate), radio_parms); // Apply Carson's rule for bandwidth
+// ------------------------------------------------------------------------------------------------
+// Packets lost because the application did not drain the ring in time
+uint32_t radio_rx_overruns(radio_int_data_t *radio)
+// ------------------------------------------------------------------------------------------------
+{
+    return radio->rx_ring.overruns;
+}
 
-    radio_parms->drate_e = (uint8_t) (floor(log2( drate*(1<<20) / f_xtal )));
-    radio_parms->drate_m = (uint8_t) (((drate*(1<<28)) / (f_xtal * (1<<radio_parms->drate_e))) - 256);
-    radio_parms->drate_e &= 0x0F; // it is 4 bits long
 
-    radio_parms->deviat_e = (uint8_t) (floor(log2( deviat*(1<<14) / f_xtal )));
-    radio_parms->deviat_m = (uint8_t) (((deviat*(1<<17)) / (f_xtal * (1<<radio_parms->deviat_e))) - 8);
-    radio_parms->deviat_e &= 0x07; // it is 3 bits long
-    radio_parms->deviat_m &= 0x07; // it is 3 bits long
+/* Every access returns the chip status byte: its state and FIFO fields are decoded once here and
+ * kept in spi_parms, the header R/W bit tells which FIFO the count is about */
 
-    radio_parms->chanspc_e &= 0x03; // it is 2 bits long
+// MCSM0.FS_AUTOCAL as last written, radio_build_config() default when unknown after an SPI error
+static uint8_t cal_autocal(spi_parms_t *spi_parms)
+{
+    if (spi_parms->shadow_valid & ((uint64_t) 1 << CC11xx_MCSM0)){
+        return (spi_parms->shadow[CC11xx_MCSM0] >> 4) & 0x03;
+    }
+    return 1;
 }
 
-// ------------------------------------------------------------------------------------------------
-// Poll FSM state waiting for given state until timeout (approx ms)
-void wait_for_state(spi_parms_t *spi_parms, CC11xx_state_t state, uint32_t timeout)
-// ------------------------------------------------------------------------------------------------
+// Count the synthesizer calibrations started by strobes: SCAL, and SRX/STX/SFSTXON leaving IDLE
+// with FS_AUTOCAL=1. Strobes leaving RX or TX (SIDLE) never calibrate.
+static void cal_count(spi_parms_t *spi_parms, uint8_t status, uint8_t header)
 {
-    uint8_t fsm_state = 0x00;
+    if (header == CC11xx_SCAL){
+        spi_parms->calibrations++;
+        return;
+    }
+    if (((header != CC11xx_SRX) && (header != CC11xx_STX) && (header != CC11xx_SFSTXON))
+        || (CC11xx_STATUS_STATE(status) != CC11xx_STATUS_IDLE)){
+        return;
+    }
+    if (cal_autocal(spi_parms) == 1){
+        spi_parms->calibrations++;
+    }
+}
 
-    while(timeout)
-    {
-        CC_SPIReadStatus(spi_parms, CC11xx_MARCSTATE, &fsm_state);
-        fsm_state &= 0x1F;
+// Count the calibration of an automatic return to IDLE at the end of a packet, off_mode being the
+// RXOFF_MODE or TXOFF_MODE field of MCSM1 in effect (0 for IDLE): every one with FS_AUTOCAL=2,
+// every 4th one with FS_AUTOCAL=3
+static void cal_count_return(spi_parms_t *spi_parms, uint8_t off_mode)
+{
+    uint8_t autocal = cal_autocal(spi_parms);
 
-        if (fsm_state == (uint8_t) state)
-        {
-            break;
-        }
+    if (off_mode != 0){
+        return;
+    }
+    if ((autocal == 2) || ((autocal == 3) && ((++spi_parms->cal_returns & 0x03) == 0))){
+        spi_parms->calibrations++;
+    }
+}
 
-        MSLEEP(1);
-        timeout--;
+static void status_update(spi_parms_t *spi_parms, uint8_t status, uint8_t header, uint32_t len)
+{
+    if (len == 1){
+        cal_count(spi_parms, status, header);
     }
+    spi_parms->transactions++;
+    spi_parms->bytes += len;
+    spi_parms->status = status;
+    spi_parms->chip_state = CC11xx_STATUS_STATE(status);
+    spi_parms->fifo_bytes = CC11xx_STATUS_FIFO(status);
+    spi_parms->fifo_rx = (header & CC11xx_READ_SINGLE) ? 1 : 0;
+}
 
-    if (!timeout)
-    {       
-        if (fsm_state == CC11xx_STATE_RXFIFO_OVERFLOW)
-        {
-            CC_SPIStrobe(spi_parms, CC11xx_SFRX); // Flush Rx FIFO
-            CC_SPIStrobe(spi_parms, CC11xx_SFTX); // Flush Tx FIFO
-        }
-    }    
+/* Asynchronous transactions: queued on spi_parms and run one after the other, through
+ * SPI_TRANSFER_SG_START or the backend spi_start (DMA) when there is one, blocking otherwise. The completion
+ * callback of a transaction may submit the next one of a chain. Transactions are submitted from
+ * the GDO interrupts and their own callbacks only. The blocking functions below wait for the bus.
+ *
+ * With a backend spi_batch (one system call per batch on Linux spidev) the transactions submitted
+ * by an interrupt handler or by the callbacks of a batch are held back (plugged) until it returns,
+ * then run together. A blocking access meanwhile runs the held back ones first. */
+
+static bool spi_batching(spi_parms_t *spi_parms)
+{
+    return spi_parms->backend && spi_parms->backend->spi_batch;
 }
 
-// ------------------------------------------------------------------------------------------------
-// Inhibit operations by returning to IDLE state
-void radio_turn_idle(spi_parms_t *spi_parms)
-// ------------------------------------------------------------------------------------------------
+static void spi_bus_wait(spi_parms_t *spi_parms)
+{
+    spi_async_run(spi_parms);
+    while (spi_parms->op_busy){
+        backend_wait(spi_parms);
+    }
+}
+
+static void spi_async_plug(spi_parms_t *spi_parms)
 {
-    CC_SPIStrobe(spi_parms, CC11xx_SIDLE);
-    radio_flush_fifos(spi_parms);
+    spi_parms->op_plug++;
 }
 
-void radio_turn_rx_isr(spi_parms_t *spi_parms)
+static void spi_async_unplug(spi_parms_t *spi_parms)
 {
-		CC_SPIWriteReg(spi_parms, CC11xx_MCSM1, 0x30);
-    CC_SPIWriteReg(spi_parms, CC11xx_IOCFG2, 0x00); // GDO2 output pin config RX mode
-    radio_int_data.packet_receive = 0;
-		radio_int_data.packet_send = 0;
-    radio_int_data.mode = RADIOMODE_RX;   
-    CC_SPIStrobe(spi_parms, CC11xx_SRX);
+    if (--spi_parms->op_plug == 0){
+        spi_async_run(spi_parms);
+    }
 }
 
-// ------------------------------------------------------------------------------------------------
-// Allow Rx operations by returning to Rx state
-void radio_turn_rx(spi_parms_t *spi_parms)
-// ------------------------------------------------------------------------------------------------
+static void spi_async_start(spi_parms_t *spi_parms)
 {
-    CC_SPIStrobe(spi_parms, CC11xx_SRX);
-    wait_for_state(spi_parms, CC11xx_STATE_RX, 10); // Wait max 10ms
+    if (spi_parms->op_plug && spi_batching(spi_parms)){
+        return;
+    }
+    spi_async_run(spi_parms);
 }
 
-// ------------------------------------------------------------------------------------------------
-// Initialize for Rx mode
-void radio_init_rx(spi_parms_t *spi_parms, radio_parms_t * radio_parms)
-// ------------------------------------------------------------------------------------------------
+// Queued register write that failed: unknown what the chip got
+static void async_shadow_check(spi_parms_t *spi_parms, const cc11xx_spi_op_t *op)
 {
-    radio_int_data.mode = RADIOMODE_RX;
-    radio_int_data.packet_receive = 0;    
-    radio_set_packet_length(spi_parms, radio_parms->packet_length);
-		CC_SPIWriteReg(spi_parms, CC11xx_MCSM1, 0x30);
-    CC_SPIWriteReg(spi_parms, CC11xx_IOCFG2, 0x00); // GDO2 output pin config RX mode
+    uint8_t addr = op->cmd & 0x3F;
+
+    if ((spi_parms->ret != 0) && !(op->cmd & CC11xx_READ_SINGLE) && (op->len > 0) && shadow_cacheable(addr)){
+        spi_parms->shadow_valid &= ~((uint64_t) 1 << addr);
+    }
 }
 
-// ------------------------------------------------------------------------------------------------
-// Flush Rx and Tx FIFOs
-void radio_flush_fifos(spi_parms_t *spi_parms)
-// ------------------------------------------------------------------------------------------------
+// Every queued transaction in one spi_batch call, then their callbacks in order. The callbacks
+// run plugged: what they submit makes the next batch.
+static void spi_async_batch(spi_parms_t *spi_parms)
 {
-    CC_SPIStrobe(spi_parms, CC11xx_SFRX); // Flush Rx FIFO
-    CC_SPIStrobe(spi_parms, CC11xx_SFTX); // Flush Tx FIFO
+    cc11xx_spi_op_t op[CC11xx_SPI_QUEUE_DEPTH];
+    uint8_t status[CC11xx_SPI_QUEUE_DEPTH];
+    radio_int_data_t *radio = spi_parms->radio;
+    uint32_t start = radio ? stats_begin(radio) : 0;
+    uint8_t i, count;
+
+    while (!spi_parms->op_busy && (spi_parms->op_head != spi_parms->op_tail)){
+        count = (uint8_t) (spi_parms->op_head - spi_parms->op_tail);
+        for (i = 0; i < count; i++){
+            op[i] = spi_parms->op[(spi_parms->op_tail + i) % CC11xx_SPI_QUEUE_DEPTH];
+            status[i] = 0;
+        }
+        spi_parms->op_tail += count;
+        spi_parms->op_busy = 1;
+        spi_parms->ret = spi_parms->backend->spi_batch(spi_parms->backend_ctx, op, count, status);
+        spi_parms->op_busy = 0;
+        spi_parms->batches++;
+        spi_async_plug(spi_parms);
+        for (i = 0; i < count; i++){
+            status_update(spi_parms, status[i], op[i].cmd, op[i].len + 1);
+            async_shadow_check(spi_parms, &op[i]);
+            if (op[i].done){
+                op[i].done(spi_parms, op[i].ctx);
+            }
+        }
+        spi_parms->op_plug--;
+    }
+    if (radio){
+        stats_end(radio, NULL, start);
+    }
 }
 
-// ------------------------------------------------------------------------------------------------
-// Set packet length
-int radio_set_packet_length(spi_parms_t *spi_parms, uint8_t pkt_len)
-// ------------------------------------------------------------------------------------------------
+static void spi_async_run(spi_parms_t *spi_parms)
 {
-    return CC_SPIWriteReg(spi_parms, CC11xx_PKTLEN, pkt_len); // Packet length.
+    cc11xx_spi_op_t *op;
+
+    if (spi_parms->op_busy || (spi_parms->op_head == spi_parms->op_tail)){
+        return;
+    }
+    if (spi_batching(spi_parms)){
+        spi_async_batch(spi_parms);
+        return;
+    }
+    op = &spi_parms->op[spi_parms->op_tail % CC11xx_SPI_QUEUE_DEPTH];
+    spi_parms->op_busy = 1;
+    spi_parms->ret = backend_start(spi_parms, op->cmd, &spi_parms->op_status, op->tx, op->rx, op->len);
+    if (spi_parms->ret < 0){
+        spi_parms->ret = backend_transfer_sg(spi_parms, op->cmd, &spi_parms->op_status, op->tx, op->rx, op->len);
+        CC_SPIAsyncComplete(spi_parms);
+    }else if (spi_parms->ret != 0){
+        CC_SPIAsyncComplete(spi_parms); // Not started, completes with the error in ret
+    }
 }
 
 // ------------------------------------------------------------------------------------------------
-// Get packet length
-uint8_t radio_get_packet_length(spi_parms_t *spi_parms)
+// Queue a burst access: command byte cmd then len bytes from tx (zeros if NULL) to rx (dropped if
+// NULL). done(spi_parms, ctx) is called on completion, with the result in spi_parms->ret.
+// Returns 1 if the queue is full (never for the chains of the driver, see SPI_CHAIN_MAX).
+int CC_SPISubmit(spi_parms_t *spi_parms, uint8_t cmd, const uint8_t *tx, uint8_t *rx, uint8_t len, cc11xx_spi_done_t done, void *ctx)
 // ------------------------------------------------------------------------------------------------
 {
-    uint8_t pkt_len;
-    CC_SPIReadReg(spi_parms, CC11xx_PKTLEN, &pkt_len); // Packet length.
-    return pkt_len;
+    cc11xx_spi_op_t *op;
+
+    if ((uint8_t) (spi_parms->op_head - spi_parms->op_tail) >= CC11xx_SPI_QUEUE_DEPTH){
+        return 1;
+    }
+    op = &spi_parms->op[spi_parms->op_head % CC11xx_SPI_QUEUE_DEPTH];
+    op->cmd = cmd;
+    op->tx = tx;
+    op->rx = rx;
+    op->len = len;
+    op->done = done;
+    op->ctx = ctx;
+    spi_parms->op_head++;
+    spi_async_start(spi_parms);
+    return 0;
 }
 
 // ------------------------------------------------------------------------------------------------
-// Get the actual data rate in Bauds
-float radio_get_rate(radio_parms_t *radio_parms)
+// Queue a single register write of *byte, which must stay valid until it is on the bus. The
+// register shadow takes it now as the write comes before any later access; it is left out when
+// the shadow holds it already and there is no done callback. Returns 1 if the queue is full; the
+// shadow of the register is then dropped so that the next write goes to the chip.
+int CC_SPISubmitReg(spi_parms_t *spi_parms, uint8_t addr, const uint8_t *byte, cc11xx_spi_done_t done, void *ctx)
 // ------------------------------------------------------------------------------------------------
 {
-    return ((float) (radio_parms->f_xtal) / (1<<28)) * (256 + radio_parms->drate_m) * (1<<radio_parms->drate_e);
+    if (!done && shadow_cacheable(addr) && (spi_parms->shadow_valid & ((uint64_t) 1 << addr)) && (spi_parms->shadow[addr] == *byte)){
+        spi_parms->writes_avoided++;
+        return 0;
+    }
+    if (CC_SPISubmit(spi_parms, addr, byte, NULL, 1, done, ctx) != 0){
+        if (shadow_cacheable(addr)){
+            spi_parms->shadow_valid &= ~((uint64_t) 1 << addr);
+        }
+        return 1;
+    }
+    shadow_update(spi_parms, addr, *byte);
+    return 0;
 }
 
 // ------------------------------------------------------------------------------------------------
-// Transmission of a block
-static void radio_send_block(spi_parms_t *spi_parms)
+// End of the transaction on the bus: to be called by the backend from its DMA completion
+// interrupt (passed to SPI_TRANSFER_SG_START or the backend spi_start)
+void CC_SPIAsyncComplete(void *ctx)
 // ------------------------------------------------------------------------------------------------
 {
-    uint8_t  initial_tx_count; // Number of bytes to send in first batch
-    uint8_t  cca, cca_count;
-
-    radio_int_data.mode = RADIOMODE_NONE;
-    radio_int_data.packet_send = 0;
-
-    radio_set_packet_length(spi_parms, radio_int_data.tx_count);
-    /* Set this shit to CCA --> Poll for this? Use ISR? */
-    /* Lets start by polling GDO2 pin, if is 1, then Random Back off, look for 1 again and go! */
-    /* The radio is always in RX */
-		CC_SPIWriteReg(spi_parms, CC11xx_MCSM1, 	 0x30);
-    CC_SPIWriteReg(spi_parms, CC11xx_IOCFG2,   0x09); // GDO2 output pin config TX mode
-		
-    radio_turn_rx(spi_parms);
-
-    MDELAY(1);
-    /* Wait 1 ms to the RX to be set */
-		cca_count = 0;
-		do{
-			MDELAY(rand()%256);
-			cca_count++;
-			cca = CC11xx_GDO2();
-		}while((cca == 0) && (cca_count < 3)); 	/* If CCA == 0 (channel is not clear) remain in the loop */
-												/* If cca_count is < 3 remain in the loop */
-		if (cca_count >= 3 && cca == 0){
-			/* If the limit is completed -> go out */
-			/* Put this shit into RX */
-			radio_turn_idle(spi_parms);
-			radio_init_rx(spi_parms, radio_int_data.radio_parms);
-			radio_turn_rx(spi_parms);
-			return;
-		}
-
-		/* Here is TX */
-		CC_SPIWriteReg(spi_parms, CC11xx_MCSM1, 	 0x00);
-		CC_SPIWriteReg(spi_parms, CC11xx_IOCFG2,   0x02); // GDO2 output pin config TX mode
-    radio_int_data.mode = RADIOMODE_TX;
-    // Initial number of bytes to put in FIFO is either the number of bytes to send or the FIFO size whichever is
-    // the smallest. Actual size blocks you need to take size minus one byte.
-    initial_tx_count = (radio_int_data.tx_count > CC11xx_FIFO_SIZE-1 ? CC11xx_FIFO_SIZE-1 : radio_int_data.tx_count);
-    // Initial fill of TX FIFO
-    CC_SPIWriteBurstReg(spi_parms, CC11xx_TXFIFO, (uint8_t *) radio_int_data.tx_buf, initial_tx_count);
-    radio_int_data.byte_index = initial_tx_count;
-    radio_int_data.bytes_remaining = radio_int_data.tx_count - initial_tx_count;
-		CC_SPIStrobe(spi_parms, CC11xx_STX); // Kick-off Tx
-		
+    spi_parms_t *spi_parms = (spi_parms_t *) ctx;
+    cc11xx_spi_op_t op = spi_parms->op[spi_parms->op_tail % CC11xx_SPI_QUEUE_DEPTH];
+    radio_int_data_t *radio = spi_parms->radio;
+    uint32_t start = radio ? stats_begin(radio) : 0;
+
+    status_update(spi_parms, spi_parms->op_status, op.cmd, op.len + 1);
+    async_shadow_check(spi_parms, &op);
+    spi_parms->op_tail++;
+    spi_parms->op_busy = 0;
+    if (op.done){
+        op.done(spi_parms, op.ctx);
+    }
+    spi_async_start(spi_parms);
+    if (radio){
+        stats_end(radio, NULL, start);
+    }
 }
 
 // ------------------------------------------------------------------------------------------------
-// Transmission of a packet
-void radio_send_packet(spi_parms_t *spi_parms, radio_parms_t * radio_parms, uint8_t *packet, uint8_t size)
+// Wait until every queued transaction is done (thread context)
+void CC_SPIAsyncWait(spi_parms_t *spi_parms)
 // ------------------------------------------------------------------------------------------------
 {
-    /* Timeout? */
-		volatile uint16_t timeout = 0;
-    while( (radio_int_data.mode == RADIOMODE_TX || radio_int_data.packet_receive) && ++timeout < radio_parms->timeout)
-    {
-        MSLEEP(1);
+    spi_async_run(spi_parms);
+    while (spi_parms->op_busy || (spi_parms->op_head != spi_parms->op_tail)){
+        backend_wait(spi_parms);
     }
-		if (timeout >= radio_parms->timeout)
-		{
-			timeout = 0;
-			/* Dropped packet */
-			return;
-		}
-    radio_turn_idle(spi_parms);
+}
 
-    radio_int_data.tx_count = radio_parms->packet_length; // same block size for all
-    memset((uint8_t *) &radio_int_data.tx_buf[0], 0, radio_parms->packet_length);
-    memcpy((uint8_t *) &radio_int_data.tx_buf[0], packet, size);
+/* Register shadow: configuration registers are only written when their value changes. FSCAL3..1
+ * are excluded as the chip rewrites them on every calibration. Reset and power down lose the
+ * chip contents, CC_SPIInvalidateShadow() must be called if the chip is reset behind our back. */
 
-    radio_send_block(spi_parms);
+static bool shadow_cacheable(uint8_t addr)
+{
+    return (addr < CC11xx_NUM_CONFIG_REGS) && ((addr < CC11xx_FSCAL3) || (addr > CC11xx_FSCAL1));
 }
 
-void enable_isr_routine(spi_parms_t * spi, radio_parms_t * radio_parms)
+static void shadow_update(spi_parms_t *spi_parms, uint8_t addr, uint8_t byte)
 {
-	radio_int_data.mode = RADIOMODE_NONE;
-	radio_int_data.packet_rx_count = 0;
-	radio_int_data.packet_tx_count = 0;
-	radio_int_data.spi_parms = &spi_parms_it;
-	radio_int_data.radio_parms = radio_parms;
-	init_radio = true;
-	/* enable RX! */
-	radio_init_rx(radio_int_data.spi_parms, radio_int_data.radio_parms);
-	radio_turn_rx(radio_int_data.spi_parms);
+    if (shadow_cacheable(addr)){
+        spi_parms->shadow[addr] = byte;
+        spi_parms->shadow_valid |= ((uint64_t) 1 << addr);
+    }
 }
 
+void CC_SPIInvalidateShadow(spi_parms_t *spi_parms)
+{
+    spi_parms->shadow_valid = 0;
+}
 
 int  CC_SPIWriteReg(spi_parms_t *spi_parms, uint8_t addr, uint8_t byte)
 {
+    if (shadow_cacheable(addr) && (spi_parms->shadow_valid & ((uint64_t) 1 << addr)) && (spi_parms->shadow[addr] == byte)){
+        spi_parms->writes_avoided++; // Chip already holds it, status byte is not refreshed
+        return 0;
+    }
     spi_parms->tx[0] = addr;
     spi_parms->tx[1] = byte;
     spi_parms->len = 2;
-    spi_parms->ret = SPI_TRANSFER(spi_parms->tx, spi_parms->rx, spi_parms->len);
+    spi_bus_wait(spi_parms);
+    spi_parms->ret = backend_transfer(spi_parms, spi_parms->tx, spi_parms->rx, spi_parms->len);
     if (spi_parms->ret != 0){
+        spi_parms->shadow_valid &= ~((uint64_t) 1 << (addr & 0x3F)); // Unknown what the chip got
         return 1;
     }
-    spi_parms->status = spi_parms->rx[0];
+    shadow_update(spi_parms, addr, byte);
+    status_update(spi_parms, spi_parms->rx[0], spi_parms->tx[0], spi_parms->len);
     return 0;
 }
 
-/* Correct write burst to be multiple calls to write reg */
+/* Burst accesses go through SPI_TRANSFER_SG: header byte then the payload straight from or to the
+ * caller's buffer, no staging in spi_parms */
 
 int  CC_SPIWriteBurstReg(spi_parms_t *spi_parms, uint8_t addr, const uint8_t *bytes, uint8_t count)
 {
-    uint8_t i;
-
-    count %= 64;
-    spi_parms->tx[0] = addr | CC11xx_WRITE_BURST;   // Send address
-
-    for (i=1; i<count+1; i++)
-    {
-        spi_parms->tx[i] = bytes[i-1];
-    }
-    spi_parms->len = count+1;
+    uint8_t i, status;
 
-    spi_parms->ret = SPI_TRANSFER(spi_parms->tx, spi_parms->rx, spi_parms->len);
+    spi_bus_wait(spi_parms);
+    spi_parms->ret = backend_transfer_sg(spi_parms, addr | CC11xx_WRITE_BURST, &status, bytes, NULL, count);
 
     if (spi_parms->ret != 0){
+        if (addr < CC11xx_NUM_CONFIG_REGS){
+            spi_parms->shadow_valid = 0;
+        }
         return 1;
     }
-    spi_parms->status = spi_parms->rx[0];
+    for (i=0; i<count && addr+i < CC11xx_NUM_CONFIG_REGS; i++)
+    {
+        shadow_update(spi_parms, addr+i, bytes[i]);
+    }
+    status_update(spi_parms, status, addr | CC11xx_WRITE_BURST, count + 1);
     return 0;
 }
 
@@ -854,40 +3225,35 @@ int  CC_SPIReadReg(spi_parms_t *spi_parms, uint8_t addr, uint8_t *byte)
     spi_parms->tx[1] = 0; // Dummy write so we can read data
     spi_parms->len = 2;
 
-    spi_parms->ret = SPI_TRANSFER(spi_parms->tx, spi_parms->rx, spi_parms->len);
+    spi_bus_wait(spi_parms);
+    spi_parms->ret = backend_transfer(spi_parms, spi_parms->tx, spi_parms->rx, spi_parms->len);
 
     if (spi_parms->ret != 0){
         return 1;
     }
     *byte = spi_parms->rx[1];
-    spi_parms->status = spi_parms->rx[0];
+    shadow_update(spi_parms, addr, *byte);
+    status_update(spi_parms, spi_parms->rx[0], spi_parms->tx[0], spi_parms->len);
     return 0;
 }
 
-/* Correct read burst to be multiple calls to read reg */
-
 int  CC_SPIReadBurstReg(spi_parms_t *spi_parms, uint8_t addr, uint8_t *bytes, uint8_t count)
 {    
-    uint8_t i;
-
-    count %= 64;
-    spi_parms->tx[0] = addr | CC11xx_READ_BURST;   // Send address
-
-    for (i=1; i<count+1; i++)
-    {
-        spi_parms->tx[i] = 0; // Dummy write so we can read data
-    }
+    uint8_t i, status;
 
-    spi_parms->len = count+1;
-    spi_parms->ret = SPI_TRANSFER(spi_parms->tx, spi_parms->rx, spi_parms->len);
+    spi_bus_wait(spi_parms);
+    spi_parms->ret = backend_transfer_sg(spi_parms, addr | CC11xx_READ_BURST, &status, NULL, bytes, count);
 
     if (spi_parms->ret != 0)
     {
         return 1;
     }
 
-		memcpy(bytes, &spi_parms->rx[1], count);
-    spi_parms->status = spi_parms->rx[0];
+    for (i=0; i<count && addr+i < CC11xx_NUM_CONFIG_REGS; i++)
+    {
+        shadow_update(spi_parms, addr+i, bytes[i]);
+    }
+    status_update(spi_parms, status, addr | CC11xx_READ_BURST, count + 1);
     return 0;
 }
 
@@ -897,48 +3263,214 @@ int  CC_SPIReadStatus(spi_parms_t *spi_parms, uint8_t addr, uint8_t *status)
     spi_parms->tx[1] = 0; // Dummy write so we can read data
     spi_parms->len = 2;
 
-    spi_parms->ret = SPI_TRANSFER(spi_parms->tx, spi_parms->rx, spi_parms->len);
+    spi_bus_wait(spi_parms);
+    spi_parms->ret = backend_transfer(spi_parms, spi_parms->tx, spi_parms->rx, spi_parms->len);
 
     if (spi_parms->ret != 0)
     {
         return 1;
     }
     *status = spi_parms->rx[1];
-    spi_parms->status = spi_parms->rx[0];
+    status_update(spi_parms, spi_parms->rx[0], spi_parms->tx[0], spi_parms->len);
     return 0;
 }
 
 int  CC_SPIStrobe(spi_parms_t *spi_parms, uint8_t strobe)
 {
+    if ((strobe == CC11xx_SRES) || (strobe == CC11xx_SPWD)){
+        CC_SPIInvalidateShadow(spi_parms); // Registers back to defaults or not retained
+    }
     spi_parms->tx[0] = strobe;   // Send strobe
     spi_parms->len = 1;
 
-    spi_parms->ret = SPI_TRANSFER(spi_parms->tx, spi_parms->rx, spi_parms->len);
+    spi_bus_wait(spi_parms);
+    spi_parms->ret = backend_transfer(spi_parms, spi_parms->tx, spi_parms->rx, spi_parms->len);
 
     if (spi_parms->ret != 0)
     {
         return 1;
     }
-    spi_parms->status = spi_parms->rx[0];
+    status_update(spi_parms, spi_parms->rx[0], spi_parms->tx[0], spi_parms->len);
     return 0;
 }
 
+// Chip state as of the last access, no SPI traffic
+CC11xx_status_state_t CC_SPIChipState(spi_parms_t *spi_parms)
+{
+    return (CC11xx_status_state_t) spi_parms->chip_state;
+}
+
+// One byte access (SNOP) to refresh the status byte
+int  CC_SPIRefreshStatus(spi_parms_t *spi_parms)
+{
+    return CC_SPIStrobe(spi_parms, CC11xx_SNOP);
+}
+
 int  CC_PowerupResetCCxxxx(spi_parms_t *spi_parms)
 {
     return CC_SPIStrobe(spi_parms, CC11xx_SRES);
 }
 
+/* Transaction batches: each access is a cc11xx_spi_op_t as on the asynchronous engine (header
+ * byte then the payload, none for strobes), run blocking by the caller. Shadow and status byte
+ * bookkeeping is the same as for the single access functions above. */
+
+static bool batch_add(cc11xx_batch_t *batch, uint8_t cmd, const uint8_t *tx, uint8_t *rx, uint8_t len)
+{
+    cc11xx_spi_op_t *op;
+
+    if (batch->count >= CC11xx_SPI_QUEUE_DEPTH){
+        batch->overflow = 1;
+        return false;
+    }
+    op = &batch->op[batch->count++];
+    op->cmd = cmd;
+    op->tx = tx;
+    op->rx = rx;
+    op->len = len;
+    op->done = NULL;
+    op->ctx = NULL;
+    return true;
+}
+
+// Configuration registers written by a transaction: not a read, strobe or FIFO access
+static bool batch_writes_config(const cc11xx_spi_op_t *op)
+{
+    return !(op->cmd & CC11xx_READ_SINGLE) && (op->len > 0) && ((op->cmd & 0x3F) < CC11xx_NUM_CONFIG_REGS);
+}
+
+// Configuration register addr written by a transaction
+static bool batch_writes_reg(const cc11xx_spi_op_t *op, uint8_t addr)
+{
+    uint8_t first = op->cmd & 0x3F;
+
+    return batch_writes_config(op) && (addr >= first) && (addr < first + op->len);
+}
+
+void CC_BatchInit(cc11xx_batch_t *batch, spi_parms_t *spi_parms)
+{
+    batch->spi_parms = spi_parms;
+    batch->count = 0;
+    batch->reset = 0;
+    batch->overflow = 0;
+}
+
+void CC_BatchStrobe(cc11xx_batch_t *batch, uint8_t strobe)
+{
+    if ((strobe == CC11xx_SRES) || (strobe == CC11xx_SPWD)){
+        batch->reset = 1;
+    }
+    batch_add(batch, strobe, NULL, NULL, 0);
+}
+
+// Left out when the chip already holds the value and nothing before it in the batch writes that register
+void CC_BatchWriteReg(cc11xx_batch_t *batch, uint8_t addr, uint8_t byte)
+{
+    spi_parms_t *spi_parms = batch->spi_parms;
+    uint8_t i, slot = batch->count;
+
+    if (!batch->reset && shadow_cacheable(addr) && (spi_parms->shadow_valid & ((uint64_t) 1 << addr)) && (spi_parms->shadow[addr] == byte)){
+        for (i = 0; (i < batch->count) && !batch_writes_reg(&batch->op[i], addr); i++){
+        }
+        if (i == batch->count){
+            spi_parms->writes_avoided++;
+            return;
+        }
+    }
+    if (batch_add(batch, addr, &batch->value[slot], NULL, 1)){
+        batch->value[slot] = byte;
+    }
+}
+
+void CC_BatchWriteBurst(cc11xx_batch_t *batch, uint8_t addr, const uint8_t *bytes, uint8_t count)
+{
+    batch_add(batch, addr | CC11xx_WRITE_BURST, bytes, NULL, count);
+}
+
+void CC_BatchReadReg(cc11xx_batch_t *batch, uint8_t addr, uint8_t *byte)
+{
+    batch_add(batch, addr | CC11xx_READ_SINGLE, NULL, byte, 1);
+}
+
+void CC_BatchReadStatus(cc11xx_batch_t *batch, uint8_t addr, uint8_t *status)
+{
+    batch_add(batch, addr | CC11xx_READ_BURST, NULL, status, 1);
+}
+
+void CC_BatchReadBurst(cc11xx_batch_t *batch, uint8_t addr, uint8_t *bytes, uint8_t count)
+{
+    batch_add(batch, addr | CC11xx_READ_BURST, NULL, bytes, count);
+}
+
+// Returns 1 if the batch overflowed (nothing sent) or a transfer failed (the rest is not sent
+// without spi_batch, and the register shadow is dropped if the batch writes configuration)
+int  CC_BatchRun(cc11xx_batch_t *batch)
+{
+    spi_parms_t *spi_parms = batch->spi_parms;
+    cc11xx_spi_op_t *op;
+    const uint8_t *data;
+    uint8_t i, j, addr;
+
+    if (batch->overflow){
+        spi_parms->ret = 1;
+        return 1;
+    }
+    spi_bus_wait(spi_parms);
+    spi_parms->ret = 0;
+    if (batch->count == 0){
+        return 0;
+    }
+    if (spi_batching(spi_parms)){
+        spi_parms->ret = spi_parms->backend->spi_batch(spi_parms->backend_ctx, batch->op, batch->count, batch->status);
+        spi_parms->batches++;
+    }else{
+        for (i = 0; (i < batch->count) && (spi_parms->ret == 0); i++){
+            op = &batch->op[i];
+            if (op->len == 0){
+                spi_parms->ret = backend_transfer(spi_parms, &op->cmd, &batch->status[i], 1);
+            }else{
+                spi_parms->ret = backend_transfer_sg(spi_parms, op->cmd, &batch->status[i], op->tx, op->rx, op->len);
+            }
+        }
+    }
+    if (spi_parms->ret != 0){
+        for (i = 0; (i < batch->count) && !batch_writes_config(&batch->op[i]); i++){
+        }
+        if (batch->reset || (i < batch->count)){
+            CC_SPIInvalidateShadow(spi_parms); // Unknown what the chip got
+        }
+        return 1;
+    }
+    for (i = 0; i < batch->count; i++){
+        op = &batch->op[i];
+        addr = op->cmd & 0x3F;
+        if ((op->len == 0) && ((op->cmd == CC11xx_SRES) || (op->cmd == CC11xx_SPWD))){
+            CC_SPIInvalidateShadow(spi_parms); // Registers back to defaults or not retained
+        }
+        data = (op->cmd & CC11xx_READ_SINGLE) ? op->rx : op->tx;
+        for (j = 0; data && (j < op->len) && (addr + j < CC11xx_NUM_CONFIG_REGS); j++){
+            shadow_update(spi_parms, addr + j, data[j]);
+        }
+        status_update(spi_parms, batch->status[i], op->cmd, op->len + 1);
+    }
+    return 0;
+}
+
 
-void disable_IT(void)
+// Mask the GDO and backoff timer interrupts of the radio. The DMA completion interrupt stays
+// enabled, the queued chain needs it to finish: once it has, no completion callback is left to
+// change mode, packet_receive or the TX queue behind the caller.
+void disable_IT(radio_int_data_t *radio)
 {
-    /* Must be changed */
-		HAL_NVIC_DisableIRQ(EXTI0_IRQn);
-		HAL_NVIC_DisableIRQ(EXTI9_5_IRQn);
+    spi_parms_t *spi_parms = (spi_parms_t *) &radio->spi;
+
+    backend_it_disable(spi_parms);
+    if (radio->init){
+        CC_SPIAsyncWait(spi_parms); // Let a FIFO unload chain run to its end
+    }
 }
 
-void enable_IT(void)
+void enable_IT(radio_int_data_t *radio)
 {
-		/* Must be changed */
-		HAL_NVIC_EnableIRQ(EXTI0_IRQn);
-		HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
+    backend_it_enable((spi_parms_t *) &radio->spi);
 }
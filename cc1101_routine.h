@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "cc1101_trace.h"
+
 /* Preamble amount */
 typedef enum preamble_e {
     PREAMBLE_2,
@@ -60,15 +62,36 @@ typedef enum rate_e {
     NUM_RATE
 } rate_t;
 
+/* Packet length configuration (PKTCTRL0.LENGTH_CONFIG) */
+typedef enum packet_length_e
+{
+    PACKET_LENGTH_FIXED = 0,  // All packets are packet_length bytes
+    PACKET_LENGTH_VARIABLE,   // First byte is the payload length, up to packet_length
+    PACKET_LENGTH_INFINITE,   // Streams only: 2 byte length header, see radio_send_stream()
+    NUM_PACKET_LENGTH
+} packet_length_t;
+
 /* Radio mode */
 typedef enum radio_mode_e
 {
     RADIOMODE_NONE = 0,
     RADIOMODE_RX,
     RADIOMODE_TX,
+    RADIOMODE_SCAN,                         // RSSI scan, see radio_scan_start()
+    RADIOMODE_CAL,                          // RADIO_CAL_PERIODIC calibration running, see radio_tx_process()
     NUM_RADIOMODE
 } radio_mode_t;
 
+/* Synthesizer calibration policy (MCSM0.FS_AUTOCAL), see set_cal_policy() */
+typedef enum radio_cal_policy_e
+{
+    RADIO_CAL_EVERY = 0,      // On every IDLE to RX/TX transition (FS_AUTOCAL=1)
+    RADIO_CAL_EVERY_4TH,      // Every 4th automatic RX/TX to IDLE return (FS_AUTOCAL=3)
+    RADIO_CAL_PERIODIC,       // SCAL by radio_tx_process() on a time or temperature trigger (FS_AUTOCAL=0)
+    RADIO_CAL_NEVER,          // SCAL once by enable_isr_routine(), then the calibration cache (FS_AUTOCAL=0)
+    NUM_RADIO_CAL
+} radio_cal_policy_t;
+
 typedef enum CC11xx_state_e {
     CC11xx_STATE_SLEEP = 0,
     CC11xx_STATE_IDLE,
@@ -95,6 +118,22 @@ typedef enum CC11xx_state_e {
     CC11xx_STATE_TXFIFO_UNDERFLOW
 } CC11xx_state_t;
 
+// State field of the chip status byte, the first byte out of every SPI access
+typedef enum CC11xx_status_state_e {
+    CC11xx_STATUS_IDLE = 0,
+    CC11xx_STATUS_RX,
+    CC11xx_STATUS_TX,
+    CC11xx_STATUS_FSTXON,
+    CC11xx_STATUS_CALIBRATE,
+    CC11xx_STATUS_SETTLING,
+    CC11xx_STATUS_RXFIFO_OVERFLOW,
+    CC11xx_STATUS_TXFIFO_UNDERFLOW
+} CC11xx_status_state_t;
+
+#define CC11xx_STATUS_CHIP_RDYn  0x80
+#define CC11xx_STATUS_STATE(s)   (((s) >> 4) & 0x07)
+#define CC11xx_STATUS_FIFO(s)    ((s) & 0x0F) // RX FIFO bytes after a read, TX FIFO free bytes after a write, 15 means 15 or more
+
 // Configuration Registers
 #define CC11xx_IOCFG2       0x00        // GDO2 output pin configuration
 #define CC11xx_IOCFG1       0x01        // GDO1 output pin configuration
@@ -191,7 +230,107 @@ typedef enum CC11xx_state_e {
 
 // Various constants
 #define CC11xx_FIFO_SIZE         64     // Rx or Tx FIFO size
+#define CC11xx_FIFO_THR_DEFAULT  14     // FIFOTHR.FIFO_THR: 60 bytes in RX, 5 bytes left in TX
 #define CC11xx_PACKET_COUNT_SIZE 255    // Packet bytes maximum count
+#define CC11xx_NUM_CONFIG_REGS   0x2F   // Configuration registers IOCFG2..TEST0
+#define CC11xx_STREAM_MIN_LENGTH 256    // Streams shorter than this are sent as packets
+#define CC11xx_STREAM_MAX_LENGTH 65535  // Limited by the 2 byte stream header
+
+// Number of received packet slots queued between gdo0_isr() and the application (power of two)
+#ifndef CC11xx_RX_RING_DEPTH
+#define CC11xx_RX_RING_DEPTH     4
+#endif
+
+// Number of frames waiting for transmission (power of two)
+#ifndef CC11xx_TX_QUEUE_DEPTH
+#define CC11xx_TX_QUEUE_DEPTH    4
+#endif
+
+// CSMA/CA: unslotted binary exponential backoff, the window grows from 2^MIN_BE to 2^MAX_BE slots
+// each time the channel is found busy
+#ifndef CC11xx_CSMA_MIN_BE
+#define CC11xx_CSMA_MIN_BE       3
+#endif
+#ifndef CC11xx_CSMA_MAX_BE
+#define CC11xx_CSMA_MAX_BE       6
+#endif
+#ifndef CC11xx_CSMA_ATTEMPTS
+#define CC11xx_CSMA_ATTEMPTS     4      // Clear channel assessments before a frame is given up
+#endif
+#ifndef CC11xx_CSMA_SLOT_BITS
+#define CC11xx_CSMA_SLOT_BITS    40     // Default slot: RSSI settling and RX to TX turnaround
+#endif
+#define CC11xx_CSMA_MAX_ATTEMPTS 8
+#define CC11xx_CSMA_BE_LIMIT     10
+
+// Channels held by the calibration cache, see radio_cal_channel()
+#ifndef CC11xx_CAL_CHANNELS
+#define CC11xx_CAL_CHANNELS      16
+#endif
+
+// RSSI scan: synthesizer settling from IDLE to RX without calibration (us), added to the RSSI
+// response time of the channel filter, see radio_scan_settle_us()
+#ifndef CC11xx_SCAN_FS_SETTLE_US
+#define CC11xx_SCAN_FS_SETTLE_US 90
+#endif
+// ... and calibration time added on channels missing from the calibration cache (us)
+#ifndef CC11xx_SCAN_CAL_US
+#define CC11xx_SCAN_CAL_US       730
+#endif
+
+// Duration of one synthesizer calibration (us), for the ones the driver cannot time, see
+// radio_get_stats()
+#ifndef CC11xx_CAL_US
+#define CC11xx_CAL_US            720
+#endif
+
+// Interval between two status polls of wait_for_state() (us)
+#ifndef CC11xx_STATE_POLL_US
+#define CC11xx_STATE_POLL_US     15
+#endif
+
+// Number of asynchronous SPI transactions waiting for the bus (power of two)
+#ifndef CC11xx_SPI_QUEUE_DEPTH
+#define CC11xx_SPI_QUEUE_DEPTH   8
+#endif
+
+struct spi_parms_s;
+struct radio_int_data_s;
+struct cc11xx_spi_op_s;
+
+/* Completion of an asynchronous SPI transaction, called from the transfer completion interrupt */
+typedef void (*cc11xx_spi_done_t)(struct spi_parms_s *spi_parms, void *ctx);
+
+/* SPI backend and GDO bindings of one radio, ctx is spi_parms->backend_ctx. Used in place of the
+ * cc1101_wrapper.h macros when spi_parms->backend is set, so each radio can sit on its own bus,
+ * DMA channel, GDO pins and EXTI lines. spi_start, timer_start and spi_batch are optional (NULL):
+ * queued transfers then run blocking one by one and backoffs are polled by radio_tx_process(). */
+typedef struct cc11xx_backend_s
+{
+    int     (*spi_transfer)(void *ctx, uint8_t *tx, uint8_t *rx, uint8_t len);            // See SPI_TRANSFER
+    int     (*spi_transfer_sg)(void *ctx, uint8_t cmd, uint8_t *status, const uint8_t *tx, uint8_t *rx, uint8_t len); // See SPI_TRANSFER_SG
+    int     (*spi_start)(void *ctx, uint8_t cmd, uint8_t *status, const uint8_t *tx, uint8_t *rx, uint8_t len,
+                         void (*done)(void *done_ctx), void *done_ctx);                      // See SPI_TRANSFER_SG_START
+    void    (*spi_wait)(void *ctx);                                                         // See CC11xx_SPI_WAIT
+    int     (*gdo0)(void *ctx);
+    int     (*gdo2)(void *ctx);
+    void    (*it_disable)(void *ctx);       // Masks the GDO (and backoff timer) interrupts of this radio
+    void    (*it_enable)(void *ctx);
+    void    (*timer_start)(void *ctx, uint32_t us); // Calls radio_csma_timer_isr() of this radio after us microseconds
+    int     (*spi_batch)(void *ctx, const struct cc11xx_spi_op_s *op, uint8_t count, uint8_t *status); // Runs count queued
+                                            // transactions blocking in one go (status byte of op[i] to status[i]), see spi_async_plug()
+} cc11xx_backend_t;
+
+/* Asynchronous SPI transaction, see CC_SPISubmit() */
+typedef struct cc11xx_spi_op_s
+{
+    uint8_t           cmd;                  // Header byte
+    const uint8_t     *tx;                  // Payload written, NULL for dummy bytes
+    uint8_t           *rx;                  // Payload read, NULL to drop it
+    uint8_t           len;                  // Payload length
+    cc11xx_spi_done_t done;                 // Completion callback, may be NULL
+    void              *ctx;
+} cc11xx_spi_op_t;
 
 
 /* spi structure */
@@ -200,11 +339,45 @@ typedef struct spi_parms_s
     int      fd;
     int      ret;    /* Ret value of funcking SPI */
     uint8_t  status;
-    uint8_t  tx[CC11xx_FIFO_SIZE + 1]; // max 1 command byte + 64 bytes FIFO
-    uint8_t  rx[CC11xx_FIFO_SIZE + 1]; // max 1 status byte + 64 bytes FIFO
+    uint8_t  chip_state;                    // CC11xx_status_state_t of the last status byte
+    uint8_t  fifo_bytes;                    // FIFO field of the last status byte ...
+    uint8_t  fifo_rx;                       // ... about the RX FIFO (read access) or the TX FIFO
+    uint8_t  tx[2];  // Single accesses: 1 command byte + 1 data byte, bursts are scatter/gather
+    uint8_t  rx[2];  // Single accesses: 1 status byte + 1 data byte
     uint8_t  len;
+    uint8_t  shadow[CC11xx_NUM_CONFIG_REGS]; // Last value written to each configuration register
+    uint64_t shadow_valid;                  // One bit per register: shadow matches the chip
+    uint32_t writes_avoided;                // CC_SPIWriteReg() calls skipped as redundant
+    uint32_t transactions;                  // SPI accesses done
+    uint32_t bytes;                         // ... and bytes clocked, status and header bytes included
+    cc11xx_spi_op_t  op[CC11xx_SPI_QUEUE_DEPTH]; // Asynchronous transactions waiting for the bus
+    volatile uint8_t op_head;
+    volatile uint8_t op_tail;
+    volatile uint8_t op_busy;               // An asynchronous transaction is on the bus
+    uint8_t  op_status;                     // Status byte of the last asynchronous transaction
+    uint8_t  op_plug;                       // Transactions held back for one spi_batch while > 0
+    uint32_t batches;                       // spi_batch calls done
+    uint32_t calibrations;                  // Calibrations started: SCAL, IDLE exits or returns as MCSM0.FS_AUTOCAL says
+    uint8_t  cal_returns;                   // Automatic returns to IDLE with FS_AUTOCAL=3, one in 4 calibrates
+    const cc11xx_backend_t *backend;        // NULL for the cc1101_wrapper.h bindings
+    void     *backend_ctx;
+    volatile struct radio_int_data_s *radio; // Radio driven through this copy, see enable_isr_routine()
 } spi_parms_t;
 
+/* Blocking transaction batch: strobes, register writes and reads, status reads and FIFO bursts
+ * collected with CC_Batch*() and run in order by CC_BatchRun() as one backend spi_batch call (one
+ * SPI_IOC_MESSAGE on Linux), back to back otherwise. Reads land in place when it returns. */
+typedef struct cc11xx_batch_s
+{
+    spi_parms_t     *spi_parms;
+    cc11xx_spi_op_t op[CC11xx_SPI_QUEUE_DEPTH];
+    uint8_t         value[CC11xx_SPI_QUEUE_DEPTH];  // Single register writes
+    uint8_t         status[CC11xx_SPI_QUEUE_DEPTH]; // Status byte of each transaction
+    uint8_t         count;
+    uint8_t         reset;                  // SRES or SPWD queued: no write is known redundant past it
+    uint8_t         overflow;               // Too many transactions: CC_BatchRun() fails, nothing is sent
+} cc11xx_batch_t;
+
 /* Radio parameters */
 typedef struct radio_parms_s
 {
@@ -212,10 +385,12 @@ typedef struct radio_parms_s
     float              freq_hz;       // RF frequency;
     float              f_if;          // IF frequency (Hz)
 		float 						 f_off;
-    uint8_t            packet_length; // Packet length if fixed
+    uint8_t            packet_length; // Packet length if fixed, maximum length if variable
+    packet_length_t    length_mode;   // Fixed or variable packet length
     radio_modulation_t modulation;    // Type of modulation
     rate_t             drate;         // Data rate of the system
-    float              mod_index;     // Modulation index Carlson rule
+    uint32_t           drate_hz;      // Arbitrary data rate set by set_rate_parameters(), 0 when drate is used
+    uint32_t           mod_index_q16; // Modulation index for Carson's rule, Q16 (CC11xx_MOD_INDEX_Q16())
     uint8_t            fec;           // FEC is in use
     uint8_t            whitening;     // Whitening useds
     preamble_t         preamble;      // Preamble count
@@ -224,6 +399,9 @@ typedef struct radio_parms_s
     uint32_t           freq_word;     // Frequency 24 bit word FREQ[23..0]
     uint8_t            chanspc_m;     // Channel spacing mantissa 
     uint8_t            chanspc_e;     // Channel spacing exponent
+    uint32_t           chanspc_hz;    // Channel spacing achieved by set_channel_plan() (Hz)
+    uint16_t           chan_count;    // Channels of the plan, freq_hz is channel 0
+    uint8_t            channr;        // Current channel (CHANNR)
     uint8_t            if_word;       // Intermediate frequency 5 bit word FREQ_IF[4:0] 
     uint8_t            drate_m;       // Data rate mantissa
     uint8_t            drate_e;       // Data rate exponent
@@ -231,24 +409,244 @@ typedef struct radio_parms_s
     uint8_t            chanbw_e;      // Channel bandwidth exponent
     uint8_t            deviat_m;      // Deviation mantissa
     uint8_t            deviat_e;      // Deviation exponent
+    uint8_t            fifo_thr;      // FIFOTHR.FIFO_THR: RX threshold 4*(n+1), TX threshold 61-4*n bytes
+    radio_cal_policy_t cal_policy;    // When the synthesizer calibrates
+    uint32_t           cal_period_ms; // RADIO_CAL_PERIODIC: time between calibrations, 0 for none ...
+    uint8_t            cal_temp_delta; // ... temperature drift calling for one (degrees), 0 for none
 } radio_parms_t;
 
-/* Handler for radio interrupt data */
+/* Register words found by radio_solve_rate() and what they achieve */
+typedef struct radio_rate_fit_s
+{
+    uint8_t   drate_m;
+    uint8_t   drate_e;
+    uint8_t   deviat_m;
+    uint8_t   deviat_e;
+    uint8_t   chanbw_m;
+    uint8_t   chanbw_e;
+    uint32_t  drate_hz;       // Achieved data rate (Baud)
+    int32_t   drate_ppm;      // Data rate error
+    uint32_t  deviat_hz;      // Achieved deviation (Hz)
+    int32_t   deviat_ppm;     // Deviation error
+    uint32_t  chanbw_hz;      // Receiver channel filter bandwidth (Hz)
+    uint32_t  required_bw_hz; // Carson's rule plus crystal drift margin
+} radio_rate_fit_t;
+
+/* Received packet with its reception data */
+typedef struct radio_rx_slot_s
+{
+    uint8_t         data[CC11xx_PACKET_COUNT_SIZE]; // Packet payload
+    uint8_t         length;                 // Number of bytes in data
+    uint8_t         lqi;                    // Link quality indicator
+    uint8_t         crc_ok;                 // CRC check passed
+    float           rssi;                   // RSSI in dBm
+    uint32_t        timestamp;              // Reception time in CC11xx_TIMESTAMP() ticks
+} radio_rx_slot_t;
+
+/* Single producer (gdo0_isr) / single consumer (application) ring of received packets */
+typedef struct radio_rx_ring_s
+{
+    radio_rx_slot_t slot[CC11xx_RX_RING_DEPTH];
+    uint32_t        head;                   // Written by the ISR only: slots committed so far
+    uint32_t        tail;                   // Written by the application only: slots released so far
+    uint32_t        overruns;               // Packets dropped because the ring was full
+} radio_rx_ring_t;
+
+/* Completion status of a queued frame */
+typedef enum radio_tx_status_e
+{
+    RADIO_TX_PENDING = 0,   // Waiting in the queue or on air
+    RADIO_TX_SENT,          // Transmitted
+    RADIO_TX_CCA_FAILED,    // Channel never found clear
+    RADIO_TX_UNDERFLOW,     // TX FIFO underflow, frame cut short
+    RADIO_TX_TIMEOUT,       // Not started within radio_parms->timeout
+    RADIO_TX_UNKNOWN        // Ticket not issued yet or too old to be tracked
+} radio_tx_status_t;
+
+/* Called on frame completion, possibly from interrupt context */
+typedef void (*radio_tx_callback_t)(volatile struct radio_int_data_s *radio, uint32_t ticket, radio_tx_status_t status);
+
+/* Called from interrupt context when a stream has been received into the application buffer */
+typedef void (*radio_stream_callback_t)(volatile struct radio_int_data_s *radio, uint8_t *data, uint32_t length, uint8_t crc_ok);
+
+/* Frame waiting for transmission */
+typedef struct radio_tx_frame_s
+{
+    uint8_t         data[CC11xx_PACKET_COUNT_SIZE]; // Frame as sent on air
+    uint8_t         length;                 // Number of bytes in data
+    uint32_t        deadline;               // CC11xx_TIMESTAMP() after which the frame is dropped
+    const uint8_t   *stream;                // Stream data sent in place of data (infinite length mode)
+    uint32_t        stream_length;          // Number of bytes in stream
+} radio_tx_frame_t;
+
+/* CSMA/CA settings, see radio_csma_config() */
+typedef struct radio_csma_parms_s
+{
+    uint32_t        slot_us;                // Backoff slot (us), 0 for CC11xx_CSMA_SLOT_BITS at the data rate
+    uint8_t         min_be;                 // Initial backoff exponent
+    uint8_t         max_be;                 // Largest backoff exponent, up to CC11xx_CSMA_BE_LIMIT
+    uint8_t         max_attempts;           // Assessments per frame, 1 to CC11xx_CSMA_MAX_ATTEMPTS
+    uint32_t        burst_us;               // Airtime of queued frames sent back to back after one assessment, 0 for none
+} radio_csma_parms_t;
+
+/* CSMA/CA counters */
+typedef struct radio_csma_stats_s
+{
+    uint32_t        assessments;            // Clear channel assessments done
+    uint32_t        busy;                   // ... that found the channel busy
+    uint32_t        failures;               // Frames given up with RADIO_TX_CCA_FAILED
+    uint32_t        backoff_slots;          // Slots waited in total
+    uint32_t        clear_at[CC11xx_CSMA_MAX_ATTEMPTS]; // Frames sent after 1, 2, ... assessments
+    uint32_t        bursts;                 // Assessments followed by more than one frame
+    uint32_t        chained;                // Frames sent in a burst without their own assessment
+} radio_csma_stats_t;
+
+/* Synthesizer calibration of one channel */
+typedef struct radio_cal_entry_s
+{
+    uint8_t         freq[3];                // FREQ2..0
+    uint8_t         channr;                 // CHANNR
+    uint8_t         fscal[3];               // FSCAL3..1 found by SCAL on that frequency
+} radio_cal_entry_t;
+
+/* Calibration cache for frequency hopping: channels calibrated once, restored on each hop */
+typedef struct radio_cal_cache_s
+{
+    radio_cal_entry_t entry[CC11xx_CAL_CHANNELS];
+    uint8_t         count;
+    uint8_t         active;                 // Autocalibration turned off by radio_hop()
+    uint32_t        hops;
+    uint32_t        last_hop_us;            // IDLE to RX of the last hop, 0 without CC11xx_CYCLES()
+} radio_cal_cache_t;
+
+/* RSSI scan over a list of channels of the channel plan, owned by the application */
+typedef struct radio_scan_s
+{
+    const uint8_t   *channels;              // CHANNR of each point
+    uint16_t        count;
+    uint8_t         *rssi;                  // Raw RSSI of each point after a sweep, see radio_scan_dbm()
+    uint32_t        settle_us;              // Wait from SRX to the RSSI read, radio_scan_settle_us() by default
+    uint32_t        sweeps;
+    uint32_t        sweep_us;               // Duration of the last sweep, 0 without CC11xx_CYCLES()
+} radio_scan_t;
+
+/* Duration of an interrupt handler in CC11xx_CYCLES() units, mean is total / count */
+typedef struct radio_isr_time_s
+{
+    uint32_t        count;
+    uint32_t        min;
+    uint32_t        max;
+    uint64_t        total;
+} radio_isr_time_t;
+
+/* Driver counters, see radio_get_stats() */
+typedef struct radio_stats_s
+{
+    uint32_t        rx_packets;             // Received with a good CRC
+    uint32_t        rx_crc_errors;
+    uint32_t        rx_overflows;           // Packets lost to a RX FIFO overflow
+    uint32_t        rx_stream_drops;        // Streams lost: no buffer or callback, or their end missed
+    uint32_t        tx_packets;
+    uint32_t        tx_underflows;
+    uint32_t        tx_cca_failures;
+    uint32_t        tx_timeouts;            // Frames dropped past radio_parms->timeout
+    uint32_t        spi_transactions;       // Driver side SPI accesses
+    uint32_t        spi_bytes;
+    uint32_t        spi_batches;            // Backend spi_batch calls (system calls on Linux)
+    uint32_t        pkt_spi_transactions;   // SPI cost of the last packet received or sent ...
+    uint32_t        pkt_spi_bytes;
+    uint32_t        pkt_spi_transactions_max; // ... and of the costliest one
+    uint32_t        pkt_spi_bytes_max;
+    radio_isr_time_t gdo0;                  // gdo0_isr() duration
+    radio_isr_time_t gdo2;                  // gdo2_isr() duration
+    radio_isr_time_t turnaround;            // End of a received packet to STX of the reply, see radio_turnaround_config()
+    uint32_t        calibrations;           // Synthesizer calibrations started, see set_cal_policy()
+    radio_isr_time_t calibration;           // SCAL to IDLE of those the driver waits for
+    uint32_t        cal_us;                 // Time spent calibrating: measured, CC11xx_CAL_US or their mean for the others
+} radio_stats_t;
+
+/* Frames queued by the application (producer) and sent by the driver (consumer) */
+typedef struct radio_tx_queue_s
+{
+    radio_tx_frame_t frame[CC11xx_TX_QUEUE_DEPTH];
+    uint8_t         status[CC11xx_TX_QUEUE_DEPTH]; // Completion status by ticket
+    uint32_t        head;                   // Frames enqueued, also the ticket of the next frame
+    uint32_t        tail;                   // Frames completed
+    uint32_t        next_cca;               // CC11xx_TIMESTAMP() of the next clear channel assessment
+    uint8_t         cca_count;              // Assessments done for the frame at tail
+    uint8_t         be;                     // Backoff exponent for the frame at tail
+    uint8_t         backoff;                // Backoff timer running (CC11xx_TIMER_START)
+    uint32_t        slot_us;                // Slot time in use
+    uint32_t        prng;                   // Backoff generator state (xorshift32), seeded by enable_isr_routine()
+    radio_csma_parms_t csma;
+    radio_csma_stats_t csma_stats;
+    uint8_t         on_air;                 // Frame at tail has been handed to the chip
+    uint8_t         chained;                // ... with TXOFF_MODE=TX, the next frame follows it
+    uint32_t        burst_airtime_us;       // Airtime of the burst so far
+    radio_tx_callback_t callback;
+} radio_tx_queue_t;
+
+/* Handle of one radio: SPI backend, interrupt state and queues. One per chip, zero initialized and
+ * set up by enable_isr_routine(); the GDO and backoff timer interrupts of the chip call the ISRs
+ * below with it. */
 typedef volatile struct radio_int_data_s 
 {
-    spi_parms_t     *spi_parms;
+    spi_parms_t     *spi_parms;             // Points to spi
+    spi_parms_t     spi;                    // Own copy of the caller's spi_parms: transfer buffers, backend, shadow
     radio_parms_t   *radio_parms;
     radio_mode_t    mode;                   // Radio mode (essentially Rx or Tx)
     uint32_t        packet_rx_count;        // Number of packets received since put into action
     uint32_t        packet_tx_count;        // Number of packets sent since put into action
-    uint8_t         tx_buf[CC11xx_PACKET_COUNT_SIZE]; // Tx buffer
-    uint8_t         tx_count;               // Number of bytes in Tx buffer
-    uint8_t         rx_buf[CC11xx_PACKET_COUNT_SIZE]; // Rx buffer
-    uint8_t         rx_count;               // Number of bytes in Rx buffer
-    uint8_t         bytes_remaining;        // Bytes remaining to be read from or written to buffer (composite mode)
-    uint8_t         byte_index;             // Current byte index in buffer
+    radio_stats_t   stats;                  // Written by the driver under stats_seq
+    uint32_t        stats_seq;              // Odd while stats are being written
+    uint8_t         stats_depth;            // Nesting of the writers (GDO, timer and SPI completion interrupts)
+    uint32_t        pkt_spi_mark;           // spi_parms transactions and bytes at the start of the packet
+    uint32_t        pkt_spi_bytes_mark;
+    uint8_t         tx_count;               // Number of bytes in the packet in transmission
+    radio_rx_ring_t rx_ring;                // Received packets waiting for the application
+    radio_rx_slot_t *rx_slot;               // Slot being filled by the packet in reception
+    radio_tx_queue_t tx_queue;              // Frames waiting for transmission
+    radio_cal_cache_t cal;                  // Calibrated channels for radio_hop()
+    uint32_t        turnaround_us;          // Time the chip waits in FSTXON for a reply, 0 when off
+    uint8_t         turnaround_hold;        // Chip waiting in FSTXON after a received packet ...
+    uint32_t        turnaround_until;       // ... until this CC11xx_TIMESTAMP() when there is no timer
+    uint32_t        rx_end_cycles;          // CC11xx_CYCLES() at the end of the last received packet
+    uint32_t        cal_next;               // CC11xx_TIMESTAMP() of the next RADIO_CAL_PERIODIC calibration
+    int16_t         cal_temp;               // Temperature given to radio_cal_temperature() ...
+    int16_t         cal_temp_ref;           // ... and at the last calibration
+    uint8_t         cal_temp_valid;
+    uint8_t         *rx_ptr;                // Buffer the packet in reception goes to, NULL to discard it
+    uint8_t         rx_length_pending;      // Header bytes (packet or stream length) not read from the FIFO yet
+    uint16_t        rx_header;              // Header bytes read so far
+    const uint8_t   *tx_ptr;                // Buffer the packet in transmission comes from
+    uint8_t         *stream_rx_buf;         // Application buffer for received streams
+    uint32_t        stream_rx_size;         // Size of stream_rx_buf
+    uint32_t        stream_length;          // Length of the stream in reception
+    uint8_t         stream_fixed;           // Switched to fixed length for the end of the stream
+    uint8_t         stream_pktctrl0;        // Queued register writes (CC_SPISubmitReg()): PKTCTRL0 of that switch, ...
+    uint8_t         rx_pktlen;              // ... PKTLEN of the stream in reception, ...
+    uint8_t         restart_pktctrl0;       // ... PKTCTRL0 and MCSM1 of the way back to RX, see rx_restart()
+    uint8_t         restart_mcsm1;
+    radio_stream_callback_t stream_callback;
+    uint32_t        bytes_remaining;        // Bytes remaining to be read from or written to buffer (composite mode)
+    uint32_t        byte_index;             // Current byte index in buffer
     uint8_t         packet_receive;         // Indicates reception of a packet is in progress
     uint8_t         packet_send;            // Indicates transmission of a packet is in progress
+    uint8_t         rx_unloading;           // A FIFO unload is queued on the SPI engine
+    uint8_t         rx_unload_left;         // Bytes of that unload not submitted yet
+    uint8_t         rx_header_count;        // Header bytes being read
+    uint8_t         rx_header_bytes[2];
+    uint8_t         rx_eop_pending;         // End of packet seen during the unload
+    uint8_t         rx_status;              // RXBYTES and LQI read at the end of packet
+    uint8_t         rx_rssi;                // RSSI read along with LQI
+    uint8_t         fifo_level;             // RXBYTES or TXBYTES read by the FIFO threshold interrupt
+    void            (*rx_unload_next)(volatile struct radio_int_data_s *radio);
+    radio_rx_slot_t rx_drop_slot;           // Receives packets when the ring is full
+    uint8_t         rx_aux[CC11xx_FIFO_SIZE]; // Bytes read from the RX FIFO and dropped
+    float           last_rssi;              // Of the last packet received (dBm)
+    uint8_t         last_lqi;               // Of the last packet or stream received
+    uint8_t         id;                     // Order of the first enable_isr_routine(), tags trace entries
+    bool            init;                   // Set up by enable_isr_routine(), the ISRs return until then
 } radio_int_data_t;
 
 
@@ -261,18 +659,36 @@ int     CC_SPIReadBurstReg(spi_parms_t *spi_parms, uint8_t addr, uint8_t *bytes,
 int     CC_SPIReadStatus(spi_parms_t *spi_parms, uint8_t addr, uint8_t *status);
 int     CC_SPIStrobe(spi_parms_t *spi_parms, uint8_t strobe);
 int     CC_PowerupResetCCxxxx(spi_parms_t *spi_parms);
-int     CC11xx_GDO2(void);
-int     CC11xx_GDO0(void);
-void    disable_IT(void);
-void    enable_IT(void);
+void    CC_SPIInvalidateShadow(spi_parms_t *spi_parms);
+int     CC_SPISubmit(spi_parms_t *spi_parms, uint8_t cmd, const uint8_t *tx, uint8_t *rx, uint8_t len, cc11xx_spi_done_t done, void *ctx);
+int     CC_SPISubmitReg(spi_parms_t *spi_parms, uint8_t addr, const uint8_t *byte, cc11xx_spi_done_t done, void *ctx);
+void    CC_SPIAsyncComplete(void *spi_parms);
+void    CC_SPIAsyncWait(spi_parms_t *spi_parms);
+void    CC_BatchInit(cc11xx_batch_t *batch, spi_parms_t *spi_parms);
+void    CC_BatchStrobe(cc11xx_batch_t *batch, uint8_t strobe);
+void    CC_BatchWriteReg(cc11xx_batch_t *batch, uint8_t addr, uint8_t byte);
+void    CC_BatchWriteBurst(cc11xx_batch_t *batch, uint8_t addr, const uint8_t *bytes, uint8_t count);
+void    CC_BatchReadReg(cc11xx_batch_t *batch, uint8_t addr, uint8_t *byte);
+void    CC_BatchReadStatus(cc11xx_batch_t *batch, uint8_t addr, uint8_t *status);
+void    CC_BatchReadBurst(cc11xx_batch_t *batch, uint8_t addr, uint8_t *bytes, uint8_t count);
+int     CC_BatchRun(cc11xx_batch_t *batch);
+void    disable_IT(radio_int_data_t *radio);
+void    enable_IT(radio_int_data_t *radio);
 
 int set_freq_parameters(float freq_hz, float freq_if, float freq_off, radio_parms_t * radio_parms);
 int set_sync_parameters(preamble_t preamble, sync_word_t sync_word, uint32_t timeout_ms, radio_parms_t * radio_parms);
 int set_packet_parameters(uint8_t packet_length, bool fec, bool white, radio_parms_t * radio_parms);
+int set_packet_length_mode(packet_length_t length_mode, radio_parms_t * radio_parms);
+int set_fifo_threshold(uint8_t fifo_thr, radio_parms_t * radio_parms);
 int set_modulation_parameters(radio_modulation_t mod, rate_t data_rate, float mod_index, radio_parms_t * radio_parms);
+int set_rate_parameters(radio_modulation_t mod, uint32_t baud, uint32_t deviation_hz, uint32_t ppm, radio_parms_t * radio_parms, radio_rate_fit_t *fit);
+int set_channel_plan(float base_hz, uint32_t spacing_hz, uint16_t count, radio_parms_t * radio_parms);
+int set_cal_policy(radio_cal_policy_t policy, uint32_t period_ms, uint8_t temp_delta, radio_parms_t * radio_parms);
 
 
 int init_radio_config(spi_parms_t * spi_parms, radio_parms_t * radio_parms);
+void radio_build_config(radio_parms_t * radio_parms, uint8_t image[CC11xx_NUM_CONFIG_REGS]);
+int radio_read_config(spi_parms_t * spi_parms, uint8_t image[CC11xx_NUM_CONFIG_REGS]);
 
 float       rssi_dbm(uint8_t rssi_dec);
 
@@ -281,30 +697,70 @@ uint32_t    get_if_word(uint32_t freq_xtal, uint32_t if_hz);
 uint8_t 		get_offset_word(uint32_t freq_xtal, uint32_t offset_hz);
 
 void        get_chanbw_words(float bw, radio_parms_t *radio_parms);
-void        get_rate_words(rate_t data_rate, float mod_index, radio_parms_t *radio_parms);
+void        get_rate_words(rate_t data_rate, uint32_t mod_index_q16, radio_parms_t *radio_parms);
+int         radio_solve_rate(uint32_t f_xtal, uint32_t freq_hz, uint32_t baud, uint32_t deviation_hz, uint32_t ppm, radio_rate_fit_t *fit);
 
 void        wait_for_state(spi_parms_t *spi_parms, CC11xx_state_t state, uint32_t timeout);
+CC11xx_status_state_t CC_SPIChipState(spi_parms_t *spi_parms);
+int         CC_SPIRefreshStatus(spi_parms_t *spi_parms);
 
 void        radio_turn_idle(spi_parms_t *spi_parms);
 /* Those 2 functions used for putting CC1101 in RX mode */
-void        radio_turn_rx_isr(spi_parms_t *spi_parms);
+void        radio_turn_rx_isr(radio_int_data_t *radio);
 void        radio_turn_rx(spi_parms_t *spi_parms);
-void        radio_init_rx(spi_parms_t *spi_parms, radio_parms_t * radio_parms);
+void        radio_init_rx(radio_int_data_t *radio);
 
 void        radio_flush_fifos(spi_parms_t *spi_parms);
 
 int         radio_set_packet_length(spi_parms_t *spi_parms, uint8_t pkt_len);
+int         radio_cal_channel(radio_int_data_t *radio, float freq_hz);
+int         radio_cal_plan(radio_int_data_t *radio);
+int         radio_hop(radio_int_data_t *radio, float freq_hz, uint32_t *hop_us);
+int         radio_set_channel(radio_int_data_t *radio, uint8_t channel, uint32_t *hop_us);
+void        radio_cal_clear(radio_int_data_t *radio);
+void        radio_cal_temperature(radio_int_data_t *radio, int16_t temp_c);
+uint32_t    radio_scan_settle_us(const radio_parms_t *radio_parms);
+int         radio_scan_start(radio_int_data_t *radio, radio_scan_t *scan, const uint8_t *channels, uint16_t count, uint8_t *rssi);
+int         radio_scan_sweep(radio_int_data_t *radio, radio_scan_t *scan);
+void        radio_scan_stop(radio_int_data_t *radio);
+void        radio_scan_dbm(const radio_scan_t *scan, float *dbm);
 
 uint8_t     radio_get_packet_length(spi_parms_t *spi_parms);    
 float       radio_get_rate(radio_parms_t *radio_parms);
 
-/* Used to send a packet with CCA */
-void        radio_send_packet(spi_parms_t *spi_parms, radio_parms_t * radio_parms, uint8_t *packet, uint8_t size);
+/* Used to send a packet with CCA: queues the frame and returns, 1 if the queue is full */
+int         radio_send_packet(radio_int_data_t *radio, uint8_t *packet, uint8_t size);
+int         radio_tx_enqueue(radio_int_data_t *radio, const uint8_t *packet, uint8_t size, uint32_t *ticket);
+radio_tx_status_t radio_tx_status(radio_int_data_t *radio, uint32_t ticket);
+void        radio_tx_set_callback(radio_int_data_t *radio, radio_tx_callback_t callback);
+void        radio_tx_process(radio_int_data_t *radio);
+int         radio_turnaround_config(radio_int_data_t *radio, uint32_t hold_us);
+int         radio_csma_config(radio_int_data_t *radio, const radio_csma_parms_t *parms);
+void        radio_csma_stats(radio_int_data_t *radio, radio_csma_stats_t *stats);
+void        radio_csma_timer_isr(radio_int_data_t *radio);
+void        radio_get_stats(radio_int_data_t *radio, radio_stats_t *stats);
+#ifdef CC11xx_TRACE
+extern radio_trace_t radio_trace;
+void        radio_trace_clear(void);
+#endif
+void        radio_reset_stats(radio_int_data_t *radio);
+
+/* Streams over the infinite packet length mode: data must stay valid until completion */
+int         radio_send_stream(radio_int_data_t *radio, const uint8_t *data, uint32_t length, uint32_t *ticket);
+void        radio_stream_rx_buffer(radio_int_data_t *radio, uint8_t *buffer, uint32_t size, radio_stream_callback_t callback);
+
+void        enable_isr_routine(radio_int_data_t *radio, spi_parms_t *spi_parms, radio_parms_t * radio_parms);
 
-void        enable_isr_routine(spi_parms_t *spi_parms, radio_parms_t * radio_parms);
+/* Received packets: peek/release for zero copy access or radio_receive_packet to copy out */
+uint32_t    radio_rx_available(radio_int_data_t *radio);
+radio_rx_slot_t *radio_rx_peek(radio_int_data_t *radio);
+void        radio_rx_release(radio_int_data_t *radio);
+int         radio_receive_packet(radio_int_data_t *radio, uint8_t *packet, uint8_t *size, radio_rx_slot_t *info);
+uint32_t    radio_rx_overruns(radio_int_data_t *radio);
 
-void				gdo0_isr(void);
-void				gdo2_isr(void);
+/* Interrupt handlers of the radio's GDO0 and GDO2 lines */
+void				gdo0_isr(radio_int_data_t *radio);
+void				gdo2_isr(radio_int_data_t *radio);
 
 #endif
 
@@ -0,0 +1,1472 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_sim.h"
+
+/* Chip status byte STATE[2:0] values */
+#define SIM_STATUS_IDLE        0
+#define SIM_STATUS_RX          1
+#define SIM_STATUS_TX          2
+#define SIM_STATUS_FSTXON      3
+#define SIM_STATUS_CALIBRATE   4
+#define SIM_STATUS_SETTLING    5
+#define SIM_STATUS_RX_OVERFLOW 6
+#define SIM_STATUS_TX_UNDERFLOW 7
+
+/* Emitter phases: what is on air for the current byte */
+#define EMIT_OFF      0
+#define EMIT_PREAMBLE 1
+#define EMIT_SYNC     2
+#define EMIT_DATA     3
+#define EMIT_CRC      4
+
+#define SIM_SPI_MAX   256 // Header byte plus the longest burst
+
+/* A transmission on air, either from a simulated chip in TX or from an injected frame */
+typedef struct sim_emitter_s
+{
+    uint8_t       phase;
+    uint32_t      left;         // Bytes left in the preamble, sync or CRC phase
+    uint64_t      next_ns;      // Time the current byte is completely on air
+    uint64_t      byte_ns;
+    double        freq_hz;      // Negative when the synthesizer is not locked
+    float         rssi_dbm;
+    bool          crc_ok;
+    uint32_t      count;        // Data bytes sent so far
+    uint8_t       first;        // First data byte (length byte in variable length mode)
+    cc1101_sim_t *src;          // Transmitting chip or NULL for injected frames
+} sim_emitter_t;
+
+typedef struct sim_inject_s
+{
+    bool          used;
+    bool          crc_en;
+    sim_emitter_t em;
+    uint8_t       data[CC11xx_SIM_FRAME_MAX];
+    uint32_t      len;
+} sim_inject_t;
+
+struct cc1101_sim_s
+{
+    bool          used;
+    uint8_t       regs[CC11xx_SIM_NUM_REGS];
+    uint8_t       patable[8];
+    uint8_t       rxfifo[CC11xx_FIFO_SIZE];
+    uint8_t       rx_rd, rx_n;
+    uint8_t       txfifo[CC11xx_FIFO_SIZE];
+    uint8_t       tx_rd, tx_n;
+    uint8_t       marcstate;
+    bool          transition;       // A timed state transition is in progress
+    bool          transition_cal;   // ... and calibrates the synthesizer when it completes
+    uint8_t       next_state;
+    uint64_t      transition_ns;
+    double        cal_freq_hz;      // Frequency the synthesizer is calibrated for
+    uint8_t       autocal_count;    // For FS_AUTOCAL every 4th time
+    uint8_t       lqi;
+    uint8_t       rssi;
+    bool          sync_flag;        // Sync word sent/received, packet in progress
+    bool          crc_flag;         // CRC of the last received packet
+    bool          sleeping;
+    sim_emitter_t tx;
+    sim_emitter_t *rx_src;          // Emitter the receiver is locked on
+    uint32_t      rx_count;
+    uint8_t       rx_first;
+    uint8_t       rx_crc_left;
+    bool          rx_payload_done;
+    uint8_t       gdo0, gdo2;
+    bool          gdo0_pending, gdo2_pending;
+    cc1101_sim_isr_t gdo0_isr, gdo2_isr, timer_isr;
+    void         *isr_ctx;
+    bool          it_disabled;      // GDO and timer interrupts of this chip masked
+    struct {                        // One shot timer, see cc1101_sim_timer_start
+        bool            armed;
+        bool            pending;
+        uint64_t        due_ns;
+    } timer;
+    struct {                        // SPI transfer started by cc1101_sim_spi_start
+        bool            active;
+        bool            pending;    // Done, completion interrupt not delivered yet
+        uint64_t        due_ns;
+        uint8_t         data[SIM_SPI_MAX];
+        uint8_t        *status;
+        uint8_t        *rx;
+        uint8_t         len;
+        cc1101_sim_spi_done_t done;
+        void           *ctx;
+    } dma;
+    cc1101_sim_tx_sink_t sink;
+    void         *sink_ctx;
+    uint8_t       frame[CC11xx_SIM_FRAME_MAX];
+    uint32_t      frame_len;
+    cc1101_sim_stats_t stats;
+};
+
+static struct
+{
+    cc1101_sim_config_t cfg;
+    uint64_t            now;
+    cc1101_sim_t        inst[CC11xx_SIM_MAX_INSTANCES];
+    sim_inject_t        inject[CC11xx_SIM_MAX_INJECT];
+    cc1101_sim_t       *current;
+    bool                in_isr;
+    bool                in_spi_isr;     // In an SPI completion callback
+} world;
+
+/* Register values after reset (SWRS061) */
+static const uint8_t reset_regs[CC11xx_SIM_NUM_REGS] = {
+    0x29, 0x2E, 0x3F, 0x07, 0xD3, 0x91, 0xFF, 0x04, 0x45, 0x00, 0x00, 0x0F, 0x00, 0x1E, 0xC4, 0xEC,
+    0x8C, 0x22, 0x02, 0x22, 0xF8, 0x47, 0x07, 0x30, 0x04, 0x36, 0x6C, 0x03, 0x40, 0x91, 0x87, 0x6B,
+    0xF8, 0x56, 0x10, 0xA9, 0x0A, 0x20, 0x0D, 0x41, 0x00, 0x59, 0x7F, 0x3F, 0x88, 0x31, 0x0B
+};
+
+static const uint8_t preamble_bytes[8] = {2, 3, 4, 6, 8, 12, 16, 24};
+
+static void sim_advance(uint64_t until, bool dispatch);
+static void sim_goto(cc1101_sim_t *s, uint8_t target);
+static void sim_auto_idle(cc1101_sim_t *s);
+static void sim_update_gdo(cc1101_sim_t *s);
+
+static void sim_radio_gdo0(void *ctx)
+{
+    gdo0_isr((radio_int_data_t *) ctx);
+}
+
+static void sim_radio_gdo2(void *ctx)
+{
+    gdo2_isr((radio_int_data_t *) ctx);
+}
+
+static void sim_radio_timer(void *ctx)
+{
+    radio_csma_timer_isr((radio_int_data_t *) ctx);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Derived radio parameters
+// ------------------------------------------------------------------------------------------------
+static double sim_freq_hz(cc1101_sim_t *s)
+{
+    double fstep = (double) world.cfg.f_xtal / 65536.0;
+    uint32_t freq_word = ((uint32_t) s->regs[CC11xx_FREQ2] << 16) | ((uint32_t) s->regs[CC11xx_FREQ1] << 8) | s->regs[CC11xx_FREQ0];
+    double chanspc = (256.0 + s->regs[CC11xx_MDMCFG0]) * (1 << (s->regs[CC11xx_MDMCFG1] & 0x03)) / 4.0;
+
+    return fstep * ((double) freq_word + s->regs[CC11xx_CHANNR] * chanspc);
+}
+
+static double sim_rate(cc1101_sim_t *s)
+{
+    uint8_t drate_e = s->regs[CC11xx_MDMCFG4] & 0x0F;
+    uint8_t drate_m = s->regs[CC11xx_MDMCFG3];
+
+    return ((double) world.cfg.f_xtal / (1 << 28)) * (256 + drate_m) * (1 << drate_e);
+}
+
+static double sim_bandwidth(cc1101_sim_t *s)
+{
+    uint8_t chanbw_e = (s->regs[CC11xx_MDMCFG4] >> 6) & 0x03;
+    uint8_t chanbw_m = (s->regs[CC11xx_MDMCFG4] >> 4) & 0x03;
+
+    return (double) world.cfg.f_xtal / (8.0 * (4 + chanbw_m) * (1 << chanbw_e));
+}
+
+static uint64_t sim_byte_ns(cc1101_sim_t *s)
+{
+    double ns = 8.0e9 / sim_rate(s);
+
+    if ((s->regs[CC11xx_MDMCFG1] & 0x80) || (s->regs[CC11xx_MDMCFG2] & 0x08)){
+        ns *= 2.0; // FEC or Manchester coding doubles the air time
+    }
+    return (uint64_t) ns;
+}
+
+static uint8_t sim_rx_threshold(cc1101_sim_t *s)
+{
+    return 4 * ((s->regs[CC11xx_FIFOTHR] & 0x0F) + 1);
+}
+
+static uint8_t sim_tx_threshold(cc1101_sim_t *s)
+{
+    return CC11xx_FIFO_SIZE + 1 - sim_rx_threshold(s);
+}
+
+static uint8_t sim_sync_bytes(cc1101_sim_t *s)
+{
+    return ((s->regs[CC11xx_MDMCFG2] & 0x03) == 0x03) ? 4 : 2; // 30/32 modes send the sync word twice
+}
+
+// |a - b| < limit, without libm like the driver
+static bool sim_within(double a, double b, double limit)
+{
+    return ((a - b) < limit) && ((b - a) < limit);
+}
+
+static bool sim_locked(cc1101_sim_t *s)
+{
+    return sim_within(sim_freq_hz(s), s->cal_freq_hz, 1.0e6);
+}
+
+static uint8_t sim_rssi_raw(float dbm)
+{
+    float half_db = (dbm + 74.0f) * 2.0f;
+    int raw = (int) (half_db + ((half_db < 0.0f) ? -0.5f : 0.5f)); // Rounded
+
+    if (raw > 127) raw = 127;
+    if (raw < -128) raw = -128;
+    return (uint8_t) (int8_t) raw;
+}
+
+static bool sim_same_channel(cc1101_sim_t *rx, sim_emitter_t *em)
+{
+    if (em->freq_hz < 0.0){
+        return false;
+    }
+    return sim_within(em->freq_hz, sim_freq_hz(rx), sim_bandwidth(rx) / 2.0);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Channel assessment as seen by a receiver
+// ------------------------------------------------------------------------------------------------
+static float sim_channel_dbm(cc1101_sim_t *s)
+{
+    float dbm = world.cfg.noise_dbm;
+    int i;
+
+    for (i = 0; i < CC11xx_SIM_MAX_INSTANCES; i++){
+        cc1101_sim_t *o = &world.inst[i];
+        if (o->used && o != s && o->tx.phase != EMIT_OFF && sim_same_channel(s, &o->tx) && o->tx.rssi_dbm > dbm){
+            dbm = o->tx.rssi_dbm;
+        }
+    }
+    for (i = 0; i < CC11xx_SIM_MAX_INJECT; i++){
+        sim_inject_t *in = &world.inject[i];
+        if (in->used && in->em.phase != EMIT_OFF && sim_same_channel(s, &in->em) && in->em.rssi_dbm > dbm){
+            dbm = in->em.rssi_dbm;
+        }
+    }
+    return dbm;
+}
+
+static bool sim_carrier_sense(cc1101_sim_t *s)
+{
+    return sim_channel_dbm(s) > world.cfg.cs_threshold_dbm;
+}
+
+static bool sim_cca(cc1101_sim_t *s)
+{
+    switch ((s->regs[CC11xx_MCSM1] >> 4) & 0x03){
+        case 0:  return true;
+        case 1:  return !sim_carrier_sense(s);
+        case 2:  return s->rx_src == NULL;
+        default: return !sim_carrier_sense(s) && s->rx_src == NULL;
+    }
+}
+
+static uint8_t sim_status_state(cc1101_sim_t *s)
+{
+    switch (s->marcstate){
+        case CC11xx_STATE_IDLE:
+        case CC11xx_STATE_SLEEP:
+        case CC11xx_STATE_XOFF:
+            return SIM_STATUS_IDLE;
+        case CC11xx_STATE_RX:
+        case CC11xx_STATE_RX_END:
+        case CC11xx_STATE_RX_RST:
+            return SIM_STATUS_RX;
+        case CC11xx_STATE_TX:
+        case CC11xx_STATE_TX_END:
+            return SIM_STATUS_TX;
+        case CC11xx_STATE_FSTXON:
+            return SIM_STATUS_FSTXON;
+        case CC11xx_STATE_MANCAL:
+        case CC11xx_STATE_STARTCAL:
+        case CC11xx_STATE_ENDCAL:
+            return SIM_STATUS_CALIBRATE;
+        case CC11xx_STATE_RXFIFO_OVERFLOW:
+            return SIM_STATUS_RX_OVERFLOW;
+        case CC11xx_STATE_TXFIFO_UNDERFLOW:
+            return SIM_STATUS_TX_UNDERFLOW;
+        default:
+            return SIM_STATUS_SETTLING;
+    }
+}
+
+static uint8_t sim_status_byte(cc1101_sim_t *s, bool read)
+{
+    uint8_t fifo = read ? s->rx_n : (uint8_t) (CC11xx_FIFO_SIZE - s->tx_n);
+
+    if (fifo > 15){
+        fifo = 15;
+    }
+    return (sim_status_state(s) << 4) | fifo;
+}
+
+// ------------------------------------------------------------------------------------------------
+// GDO outputs (IOCFGx.GDOx_CFG), only the signals the driver can make use of
+// ------------------------------------------------------------------------------------------------
+static uint8_t sim_gdo_signal(cc1101_sim_t *s, uint8_t cfg)
+{
+    uint8_t v;
+
+    switch (cfg & 0x3F){
+        case 0x00: v = s->rx_n >= sim_rx_threshold(s); break;
+        case 0x01: v = (s->rx_n >= sim_rx_threshold(s)) || (s->rx_payload_done && s->rx_n > 0); break;
+        case 0x02: v = s->tx_n >= sim_tx_threshold(s); break;
+        case 0x03: v = s->tx_n >= CC11xx_FIFO_SIZE; break;
+        case 0x04: v = s->marcstate == CC11xx_STATE_RXFIFO_OVERFLOW; break;
+        case 0x05: v = s->marcstate == CC11xx_STATE_TXFIFO_UNDERFLOW; break;
+        case 0x06: v = s->sync_flag; break;
+        case 0x07: v = s->crc_flag && s->rx_n > 0; break;
+        case 0x09: v = sim_cca(s); break;
+        case 0x0E: v = sim_carrier_sense(s); break;
+        default:   v = 0; break;
+    }
+    if (cfg & 0x40){
+        v = !v;
+    }
+    return v;
+}
+
+static void sim_update_gdo(cc1101_sim_t *s)
+{
+    uint8_t level;
+
+    level = sim_gdo_signal(s, s->regs[CC11xx_IOCFG0]);
+    if (level != s->gdo0){
+        s->gdo0 = level;
+        s->gdo0_pending = true;
+        s->stats.gdo0_edges++;
+    }
+    level = sim_gdo_signal(s, s->regs[CC11xx_IOCFG2]);
+    if (level != s->gdo2){
+        s->gdo2 = level;
+        s->gdo2_pending = true;
+        s->stats.gdo2_edges++;
+    }
+}
+
+static void sim_update_all_gdo(void)
+{
+    int i;
+
+    for (i = 0; i < CC11xx_SIM_MAX_INSTANCES; i++){
+        if (world.inst[i].used){
+            sim_update_gdo(&world.inst[i]);
+        }
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Synthesizer calibration: FSCAL3..1 encode the 1 MHz bucket the synthesizer is calibrated for,
+// so restoring saved FSCAL values restores the lock for that frequency.
+// ------------------------------------------------------------------------------------------------
+static void sim_calibrate(cc1101_sim_t *s)
+{
+    double freq = sim_freq_hz(s);
+    uint32_t bucket = (uint32_t) (freq / 1.0e6);
+
+    s->cal_freq_hz = freq;
+    s->regs[CC11xx_FSCAL3] = (s->regs[CC11xx_FSCAL3] & 0xF0) | 0x09;
+    s->regs[CC11xx_FSCAL2] = (s->regs[CC11xx_FSCAL2] & 0xE0) | ((bucket >> 6) & 0x1F);
+    s->regs[CC11xx_FSCAL1] = bucket & 0x3F;
+    s->stats.calibrations++;
+}
+
+static void sim_fscal_written(cc1101_sim_t *s)
+{
+    uint32_t bucket = ((uint32_t) (s->regs[CC11xx_FSCAL2] & 0x1F) << 6) | (s->regs[CC11xx_FSCAL1] & 0x3F);
+
+    s->cal_freq_hz = (bucket + 0.5) * 1.0e6;
+}
+
+// ------------------------------------------------------------------------------------------------
+// FIFOs
+// ------------------------------------------------------------------------------------------------
+static void sim_flush_rx(cc1101_sim_t *s)
+{
+    s->rx_rd = 0;
+    s->rx_n = 0;
+    s->rx_payload_done = false;
+}
+
+static void sim_flush_tx(cc1101_sim_t *s)
+{
+    s->tx_rd = 0;
+    s->tx_n = 0;
+}
+
+static bool sim_rx_push(cc1101_sim_t *s, uint8_t byte)
+{
+    if (s->rx_n >= CC11xx_FIFO_SIZE){
+        return false;
+    }
+    s->rxfifo[(s->rx_rd + s->rx_n) % CC11xx_FIFO_SIZE] = byte;
+    s->rx_n++;
+    return true;
+}
+
+static uint8_t sim_rx_pop(cc1101_sim_t *s)
+{
+    uint8_t byte;
+
+    if (s->rx_n == 0){
+        return 0;
+    }
+    byte = s->rxfifo[s->rx_rd];
+    s->rx_rd = (s->rx_rd + 1) % CC11xx_FIFO_SIZE;
+    s->rx_n--;
+    return byte;
+}
+
+static void sim_tx_push(cc1101_sim_t *s, uint8_t byte)
+{
+    if (s->tx_n >= CC11xx_FIFO_SIZE){
+        return; // TX FIFO overflow: byte is lost
+    }
+    s->txfifo[(s->tx_rd + s->tx_n) % CC11xx_FIFO_SIZE] = byte;
+    s->tx_n++;
+}
+
+static uint8_t sim_tx_pop(cc1101_sim_t *s)
+{
+    uint8_t byte = s->txfifo[s->tx_rd];
+
+    s->tx_rd = (s->tx_rd + 1) % CC11xx_FIFO_SIZE;
+    s->tx_n--;
+    return byte;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Packet length handling shared by the transmitter and the receiver
+// ------------------------------------------------------------------------------------------------
+static bool sim_packet_complete(cc1101_sim_t *s, uint32_t count, uint8_t first)
+{
+    switch (s->regs[CC11xx_PKTCTRL0] & 0x03){
+        case 0:  return count > 0 && (count & 0xFF) == s->regs[CC11xx_PKTLEN];
+        case 1:  return count == (uint32_t) first + 1;
+        default: return false; // Infinite: runs until switched to fixed length
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Receiver side
+// ------------------------------------------------------------------------------------------------
+static void sim_rx_finish(cc1101_sim_t *s, bool crc_ok)
+{
+    uint8_t rxoff;
+
+    if (!(s->regs[CC11xx_PKTCTRL0] & 0x04)){
+        crc_ok = true; // CRC_OK is only meaningful with CRC enabled
+    }
+    s->lqi = (crc_ok ? CC11xx_CRC_OK : 0) | 0x10;
+    s->crc_flag = crc_ok;
+    if (s->regs[CC11xx_PKTCTRL1] & 0x04){ // APPEND_STATUS
+        sim_rx_push(s, s->rssi);
+        sim_rx_push(s, s->lqi);
+    }
+    s->rx_src = NULL;
+    s->sync_flag = false;
+    s->rx_payload_done = true;
+    s->stats.frames_received++;
+    if (!crc_ok && (s->regs[CC11xx_PKTCTRL1] & 0x08)){ // CRC_AUTOFLUSH
+        sim_flush_rx(s);
+    }
+
+    rxoff = (s->regs[CC11xx_MCSM1] >> 2) & 0x03;
+    switch (rxoff){
+        case 0: sim_auto_idle(s);                 break;
+        case 1: sim_goto(s, CC11xx_STATE_FSTXON); break;
+        case 2: sim_goto(s, CC11xx_STATE_TX);     break;
+        default:
+            s->rx_count = 0; // Stay in RX for the next packet
+            break;
+    }
+}
+
+static void sim_rx_overflow(cc1101_sim_t *s)
+{
+    s->marcstate = CC11xx_STATE_RXFIFO_OVERFLOW;
+    s->rx_src = NULL;
+    s->sync_flag = false;
+    s->stats.rx_overflows++;
+}
+
+static void sim_air_sync(sim_emitter_t *em)
+{
+    int i;
+
+    for (i = 0; i < CC11xx_SIM_MAX_INSTANCES; i++){
+        cc1101_sim_t *r = &world.inst[i];
+        if (!r->used || r == em->src || r->marcstate != CC11xx_STATE_RX || r->transition || r->rx_src){
+            continue;
+        }
+        if (!sim_locked(r) || !sim_same_channel(r, em)){
+            continue;
+        }
+        r->rx_src = em;
+        r->rx_count = 0;
+        r->rx_payload_done = false;
+        r->rx_crc_left = (r->regs[CC11xx_PKTCTRL0] & 0x04) ? 2 : 0;
+        r->sync_flag = true;
+        r->rssi = sim_rssi_raw(em->rssi_dbm);
+        sim_update_gdo(r);
+    }
+}
+
+static void sim_air_byte(sim_emitter_t *em, uint8_t byte, bool crc)
+{
+    int i;
+
+    for (i = 0; i < CC11xx_SIM_MAX_INSTANCES; i++){
+        cc1101_sim_t *r = &world.inst[i];
+        if (!r->used || r->rx_src != em){
+            continue;
+        }
+        if (r->rx_payload_done){
+            if (crc && r->rx_crc_left && --r->rx_crc_left == 0){
+                sim_rx_finish(r, em->crc_ok);
+            }
+        }else if (!crc){
+            if (!sim_rx_push(r, byte)){
+                sim_rx_overflow(r);
+            }else{
+                if (r->rx_count == 0){
+                    r->rx_first = byte;
+                }
+                r->rx_count++;
+                if (sim_packet_complete(r, r->rx_count, r->rx_first)){
+                    r->rx_payload_done = true;
+                    if (r->rx_crc_left == 0){
+                        sim_rx_finish(r, true);
+                    }
+                }
+            }
+        }
+        sim_update_gdo(r);
+    }
+}
+
+static void sim_air_end(sim_emitter_t *em)
+{
+    int i;
+
+    for (i = 0; i < CC11xx_SIM_MAX_INSTANCES; i++){
+        cc1101_sim_t *r = &world.inst[i];
+        if (r->used && r->rx_src == em){
+            sim_rx_finish(r, false); // Transmitter went away before the receiver saw a complete packet
+            sim_update_gdo(r);
+        }
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Transmitter side
+// ------------------------------------------------------------------------------------------------
+static void sim_tx_start(cc1101_sim_t *s, uint32_t preamble)
+{
+    s->tx.phase = EMIT_PREAMBLE;
+    s->tx.left = preamble;
+    s->tx.byte_ns = sim_byte_ns(s);
+    s->tx.next_ns = world.now + s->tx.byte_ns;
+    s->tx.freq_hz = sim_locked(s) ? sim_freq_hz(s) : -1.0;
+    s->tx.rssi_dbm = world.cfg.link_rssi_dbm;
+    s->tx.crc_ok = true;
+    s->tx.count = 0;
+    s->tx.src = s;
+    s->frame_len = 0;
+}
+
+static void sim_tx_report(cc1101_sim_t *s, cc1101_sim_tx_status_t status)
+{
+    if (s->sink){
+        s->sink(s->sink_ctx, s->frame, s->frame_len, status);
+    }
+    s->frame_len = 0;
+}
+
+static void sim_tx_abort(cc1101_sim_t *s)
+{
+    if (s->tx.phase == EMIT_OFF){
+        return;
+    }
+    s->tx.phase = EMIT_OFF;
+    if (s->sync_flag){
+        s->sync_flag = false;
+        sim_air_end(&s->tx);
+        sim_tx_report(s, CC11xx_SIM_TX_ABORTED);
+    }
+}
+
+static void sim_tx_finish(cc1101_sim_t *s)
+{
+    uint8_t txoff = s->regs[CC11xx_MCSM1] & 0x03;
+
+    s->sync_flag = false;
+    s->tx.phase = EMIT_OFF;
+    s->stats.frames_sent++;
+    sim_air_end(&s->tx);
+    sim_tx_report(s, CC11xx_SIM_TX_OK);
+
+    switch (txoff){
+        case 0: sim_auto_idle(s);                 break;
+        case 1: sim_goto(s, CC11xx_STATE_FSTXON); break;
+        case 2: sim_tx_start(s, 1);               break; // Stay in TX sending preamble until the FIFO is fed
+        default: sim_goto(s, CC11xx_STATE_RX);    break;
+    }
+}
+
+static void sim_emit_step(sim_emitter_t *em, sim_inject_t *in)
+{
+    cc1101_sim_t *s = em->src;
+    uint8_t byte;
+    bool done;
+
+    em->next_ns += em->byte_ns;
+    switch (em->phase){
+        case EMIT_PREAMBLE:
+            if (--em->left > 0){
+                break;
+            }
+            if (s && s->tx_n == 0){
+                em->left = 1; // Keep sending preamble until data is written to the TX FIFO
+                break;
+            }
+            em->phase = EMIT_SYNC;
+            em->left = s ? sim_sync_bytes(s) : 2;
+            break;
+
+        case EMIT_SYNC:
+            if (--em->left > 0){
+                break;
+            }
+            em->phase = EMIT_DATA;
+            if (s){
+                s->sync_flag = true;
+                sim_update_gdo(s);
+            }
+            sim_air_sync(em);
+            break;
+
+        case EMIT_DATA:
+            if (s){
+                if (s->tx_n == 0){
+                    s->marcstate = CC11xx_STATE_TXFIFO_UNDERFLOW;
+                    s->sync_flag = false;
+                    em->phase = EMIT_OFF;
+                    s->stats.tx_underflows++;
+                    sim_air_end(em);
+                    sim_tx_report(s, CC11xx_SIM_TX_UNDERFLOW);
+                    return;
+                }
+                byte = sim_tx_pop(s);
+                if (s->frame_len < CC11xx_SIM_FRAME_MAX){
+                    s->frame[s->frame_len++] = byte;
+                }
+            }else{
+                byte = in->data[em->count];
+            }
+            if (em->count == 0){
+                em->first = byte;
+            }
+            em->count++;
+            sim_air_byte(em, byte, false);
+            done = s ? sim_packet_complete(s, em->count, em->first) : (em->count >= in->len);
+            if (done){
+                if (s ? (s->regs[CC11xx_PKTCTRL0] & 0x04) : in->crc_en){
+                    em->phase = EMIT_CRC;
+                    em->left = 2;
+                }else if (s){
+                    sim_tx_finish(s);
+                }else{
+                    em->phase = EMIT_OFF;
+                    sim_air_end(em);
+                    in->used = false;
+                }
+            }
+            break;
+
+        case EMIT_CRC:
+            sim_air_byte(em, 0, true);
+            if (--em->left > 0){
+                break;
+            }
+            if (s){
+                sim_tx_finish(s);
+            }else{
+                em->phase = EMIT_OFF;
+                sim_air_end(em);
+                in->used = false;
+            }
+            break;
+    }
+    if (s){
+        sim_update_gdo(s);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Main radio control state machine
+// ------------------------------------------------------------------------------------------------
+static void sim_enter(cc1101_sim_t *s, uint8_t state)
+{
+    s->marcstate = state;
+    s->transition = false;
+    if (state == CC11xx_STATE_TX){
+        sim_tx_start(s, preamble_bytes[(s->regs[CC11xx_MDMCFG1] >> 4) & 0x07]);
+    }else if (state == CC11xx_STATE_RX){
+        s->rx_src = NULL;
+        s->rx_count = 0;
+        s->rssi = sim_rssi_raw(sim_channel_dbm(s));
+    }
+}
+
+static void sim_schedule(cc1101_sim_t *s, uint8_t via, uint8_t target, uint64_t delay_ns, bool cal)
+{
+    s->marcstate = via;
+    s->next_state = target;
+    s->transition = true;
+    s->transition_cal = cal;
+    s->transition_ns = world.now + delay_ns;
+}
+
+// End of packet with RXOFF_MODE or TXOFF_MODE IDLE: the automatic return calibrates with
+// FS_AUTOCAL=2, every 4th one with FS_AUTOCAL=3
+static void sim_auto_idle(cc1101_sim_t *s)
+{
+    uint8_t autocal = (s->regs[CC11xx_MCSM0] >> 4) & 0x03;
+
+    sim_goto(s, CC11xx_STATE_IDLE);
+    if ((autocal == 2) || ((autocal == 3) && ((++s->autocal_count & 0x03) == 0))){
+        sim_schedule(s, CC11xx_STATE_ENDCAL, CC11xx_STATE_IDLE, world.cfg.cal_ns, true);
+    }
+}
+
+static void sim_goto(cc1101_sim_t *s, uint8_t target)
+{
+    uint8_t from = s->marcstate;
+    uint8_t autocal = (s->regs[CC11xx_MCSM0] >> 4) & 0x03;
+
+    if (s->transition){
+        from = s->next_state;
+        s->transition = false;
+    }
+    if (from == CC11xx_STATE_TX && target != CC11xx_STATE_TX){
+        sim_tx_abort(s);
+    }
+    if (from == CC11xx_STATE_RX && target != CC11xx_STATE_RX && s->rx_src){
+        s->rx_src = NULL;
+        s->sync_flag = false;
+    }
+
+    if (target == CC11xx_STATE_IDLE){
+        sim_enter(s, CC11xx_STATE_IDLE); // SIDLE does not calibrate, see sim_auto_idle()
+        return;
+    }
+    if (from == target){
+        return;
+    }
+
+    switch (from){
+        case CC11xx_STATE_IDLE:
+            if (autocal == 1){
+                sim_schedule(s, CC11xx_STATE_STARTCAL, target, (uint64_t) world.cfg.cal_ns + world.cfg.settle_ns, true);
+            }else{
+                sim_schedule(s, CC11xx_STATE_FS_LOCK, target, world.cfg.settle_ns, false);
+            }
+            break;
+        case CC11xx_STATE_TX:
+            sim_schedule(s, CC11xx_STATE_TXRX_SWITCH, target, world.cfg.tx_to_rx_ns, false);
+            break;
+        case CC11xx_STATE_FSTXON:
+            if (target == CC11xx_STATE_TX){
+                sim_enter(s, CC11xx_STATE_TX); // Synthesizer already running
+            }else{
+                sim_schedule(s, CC11xx_STATE_TXRX_SWITCH, target, world.cfg.tx_to_rx_ns, false);
+            }
+            break;
+        default:
+            sim_schedule(s, CC11xx_STATE_RXTX_SWITCH, target, world.cfg.rx_to_tx_ns, false);
+            break;
+    }
+}
+
+static void sim_reset(cc1101_sim_t *s)
+{
+    sim_tx_abort(s);
+    memcpy(s->regs, reset_regs, sizeof(reset_regs));
+    memset(s->patable, 0, sizeof(s->patable));
+    s->patable[0] = 0xC6;
+    sim_flush_rx(s);
+    sim_flush_tx(s);
+    s->transition = false;
+    s->marcstate = CC11xx_STATE_IDLE;
+    s->cal_freq_hz = 0.0;
+    s->autocal_count = 0;
+    s->rx_src = NULL;
+    s->sync_flag = false;
+    s->crc_flag = false;
+    s->sleeping = false;
+    s->lqi = 0;
+    s->rssi = 0x80;
+}
+
+static void sim_strobe(cc1101_sim_t *s, uint8_t strobe)
+{
+    uint8_t state = s->transition ? s->next_state : s->marcstate;
+
+    s->stats.strobes++;
+    switch (strobe){
+        case CC11xx_SRES:
+            sim_reset(s);
+            break;
+        case CC11xx_SFSTXON:
+            if (state == CC11xx_STATE_IDLE || state == CC11xx_STATE_RX){
+                sim_goto(s, CC11xx_STATE_FSTXON);
+            }
+            break;
+        case CC11xx_SXOFF:
+        case CC11xx_SPWD:
+            if (state == CC11xx_STATE_IDLE){
+                s->marcstate = (strobe == CC11xx_SPWD) ? CC11xx_STATE_SLEEP : CC11xx_STATE_XOFF;
+                s->sleeping = true;
+            }
+            break;
+        case CC11xx_SCAL:
+            if (state == CC11xx_STATE_IDLE){
+                sim_schedule(s, CC11xx_STATE_MANCAL, CC11xx_STATE_IDLE, world.cfg.cal_ns, true);
+            }
+            break;
+        case CC11xx_SRX:
+            if (state == CC11xx_STATE_IDLE || state == CC11xx_STATE_FSTXON || state == CC11xx_STATE_TX){
+                sim_goto(s, CC11xx_STATE_RX);
+            }
+            break;
+        case CC11xx_STX:
+            if (state == CC11xx_STATE_IDLE || state == CC11xx_STATE_FSTXON){
+                sim_goto(s, CC11xx_STATE_TX);
+            }else if (state == CC11xx_STATE_RX && sim_cca(s)){
+                sim_goto(s, CC11xx_STATE_TX); // In RX the chip only enters TX when the channel is clear
+            }
+            break;
+        case CC11xx_SIDLE:
+            sim_goto(s, CC11xx_STATE_IDLE);
+            break;
+        case CC11xx_SFRX:
+            if (state == CC11xx_STATE_IDLE || state == CC11xx_STATE_RXFIFO_OVERFLOW){
+                sim_flush_rx(s);
+                if (state == CC11xx_STATE_RXFIFO_OVERFLOW){
+                    sim_enter(s, CC11xx_STATE_IDLE);
+                }
+            }
+            break;
+        case CC11xx_SFTX:
+            if (state == CC11xx_STATE_IDLE || state == CC11xx_STATE_TXFIFO_UNDERFLOW){
+                sim_flush_tx(s);
+                if (state == CC11xx_STATE_TXFIFO_UNDERFLOW){
+                    sim_enter(s, CC11xx_STATE_IDLE);
+                }
+            }
+            break;
+        default: // SAFC, SWOR, SWORRST, SNOP
+            break;
+    }
+}
+
+static uint8_t sim_read_status_reg(cc1101_sim_t *s, uint8_t addr)
+{
+    switch (addr){
+        case CC11xx_PARTNUM:    return 0x00;
+        case CC11xx_VERSION:    return 0x14;
+        case CC11xx_LQI:        return s->lqi;
+        case CC11xx_RSSI:
+            if (s->marcstate == CC11xx_STATE_RX && s->rx_src == NULL){
+                s->rssi = sim_rssi_raw(sim_channel_dbm(s));
+            }
+            return s->rssi;
+        case CC11xx_MARCSTATE:  return s->marcstate & 0x1F;
+        case CC11xx_PKTSTATUS:
+            return (s->crc_flag ? 0x80 : 0) | (sim_carrier_sense(s) ? 0x40 : 0) | (sim_cca(s) ? 0x10 : 0) |
+                   (s->sync_flag ? 0x08 : 0) | (s->gdo2 ? 0x04 : 0) | (s->gdo0 ? 0x01 : 0);
+        case CC11xx_VCO_VC_DAC: return 0x94;
+        case CC11xx_TXBYTES:
+            return (s->marcstate == CC11xx_STATE_TXFIFO_UNDERFLOW ? 0x80 : 0) | s->tx_n;
+        case CC11xx_RXBYTES:
+            return (s->marcstate == CC11xx_STATE_RXFIFO_OVERFLOW ? 0x80 : 0) | s->rx_n;
+        case 0x3C:              return s->regs[CC11xx_RCCTRL1];
+        case 0x3D:              return s->regs[CC11xx_RCCTRL0];
+        default:                return 0x00;
+    }
+}
+
+static void sim_spi(cc1101_sim_t *s, const uint8_t *tx, uint8_t *rx, uint32_t len)
+{
+    uint8_t hdr = tx[0];
+    uint8_t addr = hdr & 0x3F;
+    bool read = (hdr & 0x80) != 0;
+    bool burst = (hdr & 0x40) != 0;
+    uint32_t i;
+
+    if (s->sleeping){
+        s->sleeping = false; // CSn low wakes the chip up
+        s->marcstate = CC11xx_STATE_IDLE;
+    }
+    rx[0] = sim_status_byte(s, read);
+
+    if (addr >= 0x30 && addr <= 0x3D && !burst){
+        sim_strobe(s, addr);
+        for (i = 1; i < len; i++){
+            rx[i] = sim_status_byte(s, read);
+        }
+    }else if (addr == CC11xx_TXFIFO){
+        for (i = 1; i < len; i++){
+            if (read){
+                rx[i] = sim_rx_pop(s);
+            }else{
+                sim_tx_push(s, tx[i]);
+                rx[i] = sim_status_byte(s, false);
+            }
+            if (!burst){
+                break;
+            }
+        }
+    }else if (addr == CC11xx_PATABLE){
+        for (i = 1; i < len && i <= 8; i++){
+            if (read){
+                rx[i] = s->patable[i-1];
+            }else{
+                s->patable[i-1] = tx[i];
+            }
+            if (!burst){
+                break;
+            }
+        }
+    }else if (addr >= 0x30){
+        if (len > 1){
+            rx[1] = read ? sim_read_status_reg(s, addr) : 0;
+        }
+    }else{
+        for (i = 1; i < len; i++){
+            uint8_t reg = addr + (i - 1);
+            if (reg >= CC11xx_SIM_NUM_REGS){
+                break;
+            }
+            if (read){
+                rx[i] = s->regs[reg];
+            }else{
+                s->regs[reg] = tx[i];
+                if (reg == CC11xx_FSCAL2 || reg == CC11xx_FSCAL1){
+                    sim_fscal_written(s);
+                }
+            }
+            if (!burst){
+                break;
+            }
+        }
+    }
+
+    s->stats.spi_transactions++;
+    s->stats.spi_bytes += len;
+    sim_update_gdo(s);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Virtual clock
+// ------------------------------------------------------------------------------------------------
+static uint64_t sim_next_event(void)
+{
+    uint64_t t = UINT64_MAX;
+    int i;
+
+    for (i = 0; i < CC11xx_SIM_MAX_INSTANCES; i++){
+        cc1101_sim_t *s = &world.inst[i];
+        if (!s->used){
+            continue;
+        }
+        if (s->transition && s->transition_ns < t){
+            t = s->transition_ns;
+        }
+        if (s->tx.phase != EMIT_OFF && s->tx.next_ns < t){
+            t = s->tx.next_ns;
+        }
+        if (s->dma.active && !s->dma.pending && s->dma.due_ns < t){
+            t = s->dma.due_ns;
+        }
+        if (s->timer.armed && s->timer.due_ns < t){
+            t = s->timer.due_ns;
+        }
+    }
+    for (i = 0; i < CC11xx_SIM_MAX_INJECT; i++){
+        if (world.inject[i].used && world.inject[i].em.next_ns < t){
+            t = world.inject[i].em.next_ns;
+        }
+    }
+    return t;
+}
+
+static void sim_process(uint64_t t)
+{
+    int i;
+
+    for (i = 0; i < CC11xx_SIM_MAX_INSTANCES; i++){
+        cc1101_sim_t *s = &world.inst[i];
+        if (!s->used){
+            continue;
+        }
+        if (s->transition && s->transition_ns <= t){
+            if (s->transition_cal){
+                sim_calibrate(s);
+            }
+            sim_enter(s, s->next_state);
+            sim_update_gdo(s);
+        }
+        if (s->tx.phase != EMIT_OFF && s->tx.next_ns <= t){
+            sim_emit_step(&s->tx, NULL);
+        }
+        if (s->dma.active && !s->dma.pending && s->dma.due_ns <= t){
+            *s->dma.status = s->dma.data[0];
+            if (s->dma.rx){
+                memcpy(s->dma.rx, &s->dma.data[1], s->dma.len);
+            }
+            s->dma.pending = true;
+        }
+        if (s->timer.armed && s->timer.due_ns <= t){
+            s->timer.armed = false;
+            s->timer.pending = true;
+        }
+    }
+    for (i = 0; i < CC11xx_SIM_MAX_INJECT; i++){
+        sim_inject_t *in = &world.inject[i];
+        if (!in->used || in->em.next_ns > t){
+            continue;
+        }
+        if (in->em.phase == EMIT_OFF){
+            in->em.phase = EMIT_PREAMBLE; // Frame starts: the preamble is on air from now on
+            in->em.next_ns += in->em.byte_ns;
+            continue;
+        }
+        sim_emit_step(&in->em, in);
+    }
+    sim_update_all_gdo(); // CCA and carrier sense follow what is on air
+}
+
+// SPI completion interrupt: preempts the GDO interrupts and is not masked by cc1101_sim_it_disable
+static bool sim_dma_deliver(cc1101_sim_t *s)
+{
+    bool in_isr = world.in_isr;
+    bool in_spi_isr = world.in_spi_isr;
+
+    if (!s->dma.pending){
+        return false;
+    }
+    s->dma.pending = false;
+    s->dma.active = false;
+    world.in_isr = true;
+    world.in_spi_isr = true;
+    s->dma.done(s->dma.ctx);
+    world.in_spi_isr = in_spi_isr;
+    world.in_isr = in_isr;
+    return true;
+}
+
+static void sim_dispatch(void)
+{
+    bool any;
+    int i;
+
+    if (world.in_isr){
+        return;
+    }
+    do{
+        any = false;
+        for (i = 0; i < CC11xx_SIM_MAX_INSTANCES; i++){
+            if (world.inst[i].used && sim_dma_deliver(&world.inst[i])){
+                any = true;
+            }
+        }
+        for (i = 0; i < CC11xx_SIM_MAX_INSTANCES; i++){
+            cc1101_sim_t *s = &world.inst[i];
+            if (!s->used || s->it_disabled){
+                continue;
+            }
+            if (s->timer.pending && s->timer_isr){
+                s->timer.pending = false;
+                world.in_isr = true;
+                s->timer_isr(s->isr_ctx);
+                world.in_isr = false;
+                any = true;
+            }
+            if (s->gdo0_pending && s->gdo0_isr){
+                s->gdo0_pending = false;
+                world.in_isr = true;
+                s->gdo0_isr(s->isr_ctx);
+                world.in_isr = false;
+                any = true;
+            }
+            if (s->gdo2_pending && s->gdo2_isr){
+                s->gdo2_pending = false;
+                world.in_isr = true;
+                s->gdo2_isr(s->isr_ctx);
+                world.in_isr = false;
+                any = true;
+            }
+        }
+    }while (any);
+}
+
+static void sim_advance(uint64_t until, bool dispatch)
+{
+    uint64_t t;
+
+    for (;;){
+        if (dispatch){
+            sim_dispatch();
+        }
+        t = sim_next_event();
+        if (t > until){
+            break;
+        }
+        if (t > world.now){
+            world.now = t;
+        }
+        sim_process(world.now);
+    }
+    if (until > world.now){
+        world.now = until;
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Public interface
+// ------------------------------------------------------------------------------------------------
+void cc1101_sim_default_config(cc1101_sim_config_t *cfg)
+{
+    cfg->f_xtal           = 26000000;
+    cfg->spi_byte_ns      = 1000;     // 8 MHz SCLK
+    cfg->spi_cs_ns        = 500;
+    cfg->cal_ns           = 720000;   // FS calibration, FS_AUTOCAL or SCAL
+    cfg->settle_ns        = 75100;    // IDLE -> RX/TX without calibration
+    cfg->rx_to_tx_ns      = 9600;
+    cfg->tx_to_rx_ns      = 21500;
+    cfg->noise_dbm        = -110.0f;
+    cfg->cs_threshold_dbm = -90.0f;
+    cfg->link_rssi_dbm    = -60.0f;
+    cfg->spi_isr_strict   = false;
+}
+
+void cc1101_sim_init(const cc1101_sim_config_t *cfg)
+{
+    memset(&world, 0, sizeof(world));
+    if (cfg){
+        world.cfg = *cfg;
+    }else{
+        cc1101_sim_default_config(&world.cfg);
+    }
+    world.current = cc1101_sim_add();
+}
+
+cc1101_sim_t *cc1101_sim_default(void)
+{
+    return &world.inst[0];
+}
+
+cc1101_sim_t *cc1101_sim_add(void)
+{
+    int i;
+
+    for (i = 0; i < CC11xx_SIM_MAX_INSTANCES; i++){
+        cc1101_sim_t *s = &world.inst[i];
+        if (!s->used){
+            memset(s, 0, sizeof(*s));
+            s->used = true;
+            sim_reset(s);
+            sim_update_gdo(s);
+            s->gdo0_pending = false;
+            s->gdo2_pending = false;
+            return s;
+        }
+    }
+    return NULL;
+}
+
+void cc1101_sim_select(cc1101_sim_t *sim)
+{
+    world.current = sim;
+}
+
+void cc1101_sim_attach_isr(cc1101_sim_t *sim, cc1101_sim_isr_t gdo0, cc1101_sim_isr_t gdo2, cc1101_sim_isr_t timer, void *ctx)
+{
+    sim->gdo0_isr = gdo0;
+    sim->gdo2_isr = gdo2;
+    sim->timer_isr = timer;
+    sim->isr_ctx = ctx;
+}
+
+// Wire the GDO lines and the timer of the chip to the interrupt handlers of a driver handle
+void cc1101_sim_attach_radio(cc1101_sim_t *sim, radio_int_data_t *radio)
+{
+    cc1101_sim_attach_isr(sim, sim_radio_gdo0, sim_radio_gdo2, sim_radio_timer, (void *) radio);
+}
+
+void cc1101_sim_set_tx_sink(cc1101_sim_t *sim, cc1101_sim_tx_sink_t sink, void *ctx)
+{
+    sim->sink = sink;
+    sim->sink_ctx = ctx;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Put a frame on air for sim after delay_ns, as if sent by a peer using sim's own settings.
+// frame holds the bytes a transmitter would write to its TX FIFO (length byte included in
+// variable length mode).
+int cc1101_sim_inject(cc1101_sim_t *sim, const uint8_t *frame, uint32_t len, uint64_t delay_ns, float rssi_dbm, bool crc_ok)
+// ------------------------------------------------------------------------------------------------
+{
+    sim_inject_t *in = NULL;
+    int i;
+
+    if (len == 0 || len > CC11xx_SIM_FRAME_MAX){
+        return 1;
+    }
+    for (i = 0; i < CC11xx_SIM_MAX_INJECT; i++){
+        if (!world.inject[i].used){
+            in = &world.inject[i];
+            break;
+        }
+    }
+    if (!in){
+        return 1;
+    }
+    memset(&in->em, 0, sizeof(in->em));
+    memcpy(in->data, frame, len);
+    in->len = len;
+    in->crc_en = (sim->regs[CC11xx_PKTCTRL0] & 0x04) != 0;
+    in->em.phase = EMIT_OFF;
+    in->em.left = preamble_bytes[(sim->regs[CC11xx_MDMCFG1] >> 4) & 0x07];
+    in->em.byte_ns = sim_byte_ns(sim);
+    in->em.next_ns = world.now + delay_ns;
+    in->em.freq_hz = sim_freq_hz(sim);
+    in->em.rssi_dbm = rssi_dbm;
+    in->em.crc_ok = crc_ok;
+    in->used = true;
+    return 0;
+}
+
+void cc1101_sim_set_noise(float noise_dbm)
+{
+    world.cfg.noise_dbm = noise_dbm;
+    sim_update_all_gdo();
+}
+
+uint64_t cc1101_sim_now_ns(void)
+{
+    return world.now;
+}
+
+void cc1101_sim_run_for(uint64_t ns)
+{
+    sim_advance(world.now + ns, !world.in_isr);
+}
+
+void cc1101_sim_sleep_us(uint32_t us)
+{
+    cc1101_sim_run_for((uint64_t) us * 1000);
+}
+
+uint8_t cc1101_sim_reg(cc1101_sim_t *sim, uint8_t addr)
+{
+    return (addr < CC11xx_SIM_NUM_REGS) ? sim->regs[addr] : 0;
+}
+
+uint8_t cc1101_sim_marcstate(cc1101_sim_t *sim)
+{
+    return sim->marcstate;
+}
+
+float cc1101_sim_data_rate(cc1101_sim_t *sim)
+{
+    return (float) sim_rate(sim);
+}
+
+void cc1101_sim_get_stats(cc1101_sim_t *sim, cc1101_sim_stats_t *stats)
+{
+    *stats = sim->stats;
+}
+
+/* Backend: per chip, the cc1101_sim_backend functions, the plain ones act on the selected chip */
+
+static int sim_be_transfer(void *ctx, uint8_t *tx, uint8_t *rx, uint8_t len)
+{
+    cc1101_sim_t *s = (cc1101_sim_t *) ctx;
+
+    if (!s || len == 0){
+        return 1;
+    }
+    sim_spi(s, tx, rx, len);
+    sim_advance(world.now + world.cfg.spi_cs_ns + (uint64_t) len * world.cfg.spi_byte_ns, false);
+    sim_dispatch(); // Pending GDO interrupts preempt thread context between transactions
+    return 0;
+}
+
+static int sim_be_transfer_sg(void *ctx, uint8_t cmd, uint8_t *status, const uint8_t *tx, uint8_t *rx, uint8_t len)
+{
+    cc1101_sim_t *s = (cc1101_sim_t *) ctx;
+    uint8_t out[SIM_SPI_MAX], in[SIM_SPI_MAX];
+
+    if (!s){
+        return 1;
+    }
+    out[0] = cmd;
+    if (tx){
+        memcpy(&out[1], tx, len);
+    }else{
+        memset(&out[1], 0, len);
+    }
+    sim_spi(s, out, in, (uint32_t) len + 1);
+    *status = in[0];
+    if (rx){
+        memcpy(rx, &in[1], len);
+    }
+    sim_advance(world.now + world.cfg.spi_cs_ns + ((uint64_t) len + 1) * world.cfg.spi_byte_ns, false);
+    sim_dispatch();
+    return 0;
+}
+
+static int sim_be_start(void *ctx, uint8_t cmd, uint8_t *status, const uint8_t *tx, uint8_t *rx, uint8_t len, cc1101_sim_spi_done_t done, void *done_ctx)
+{
+    cc1101_sim_t *s = (cc1101_sim_t *) ctx;
+    uint8_t out[SIM_SPI_MAX];
+
+    if (!s || s->dma.active){
+        return 1;
+    }
+    out[0] = cmd;
+    if (tx){
+        memcpy(&out[1], tx, len);
+    }else{
+        memset(&out[1], 0, len);
+    }
+    sim_spi(s, out, s->dma.data, (uint32_t) len + 1); // The chip sees it now, the caller at completion
+    s->dma.active = true;
+    s->dma.pending = false;
+    s->dma.due_ns = world.now + world.cfg.spi_cs_ns + ((uint64_t) len + 1) * world.cfg.spi_byte_ns;
+    s->dma.status = status;
+    s->dma.rx = rx;
+    s->dma.len = len;
+    s->dma.done = done;
+    s->dma.ctx = done_ctx;
+    return 0;
+}
+
+static void sim_be_wait(void *ctx)
+{
+    cc1101_sim_t *s = (cc1101_sim_t *) ctx;
+
+    if (!s){
+        return;
+    }
+    if (world.in_spi_isr){
+        s->stats.spi_isr_waits++; // The completion interrupt waiting for itself
+        if (world.cfg.spi_isr_strict){
+            abort();
+        }
+    }
+    if (s->dma.active && !s->dma.pending){
+        sim_advance(s->dma.due_ns, false);
+    }
+    if (!sim_dma_deliver(s)){
+        sim_advance(world.now + world.cfg.spi_byte_ns, false);
+    }
+}
+
+static int sim_be_gdo0(void *ctx)
+{
+    return ctx ? ((cc1101_sim_t *) ctx)->gdo0 : 0;
+}
+
+static int sim_be_gdo2(void *ctx)
+{
+    return ctx ? ((cc1101_sim_t *) ctx)->gdo2 : 0;
+}
+
+static void sim_be_it_disable(void *ctx)
+{
+    ((cc1101_sim_t *) ctx)->it_disabled = true;
+}
+
+static void sim_be_it_enable(void *ctx)
+{
+    ((cc1101_sim_t *) ctx)->it_disabled = false;
+    sim_dispatch();
+}
+
+static void sim_be_timer_start(void *ctx, uint32_t us)
+{
+    cc1101_sim_t *s = (cc1101_sim_t *) ctx;
+
+    s->timer.armed = true;
+    s->timer.pending = false;
+    s->timer.due_ns = world.now + (uint64_t) us * 1000;
+}
+
+const cc11xx_backend_t cc1101_sim_backend = {
+    sim_be_transfer,
+    sim_be_transfer_sg,
+    sim_be_start,
+    sim_be_wait,
+    sim_be_gdo0,
+    sim_be_gdo2,
+    sim_be_it_disable,
+    sim_be_it_enable,
+    sim_be_timer_start,
+    NULL                // spi_batch: queued transfers run one by one in the background
+};
+
+int cc1101_sim_spi_transfer(uint8_t *tx, uint8_t *rx, uint8_t len)
+{
+    return sim_be_transfer(world.current, tx, rx, len);
+}
+
+int cc1101_sim_spi_transfer_sg(uint8_t cmd, uint8_t *status, const uint8_t *tx, uint8_t *rx, uint8_t len)
+{
+    return sim_be_transfer_sg(world.current, cmd, status, tx, rx, len);
+}
+
+void cc1101_sim_timer_start(uint32_t us)
+{
+    if (world.current){
+        sim_be_timer_start(world.current, us);
+    }
+}
+
+int cc1101_sim_spi_start(uint8_t cmd, uint8_t *status, const uint8_t *tx, uint8_t *rx, uint8_t len, cc1101_sim_spi_done_t done, void *ctx)
+{
+    return sim_be_start(world.current, cmd, status, tx, rx, len, done, ctx);
+}
+
+void cc1101_sim_spi_wait(void)
+{
+    sim_be_wait(world.current);
+}
+
+int cc1101_sim_gdo0(void)
+{
+    return sim_be_gdo0(world.current);
+}
+
+int cc1101_sim_gdo2(void)
+{
+    return sim_be_gdo2(world.current);
+}
+
+void cc1101_sim_it_disable(void)
+{
+    if (world.current){
+        sim_be_it_disable(world.current);
+    }
+}
+
+void cc1101_sim_it_enable(void)
+{
+    if (world.current){
+        sim_be_it_enable(world.current);
+    }
+}
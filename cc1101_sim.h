@@ -0,0 +1,124 @@
+#ifndef __CC1101_SIM_H__
+#define __CC1101_SIM_H__
+
+/*
+ * Host-side CC1101 simulator.
+ *
+ * Models the parts of the chip the driver relies on: the configuration register
+ * file, status registers, 64 byte RX/TX FIFOs with FIFOTHR thresholds, the main
+ * radio control state machine (strobes, MCSM0/MCSM1 transitions, calibration)
+ * and the GDO0/GDO2 outputs. Everything runs on a virtual clock in nanoseconds;
+ * on-air timing follows the data rate programmed in MDMCFG4/MDMCFG3.
+ *
+ * Several instances share one "air": a frame transmitted by one instance is
+ * received by every other instance in RX on the same frequency. Frames can also
+ * be injected from the test harness without a second instance.
+ *
+ * GDO edges are latched like EXTI pending bits and the bound ISRs are called
+ * from the clock loop (MSLEEP or cc1101_sim_run_for) and at the end of SPI
+ * transactions issued from thread context, unless interrupts are disabled.
+ * cc1101_sim_spi_start runs one transfer in the background like a DMA: its
+ * completion callback is delivered the same way, ahead of the GDO interrupts
+ * and regardless of cc1101_sim_it_disable, or by cc1101_sim_spi_wait. A
+ * completion interrupt does not nest: a wait for the bus from a completion
+ * callback would never return on a microcontroller. It is counted, and with
+ * spi_isr_strict in the configuration the simulator aborts there. The one
+ * shot timer of cc1101_sim_timer_start is masked like the GDO interrupts.
+ *
+ * Each chip has its own SPI bus, DMA, timer and interrupt mask. The plain
+ * backend entry points act on the chip picked with cc1101_sim_select (the
+ * default one after cc1101_sim_init); cc1101_sim_backend, with the chip as
+ * spi_parms_t backend_ctx, drives several of them side by side.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cc1101_routine.h"
+
+#define CC11xx_SIM_MAX_INSTANCES 4
+#define CC11xx_SIM_MAX_INJECT    8
+#define CC11xx_SIM_FRAME_MAX     8192   // Largest frame captured or injected (bytes)
+#define CC11xx_SIM_NUM_REGS      0x2F   // Configuration registers 0x00..0x2E
+
+/* Status of a frame reported to the TX sink */
+typedef enum cc1101_sim_tx_status_e {
+    CC11xx_SIM_TX_OK = 0,
+    CC11xx_SIM_TX_UNDERFLOW,
+    CC11xx_SIM_TX_ABORTED
+} cc1101_sim_tx_status_t;
+
+/* Timing and RF environment of the simulated world */
+typedef struct cc1101_sim_config_s
+{
+    uint32_t f_xtal;            // Crystal frequency (Hz)
+    uint32_t spi_byte_ns;       // Duration of one SPI byte
+    uint32_t spi_cs_ns;         // Chip select setup/hold overhead per transaction
+    uint32_t cal_ns;            // Frequency synthesizer calibration time
+    uint32_t settle_ns;         // IDLE to RX/TX/FSTXON settling time without calibration
+    uint32_t rx_to_tx_ns;       // RX or FSTXON to TX turnaround
+    uint32_t tx_to_rx_ns;       // TX to RX turnaround
+    float    noise_dbm;         // Channel noise floor
+    float    cs_threshold_dbm;  // Carrier sense / CCA threshold
+    float    link_rssi_dbm;     // RSSI seen for frames sent by other instances
+    bool     spi_isr_strict;    // SPI completions only from their interrupt: a bus wait inside it aborts
+} cc1101_sim_config_t;
+
+/* Counters kept per simulated chip */
+typedef struct cc1101_sim_stats_s
+{
+    uint32_t spi_transactions;
+    uint32_t spi_bytes;
+    uint32_t strobes;
+    uint32_t calibrations;
+    uint32_t frames_sent;
+    uint32_t frames_received;
+    uint32_t tx_underflows;
+    uint32_t rx_overflows;
+    uint32_t gdo0_edges;
+    uint32_t gdo2_edges;
+    uint32_t spi_isr_waits;     // Bus waits from an SPI completion callback, a hang on a microcontroller
+} cc1101_sim_stats_t;
+
+typedef struct cc1101_sim_s cc1101_sim_t;
+
+typedef void (*cc1101_sim_isr_t)(void *ctx);
+typedef void (*cc1101_sim_spi_done_t)(void *ctx);
+typedef void (*cc1101_sim_tx_sink_t)(void *ctx, const uint8_t *frame, uint32_t len, cc1101_sim_tx_status_t status);
+
+void            cc1101_sim_default_config(cc1101_sim_config_t *cfg);
+void            cc1101_sim_init(const cc1101_sim_config_t *cfg);
+cc1101_sim_t   *cc1101_sim_default(void);
+cc1101_sim_t   *cc1101_sim_add(void);
+void            cc1101_sim_select(cc1101_sim_t *sim);
+
+void            cc1101_sim_attach_isr(cc1101_sim_t *sim, cc1101_sim_isr_t gdo0, cc1101_sim_isr_t gdo2, cc1101_sim_isr_t timer, void *ctx);
+void            cc1101_sim_attach_radio(cc1101_sim_t *sim, radio_int_data_t *radio);
+void            cc1101_sim_set_tx_sink(cc1101_sim_t *sim, cc1101_sim_tx_sink_t sink, void *ctx);
+int             cc1101_sim_inject(cc1101_sim_t *sim, const uint8_t *frame, uint32_t len, uint64_t delay_ns, float rssi_dbm, bool crc_ok);
+void            cc1101_sim_set_noise(float noise_dbm);
+
+uint64_t        cc1101_sim_now_ns(void);
+void            cc1101_sim_run_for(uint64_t ns);
+void            cc1101_sim_sleep_us(uint32_t us);
+
+uint8_t         cc1101_sim_reg(cc1101_sim_t *sim, uint8_t addr);
+uint8_t         cc1101_sim_marcstate(cc1101_sim_t *sim);
+float           cc1101_sim_data_rate(cc1101_sim_t *sim);
+void            cc1101_sim_get_stats(cc1101_sim_t *sim, cc1101_sim_stats_t *stats);
+
+/* Per chip backend, backend_ctx is the cc1101_sim_t */
+extern const cc11xx_backend_t cc1101_sim_backend;
+
+/* Backend entry points used by cc1101_wrapper.h */
+int             cc1101_sim_spi_transfer(uint8_t *tx, uint8_t *rx, uint8_t len);
+int             cc1101_sim_spi_transfer_sg(uint8_t cmd, uint8_t *status, const uint8_t *tx, uint8_t *rx, uint8_t len);
+int             cc1101_sim_spi_start(uint8_t cmd, uint8_t *status, const uint8_t *tx, uint8_t *rx, uint8_t len, cc1101_sim_spi_done_t done, void *ctx);
+void            cc1101_sim_spi_wait(void);
+int             cc1101_sim_gdo0(void);
+int             cc1101_sim_gdo2(void);
+void            cc1101_sim_it_disable(void);
+void            cc1101_sim_it_enable(void);
+void            cc1101_sim_timer_start(uint32_t us);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef __CC1101_TRACE_H__
+#define __CC1101_TRACE_H__
+
+/*
+ * Binary trace of the interrupt side of the driver, built with -DCC11xx_TRACE.
+ *
+ * Each step of gdo0_isr(), gdo2_isr() and the SPI completion and backoff timer chains records
+ * one fixed size entry in radio_trace: event, timestamp, chip state from the last status byte,
+ * byte_index and bytes_remaining. All radios share the ring, entries carry the radio id. Recording is a handful of stores, no SPI access. The ring
+ * overwrites the oldest entries; an entry may be lost when interrupts nest while recording.
+ *
+ * radio_trace is laid out to be dumped as is (debugger memory dump, UART, ...) and turned into
+ * a timeline on the host with cc1101_trace_decode. Little endian targets only.
+ */
+
+#include <stdint.h>
+
+// Entries kept (power of two)
+#ifndef CC11xx_TRACE_DEPTH
+#define CC11xx_TRACE_DEPTH       256
+#endif
+
+#define CC11xx_TRACE_MAGIC       0x52544343  // "CCTR"
+#define CC11xx_TRACE_VERSION     2
+
+/* Trace events, arg meaning in brackets */
+typedef enum radio_trace_event_e {
+    TRACE_GDO0_RISE = 1,        // [radio mode]
+    TRACE_GDO0_FALL,            // [radio mode]
+    TRACE_GDO2_RISE,            // [radio mode]
+    TRACE_GDO2_FALL,            // [radio mode]
+    TRACE_RX_LEVEL,             // RXBYTES read on FIFO threshold [RXBYTES]
+    TRACE_RX_UNLOAD,            // Payload read from the RX FIFO [bytes]
+    TRACE_RX_HEADER,            // Length header complete [length, low byte]
+    TRACE_RX_STREAM_FIXED,      // Stream in reception switched to fixed length
+    TRACE_RX_EOP,               // End of packet handling starts
+    TRACE_RX_OVERFLOW,          // Packet lost to a RX FIFO overflow
+    TRACE_RX_DONE,              // Packet or stream handed over [LQI byte, CRC in bit 7]
+    TRACE_CCA,                  // Clear channel assessment [1 clear, 0 busy]
+    TRACE_BACKOFF,              // Backoff started [slots, 255 and more]
+    TRACE_BACKOFF_END,          // Backoff timer expired
+    TRACE_TX_START,             // Frame handed to the chip [bytes in the first FIFO fill]
+    TRACE_TX_LEVEL,             // TXBYTES read on FIFO threshold [TXBYTES]
+    TRACE_TX_REFILL,            // Bytes written to the TX FIFO [bytes]
+    TRACE_TX_STREAM_FIXED,      // Stream in transmission switched to fixed length
+    TRACE_TX_DONE,              // Frame completed [radio_tx_status_t]
+    NUM_TRACE_EVENTS
+} radio_trace_event_t;
+
+/* One trace entry, 12 bytes */
+typedef struct radio_trace_entry_s
+{
+    uint32_t        timestamp;              // CC11xx_CYCLES() if defined, else CC11xx_TIMESTAMP()
+    uint16_t        byte_index;             // Packet bytes moved so far (low 16 bits)
+    uint16_t        bytes_remaining;        // Packet bytes left (low 16 bits)
+    uint8_t         event;                  // radio_trace_event_t
+    uint8_t         state;                  // CC11xx_status_state_t of the last SPI access
+    uint8_t         arg;                    // Event specific
+    uint8_t         mode;                   // Radio mode, radio id in the high nibble
+} radio_trace_entry_t;
+
+/* The ring as dumped */
+typedef struct radio_trace_s
+{
+    uint32_t        magic;                  // CC11xx_TRACE_MAGIC
+    uint16_t        version;                // CC11xx_TRACE_VERSION
+    uint16_t        depth;                  // CC11xx_TRACE_DEPTH
+    uint32_t        head;                   // Entries recorded, the newest is at (head - 1) % depth
+    uint32_t        clock;                  // 1 if timestamps are CC11xx_CYCLES(), 0 for milliseconds
+    radio_trace_entry_t entry[CC11xx_TRACE_DEPTH];
+} radio_trace_t;
+
+#endif
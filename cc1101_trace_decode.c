@@ -0,0 +1,137 @@
+/*
+ * Host side decoder for the driver trace ring (cc1101_trace.h).
+ *
+ * Reads a raw dump of radio_trace and prints the recorded events oldest first, one per line,
+ * with the time since the previous event. Build and run:
+ *
+ *   cc -o cc1101_trace_decode cc1101_trace_decode.c
+ *   ./cc1101_trace_decode dump.bin [ticks_per_us]
+ *
+ * ticks_per_us converts CC11xx_CYCLES() timestamps to microseconds (e.g. 80 for a 80 MHz core),
+ * raw ticks are printed without it. Millisecond timestamps are printed as is.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cc1101_trace.h"
+
+static const char *event_names[NUM_TRACE_EVENTS] = {
+    "?",
+    "GDO0_RISE",
+    "GDO0_FALL",
+    "GDO2_RISE",
+    "GDO2_FALL",
+    "RX_LEVEL",
+    "RX_UNLOAD",
+    "RX_HEADER",
+    "RX_STREAM_FIXED",
+    "RX_EOP",
+    "RX_OVERFLOW",
+    "RX_DONE",
+    "CCA",
+    "BACKOFF",
+    "BACKOFF_END",
+    "TX_START",
+    "TX_LEVEL",
+    "TX_REFILL",
+    "TX_STREAM_FIXED",
+    "TX_DONE"
+};
+
+static const char *state_names[8] = {
+    "IDLE", "RX", "TX", "FSTXON", "CALIBRATE", "SETTLING", "RXFIFO_OVF", "TXFIFO_UNF"
+};
+
+static const char *mode_names[5] = {
+    "-", "RX", "TX", "SCAN", "CAL"
+};
+
+// Header of the dump: radio_trace_t up to the entries
+typedef struct trace_header_s
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t depth;
+    uint32_t head;
+    uint32_t clock;
+} trace_header_t;
+
+// ------------------------------------------------------------------------------------------------
+// Print a timestamp or a time difference in the dump time base
+static void print_time(uint32_t ticks, uint32_t clock, double ticks_per_us)
+// ------------------------------------------------------------------------------------------------
+{
+    if (clock && ticks_per_us > 0){
+        printf("%12.1f", ticks / ticks_per_us);
+    }else{
+        printf("%12u", ticks);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    FILE *f;
+    trace_header_t header;
+    radio_trace_entry_t *entry;
+    uint32_t count, first, i;
+    uint32_t prev = 0;
+    double ticks_per_us = 0;
+
+    if (argc < 2){
+        fprintf(stderr, "usage: %s dump.bin [ticks_per_us]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2){
+        ticks_per_us = atof(argv[2]);
+    }
+    f = fopen(argv[1], "rb");
+    if (!f){
+        perror(argv[1]);
+        return 1;
+    }
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != CC11xx_TRACE_MAGIC){
+        fprintf(stderr, "%s: not a trace dump\n", argv[1]);
+        fclose(f);
+        return 1;
+    }
+    if (header.version != CC11xx_TRACE_VERSION || header.depth == 0 || (header.depth & (header.depth - 1))){
+        fprintf(stderr, "%s: unsupported version %u or depth %u\n", argv[1], header.version, header.depth);
+        fclose(f);
+        return 1;
+    }
+    entry = malloc(header.depth * sizeof(radio_trace_entry_t));
+    if (!entry || fread(entry, sizeof(radio_trace_entry_t), header.depth, f) != header.depth){
+        fprintf(stderr, "%s: truncated dump\n", argv[1]);
+        free(entry);
+        fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    count = (header.head < header.depth) ? header.head : header.depth;
+    first = header.head - count;
+    printf("%u events recorded, %u kept, time in %s\n", header.head, count,
+           header.clock ? (ticks_per_us > 0 ? "us" : "cycles") : "ms");
+    printf("%8s %12s %12s  %5s %-16s %-10s %-4s %6s %6s %4s\n",
+           "#", "time", "delta", "radio", "event", "state", "mode", "index", "left", "arg");
+
+    for (i = 0; i < count; i++){
+        radio_trace_entry_t *e = &entry[(first + i) & (header.depth - 1)];
+
+        printf("%8u ", first + i);
+        print_time(e->timestamp, header.clock, ticks_per_us);
+        printf(" ");
+        print_time(i ? e->timestamp - prev : 0, header.clock, ticks_per_us);
+        printf("  %5u %-16s %-10s %-4s %6u %6u %4u\n",
+               e->mode >> 4,
+               (e->event < NUM_TRACE_EVENTS) ? event_names[e->event] : "?",
+               state_names[e->state & 0x07],
+               ((e->mode & 0x0F) < 5) ? mode_names[e->mode & 0x0F] : "?",
+               e->byte_index, e->bytes_remaining, e->arg);
+        prev = e->timestamp;
+    }
+    free(entry);
+    return 0;
+}
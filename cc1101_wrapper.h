@@ -1,14 +1,115 @@
 #ifndef __CC1101_WRAPPER_H__
 #define __CC1101_WRAPPER_H__
 
+/* Compile time backend, used by the radios whose spi_parms_t has no backend (cc11xx_backend_t) */
+
+#ifdef CC11xx_SIM
+
+/* Host build against the simulated chip in cc1101_sim.c */
+#include "cc1101_sim.h"
+
+#define MSLEEP(x) cc1101_sim_sleep_us((x) * 1000)
+#define MDELAY(x) MSLEEP(x)
+#define USLEEP(x) cc1101_sim_sleep_us(x)
+#define SPI_TRANSFER(x, y, z)  cc1101_sim_spi_transfer(x, y, z)
+#define SPI_TRANSFER_SG(c, s, t, r, n)  cc1101_sim_spi_transfer_sg(c, s, t, r, n)
+#define SPI_TRANSFER_SG_START(c, s, t, r, n, d, x)  cc1101_sim_spi_start(c, s, t, r, n, d, x)
+#define CC11xx_SPI_WAIT()	cc1101_sim_spi_wait()
+
+#define CC11xx_GDO0()	cc1101_sim_gdo0()
+#define CC11xx_GDO2()	cc1101_sim_gdo2()
+
+#define CC11xx_IT_DISABLE()	cc1101_sim_it_disable()
+#define CC11xx_IT_ENABLE()	cc1101_sim_it_enable()
+
+#define CC11xx_TIMER_START(us)	cc1101_sim_timer_start(us)
+
+#define CC11xx_TIMESTAMP()	((uint32_t) (cc1101_sim_now_ns() / 1000000))
+#define CC11xx_CYCLES()	((uint32_t) cc1101_sim_now_ns())
+#define CC11xx_CYCLES_PER_US	1000
+#define CC11xx_MEMORY_BARRIER()	__sync_synchronize()
+
+#elif defined(CC11xx_LINUX)
+
+/* Linux userspace, see cc1101_linux.h: every radio needs the cc1101_linux_backend, there are no
+ * default bindings */
+#include "cc1101_linux.h"
+
+#define MSLEEP(x) cc1101_linux_sleep_ms(x)
+#define MDELAY(x) MSLEEP(x)
+#define USLEEP(x) cc1101_linux_sleep_us(x)
+#define SPI_TRANSFER(x, y, z)  1
+#define SPI_TRANSFER_SG(c, s, t, r, n)  1
+#define CC11xx_SPI_WAIT()	do { } while (0)
+
+#define CC11xx_GDO0()	0
+#define CC11xx_GDO2()	0
+
+#define CC11xx_IT_DISABLE()	do { } while (0)
+#define CC11xx_IT_ENABLE()	do { } while (0)
+
+#define CC11xx_TIMESTAMP()	((uint32_t) (cc1101_linux_now_ns() / 1000000))
+#define CC11xx_CYCLES()	((uint32_t) cc1101_linux_now_ns())
+#define CC11xx_CYCLES_PER_US	1000
+#define CC11xx_MEMORY_BARRIER()	__sync_synchronize()
+
+#else
+
 #include "stm32l4xx_hal.h"
 #include "spi.h"
 
 #define MSLEEP(x) HAL_Delay(x)
 #define MDELAY(x) MSLEEP(x)
 #define SPI_TRANSFER(x, y, z)  spi_transfer(x, y, z)
+/* Command byte c (status byte to *s), then n bytes from t (zeros if NULL) to r (dropped if NULL)
+ * under the same chip select: DMA can run from and to the packet buffers directly */
+#define SPI_TRANSFER_SG(c, s, t, r, n)  spi_transfer_sg(c, s, t, r, n)
+#ifdef CC11xx_SPI_DMA
+/* Same transfer started on DMA, d(x) called from the DMA completion interrupt, which must be
+ * able to preempt the GDOx EXTI interrupts. n is 0 for a strobe (command byte only). d(x) may
+ * start the next transfer but never waits for one. Without it queued transfers run blocking. */
+#define SPI_TRANSFER_SG_START(c, s, t, r, n, d, x)  spi_transfer_sg_start(c, s, t, r, n, d, x)
+#endif
+#define CC11xx_SPI_WAIT()	__NOP()
 
 #define CC11xx_GDO0()	HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_0)
 #define CC11xx_GDO2()	HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_5)
 
+/* Must be changed to match the EXTI lines the GDOx pins are wired to. The DMA completion
+ * interrupt is left out on purpose: disable_IT() waits for the queued transfers to finish. */
+#define CC11xx_IT_DISABLE()	do { HAL_NVIC_DisableIRQ(EXTI0_IRQn); HAL_NVIC_DisableIRQ(EXTI9_5_IRQn); } while (0)
+#define CC11xx_IT_ENABLE()	do { HAL_NVIC_EnableIRQ(EXTI0_IRQn); HAL_NVIC_EnableIRQ(EXTI9_5_IRQn); } while (0)
+
+#ifdef CC11xx_CSMA_TIMER
+/* One shot timer calling radio_csma_timer_isr(radio) after us microseconds, restarted if running. Its
+ * interrupt must share the EXTI priority and be masked by CC11xx_IT_DISABLE() as well. Without it
+ * backoffs are polled by radio_tx_process() with CC11xx_TIMESTAMP() resolution. */
+#define CC11xx_TIMER_START(us)	csma_timer_start(us)
+#endif
+
+#define CC11xx_TIMESTAMP()	HAL_GetTick()
+#ifdef CC11xx_ISR_TIMING
+/* Free running cycle counter for the ISR durations of radio_get_stats(), the application enables
+ * it (CoreDebug->DEMCR TRCENA, DWT->CTRL CYCCNTENA). Without it durations are not measured. */
+#define CC11xx_CYCLES()	DWT->CYCCNT
+#define CC11xx_CYCLES_PER_US	(SystemCoreClock / 1000000)
+#endif
+#ifndef USLEEP
+/* Microsecond wait of the RSSI scan, busy on the DWT cycle counter whether or not
+ * CC11xx_ISR_TIMING is set: the counter is started here if the application has not. Define
+ * USLEEP(x) before this header to use a hardware timer instead. */
+#define USLEEP(x)	do { \
+	uint32_t _t; \
+	if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)){ \
+	    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; \
+	    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk; \
+	} \
+	_t = DWT->CYCCNT; \
+	while ((DWT->CYCCNT - _t) < (uint32_t) (x) * (SystemCoreClock / 1000000)){ } \
+	} while (0)
+#endif
+#define CC11xx_MEMORY_BARRIER()	__DMB()
+
+#endif
+
 #endif
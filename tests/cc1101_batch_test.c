@@ -0,0 +1,221 @@
+/*
+ * Host test: SPI transaction batches.
+ *
+ * Runs batches on the simulator, back to back through the plain bindings and in one spi_batch
+ * call through a backend that has one. Checks that the transactions reach the chip in the order
+ * they were added (a read sees the writes queued before it), that reads and status reads land,
+ * that the register shadow follows the writes, reads and resets of the batch, that a write of
+ * the value the chip holds is left out unless the batch changes that register or resets the chip
+ * before it, and that an overflowing batch sends nothing. Build and run from the repository root:
+ *
+ *   cc -std=c99 -DCC11xx_SIM -I. -o batch_test tests/cc1101_batch_test.c cc1101_routine.c cc1101_sim.c
+ *   ./batch_test
+ *
+ * Exits non zero on the first failure.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_sim.h"
+
+static spi_parms_t      spi_parms;
+static radio_parms_t    radio_parms;
+static cc11xx_backend_t batch_backend;
+static uint32_t         batch_calls;
+
+static int failures;
+
+// ------------------------------------------------------------------------------------------------
+static void check(int cond, const char *what, uint32_t value)
+// ------------------------------------------------------------------------------------------------
+{
+    printf("%-32s %5u: %s\n", what, value, cond ? "ok" : "FAILED");
+    failures += !cond;
+}
+
+// ------------------------------------------------------------------------------------------------
+// spi_batch of the test backend: the simulator transfers one after the other, in a single call
+static int sim_batch(void *ctx, const cc11xx_spi_op_t *op, uint8_t count, uint8_t *status)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t i;
+
+    batch_calls++;
+    for (i = 0; i < count; i++)
+    {
+        if (op[i].len == 0)
+        {
+            uint8_t cmd = op[i].cmd;
+
+            if (cc1101_sim_backend.spi_transfer(ctx, &cmd, &status[i], 1) != 0)
+            {
+                return 1;
+            }
+        }
+        else if (cc1101_sim_backend.spi_transfer_sg(ctx, op[i].cmd, &status[i], op[i].tx, op[i].rx, op[i].len) != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Configure the default chip, through the backend with spi_batch or the plain bindings
+static void setup(int batching)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_init(NULL);
+
+    memset(&spi_parms, 0, sizeof(spi_parms));
+    memset(&radio_parms, 0, sizeof(radio_parms));
+    if (batching)
+    {
+        batch_backend = cc1101_sim_backend;
+        batch_backend.spi_batch = sim_batch;
+        spi_parms.backend = &batch_backend;
+        spi_parms.backend_ctx = cc1101_sim_default();
+    }
+    batch_calls = 0;
+    set_freq_parameters(433e6, 304e3, 0, &radio_parms);
+    set_sync_parameters(PREAMBLE_4, SYNC_30_over_32, 5000, &radio_parms);
+    set_packet_parameters(255, false, false, &radio_parms);
+    set_packet_length_mode(PACKET_LENGTH_VARIABLE, &radio_parms);
+    set_modulation_parameters(RADIO_MOD_GFSK, RATE_115200, 0.5, &radio_parms);
+    init_radio_config(&spi_parms, &radio_parms);
+}
+
+// ------------------------------------------------------------------------------------------------
+// SPI transactions the simulated chip has seen so far
+static uint32_t transactions(void)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_stats_t stats;
+
+    cc1101_sim_get_stats(cc1101_sim_default(), &stats);
+    return stats.spi_transactions;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Transactions run in order, reads land, the shadow follows
+static void test_order(int batching)
+// ------------------------------------------------------------------------------------------------
+{
+    cc11xx_batch_t batch;
+    uint8_t  first = 0, second = 0, marcstate = 0, sync[2] = { 0, 0 };
+    uint8_t  burst[2] = { 0x5A, 0xA5 };
+    uint32_t before, counted;
+    int      ret;
+
+    setup(batching);
+    before = transactions();
+    counted = spi_parms.transactions;
+    CC_BatchInit(&batch, &spi_parms);
+    CC_BatchWriteReg(&batch, CC11xx_PKTLEN, 10);
+    CC_BatchReadReg(&batch, CC11xx_PKTLEN, &first);
+    CC_BatchWriteReg(&batch, CC11xx_PKTLEN, 20);
+    CC_BatchReadReg(&batch, CC11xx_PKTLEN, &second);
+    CC_BatchWriteBurst(&batch, CC11xx_SYNC1, burst, 2);
+    CC_BatchReadBurst(&batch, CC11xx_SYNC1, sync, 2);
+    CC_BatchReadStatus(&batch, CC11xx_MARCSTATE, &marcstate);
+    ret = CC_BatchRun(&batch);
+
+    check(ret == 0, batching ? "spi_batch: run" : "back to back: run", batch.count);
+    check(batch_calls == (batching ? 1u : 0u), "backend spi_batch calls", batch_calls);
+    check(transactions() == before + 7, "one transaction each", transactions() - before);
+    check(first == 10, "read after the first write", first);
+    check(second == 20, "read after the second write", second);
+    check((sync[0] == 0x5A) && (sync[1] == 0xA5), "burst read after burst write", sync[1]);
+    check((marcstate & 0x1F) == 0x01, "status read: MARCSTATE IDLE", marcstate);
+    check(cc1101_sim_reg(cc1101_sim_default(), CC11xx_PKTLEN) == 20, "chip holds the last write",
+          cc1101_sim_reg(cc1101_sim_default(), CC11xx_PKTLEN));
+    check((spi_parms.shadow[CC11xx_PKTLEN] == 20) && (spi_parms.shadow[CC11xx_SYNC0] == 0xA5),
+          "shadow follows the batch", spi_parms.shadow[CC11xx_PKTLEN]);
+    check(spi_parms.transactions == counted + 7, "driver counts them", spi_parms.transactions - counted);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Redundant writes are left out, unless the batch changes the register or resets the chip first
+static void test_redundant(int batching)
+// ------------------------------------------------------------------------------------------------
+{
+    cc11xx_batch_t batch;
+    uint8_t  pktlen, byte = 0;
+    uint32_t before, avoided;
+
+    setup(batching);
+    pktlen = cc1101_sim_reg(cc1101_sim_default(), CC11xx_PKTLEN);
+    avoided = spi_parms.writes_avoided;
+
+    CC_BatchInit(&batch, &spi_parms);
+    CC_BatchWriteReg(&batch, CC11xx_PKTLEN, pktlen);
+    check(batch.count == 0, "held value: left out", batch.count);
+    check(spi_parms.writes_avoided == avoided + 1, "held value: avoided", spi_parms.writes_avoided - avoided);
+
+    CC_BatchWriteReg(&batch, CC11xx_PKTLEN, 33);
+    CC_BatchWriteReg(&batch, CC11xx_PKTLEN, pktlen);
+    check(batch.count == 2, "changed in the batch: kept", batch.count);
+    CC_BatchWriteReg(&batch, CC11xx_FSCAL3, 0xE9);
+    check(batch.count == 3, "FSCAL3: kept", batch.count);
+    before = transactions();
+    CC_BatchRun(&batch);
+    check(transactions() == before + 3, "batch sent", transactions() - before);
+    check(cc1101_sim_reg(cc1101_sim_default(), CC11xx_PKTLEN) == pktlen, "value back on the chip",
+          cc1101_sim_reg(cc1101_sim_default(), CC11xx_PKTLEN));
+
+    // Reset in the batch: the shadow is stale past it, the write must go
+    CC_BatchInit(&batch, &spi_parms);
+    CC_BatchStrobe(&batch, CC11xx_SRES);
+    CC_BatchWriteReg(&batch, CC11xx_CHANNR, spi_parms.shadow[CC11xx_CHANNR]);
+    check(batch.count == 2, "after SRES: kept", batch.count);
+    CC_BatchReadReg(&batch, CC11xx_ADDR, &byte);
+    CC_BatchRun(&batch);
+    cc1101_sim_run_for(1000000);
+    check(spi_parms.shadow_valid == (((uint64_t) 1 << CC11xx_CHANNR) | ((uint64_t) 1 << CC11xx_ADDR)),
+          "after SRES: batch writes only", 2);
+    check(spi_parms.shadow[CC11xx_ADDR] == byte, "read refreshes the shadow", byte);
+
+    CC_BatchInit(&batch, &spi_parms);
+    CC_BatchWriteReg(&batch, CC11xx_ADDR, byte);
+    check(batch.count == 0, "read value: left out", batch.count);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Too many transactions: nothing goes out
+static void test_overflow(int batching)
+// ------------------------------------------------------------------------------------------------
+{
+    cc11xx_batch_t batch;
+    uint32_t i, before;
+    int      ret;
+
+    setup(batching);
+    CC_BatchInit(&batch, &spi_parms);
+    for (i = 0; i <= CC11xx_SPI_QUEUE_DEPTH; i++)
+    {
+        CC_BatchStrobe(&batch, CC11xx_SNOP);
+    }
+    before = transactions();
+    ret = CC_BatchRun(&batch);
+    check((ret == 1) && batch.overflow, "overflow: refused", i);
+    check(transactions() == before, "overflow: nothing sent", transactions() - before);
+}
+
+// ------------------------------------------------------------------------------------------------
+int main(void)
+// ------------------------------------------------------------------------------------------------
+{
+    int batching;
+
+    for (batching = 0; batching < 2; batching++)
+    {
+        test_order(batching);
+        test_redundant(batching);
+        test_overflow(batching);
+    }
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
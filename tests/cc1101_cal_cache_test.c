@@ -0,0 +1,178 @@
+/*
+ * Host test: calibration cache of the frequency hopping and channel plan paths.
+ *
+ * Calibrates a channel plan larger than the cache and checks through the simulator that the
+ * channels that found room are counted once and retuned without a calibration, that the ones
+ * left out calibrate on the way to RX, that a full cache refuses new channels but calibrates
+ * cached ones again, that a refused calibration leaves the free slots alone, and that a hop is
+ * refused until its channel is calibrated. Build and run from the repository root:
+ *
+ *   cc -std=c99 -DCC11xx_SIM -I. -o cal_test tests/cc1101_cal_cache_test.c cc1101_routine.c cc1101_sim.c
+ *   ./cal_test
+ *
+ * Exits non zero on the first failure.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_sim.h"
+
+#define PLAN_CHANNELS (CC11xx_CAL_CHANNELS + 4)
+
+static radio_int_data_t radio_int_data;
+static spi_parms_t      spi_parms;
+static radio_parms_t    radio_parms;
+
+static int failures;
+
+// ------------------------------------------------------------------------------------------------
+static void check(int cond, const char *what, uint32_t value)
+// ------------------------------------------------------------------------------------------------
+{
+    printf("%-32s %5u: %s\n", what, value, cond ? "ok" : "FAILED");
+    failures += !cond;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Bring up the default chip with a channel plan of PLAN_CHANNELS
+static void setup(void)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_init(NULL);
+
+    memset((void *) &radio_int_data, 0, sizeof(radio_int_data)); // Empty calibration cache
+    memset(&spi_parms, 0, sizeof(spi_parms));
+    memset(&radio_parms, 0, sizeof(radio_parms));
+    set_freq_parameters(433e6, 304e3, 0, &radio_parms);
+    set_channel_plan(433e6, 200000, PLAN_CHANNELS, &radio_parms);
+    set_sync_parameters(PREAMBLE_4, SYNC_30_over_32, 5000, &radio_parms);
+    set_packet_parameters(255, false, false, &radio_parms);
+    set_packet_length_mode(PACKET_LENGTH_VARIABLE, &radio_parms);
+    set_modulation_parameters(RADIO_MOD_GFSK, RATE_115200, 0.5, &radio_parms);
+    init_radio_config(&spi_parms, &radio_parms);
+
+    cc1101_sim_attach_radio(cc1101_sim_default(), &radio_int_data);
+    enable_isr_routine(&radio_int_data, &spi_parms, &radio_parms);
+    cc1101_sim_run_for(2000000);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Calibrations the simulated chip has run so far
+static uint32_t calibrations(void)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_stats_t stats;
+
+    cc1101_sim_get_stats(cc1101_sim_default(), &stats);
+    return stats.calibrations;
+}
+
+// ------------------------------------------------------------------------------------------------
+// A packet gets through on the current channel
+static int receive_one(uint8_t seed)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  frame[41], packet[256];
+    uint8_t  length = 0;
+    uint32_t i;
+
+    frame[0] = 40;
+    for (i = 0; i < 40; i++)
+    {
+        frame[1 + i] = (uint8_t) (i * 5 + seed);
+    }
+    cc1101_sim_inject(cc1101_sim_default(), frame, sizeof(frame), 1000000, -50, true);
+    cc1101_sim_run_for(20000000);
+    return (radio_receive_packet(&radio_int_data, packet, &length, NULL) == 0) && (length == 40)
+        && (memcmp(packet, frame + 1, 40) == 0);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Channel plan larger than the cache: hits skip the calibration, misses calibrate
+static void test_plan(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t before;
+
+    setup();
+    check(radio_cal_plan(&radio_int_data) == 1, "plan larger than the cache", PLAN_CHANNELS);
+    check(radio_int_data.cal.count == CC11xx_CAL_CHANNELS, "channels cached", radio_int_data.cal.count);
+
+    before = calibrations();
+    check(radio_set_channel(&radio_int_data, 3, NULL) == 0, "set cached channel", 3);
+    check(calibrations() == before, "hit: no calibration", calibrations() - before);
+    check(cc1101_sim_reg(cc1101_sim_default(), CC11xx_MCSM0) == 0x08, "hit: autocalibration off", 3);
+    check(receive_one(3), "hit: rx", 3);
+
+    before = calibrations();
+    check(radio_set_channel(&radio_int_data, PLAN_CHANNELS - 1, NULL) == 0, "set uncached channel", PLAN_CHANNELS - 1);
+    check(calibrations() == before + 1, "miss: calibration", calibrations() - before);
+    check(cc1101_sim_reg(cc1101_sim_default(), CC11xx_MCSM0) == 0x18, "miss: autocalibration on", PLAN_CHANNELS - 1);
+    check(receive_one(4), "miss: rx", PLAN_CHANNELS - 1);
+
+    // Full: cached channels calibrate again, new ones are refused
+    check(radio_set_channel(&radio_int_data, 5, NULL) == 0, "set cached channel", 5);
+    before = calibrations();
+    check(radio_cal_channel(&radio_int_data, 433e6) == 0, "full: cached calibrated again", 5);
+    check(calibrations() == before + 1, "full: one calibration", calibrations() - before);
+    check(radio_cal_channel(&radio_int_data, 434e6) == 1, "full: new channel refused", CC11xx_CAL_CHANNELS);
+    check(radio_int_data.cal.count == CC11xx_CAL_CHANNELS, "full: count unchanged", radio_int_data.cal.count);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Hops by frequency, a calibration refused while scanning, the cache cleared
+static void test_hops(void)
+// ------------------------------------------------------------------------------------------------
+{
+    static const float hops[] = {433.1e6, 434.3e6, 435.7e6};
+    static const uint8_t scan_channels[] = {0, 1};
+    radio_cal_entry_t free_slot;
+    radio_scan_t scan;
+    uint8_t  rssi[2];
+    uint32_t k, before;
+
+    setup();
+    check(radio_hop(&radio_int_data, hops[0], NULL) == 1, "hop before calibration", 0);
+    check(radio_int_data.radio_parms->freq_hz == 433e6, "radio stays", 0);
+
+    for (k = 0; k < 3; k++)
+    {
+        check(radio_cal_channel(&radio_int_data, hops[k]) == 0, "calibrate", k);
+    }
+    check(radio_int_data.cal.count == 3, "channels cached", radio_int_data.cal.count);
+
+    before = calibrations();
+    for (k = 0; k < 6; k++)
+    {
+        check(radio_hop(&radio_int_data, hops[k % 3], NULL) == 0, "hop", k);
+        check(receive_one((uint8_t) k), "hop rx", k);
+    }
+    check(calibrations() == before, "hops without calibration", calibrations() - before);
+    check(radio_int_data.cal.hops == 6, "hops counted", radio_int_data.cal.hops);
+
+    // Not in RX: refused before it touches the first free slot
+    check(radio_scan_start(&radio_int_data, &scan, scan_channels, 2, rssi) == 0, "scan start", 2);
+    free_slot = radio_int_data.cal.entry[radio_int_data.cal.count];
+    check(radio_cal_channel(&radio_int_data, 436.5e6) == 1, "calibrate while scanning", 0);
+    check(memcmp(&free_slot, (const void *) &radio_int_data.cal.entry[radio_int_data.cal.count], sizeof(free_slot)) == 0,
+        "free slot untouched", radio_int_data.cal.count);
+    radio_scan_stop(&radio_int_data);
+
+    radio_cal_clear(&radio_int_data);
+    check(radio_int_data.cal.count == 0, "cleared", radio_int_data.cal.count);
+    check(cc1101_sim_reg(cc1101_sim_default(), CC11xx_MCSM0) == 0x18, "autocalibration back on", 0);
+    check(radio_hop(&radio_int_data, hops[1], NULL) == 1, "hop after clear", 1);
+}
+
+// ------------------------------------------------------------------------------------------------
+int main(void)
+// ------------------------------------------------------------------------------------------------
+{
+    test_plan();
+    test_hops();
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
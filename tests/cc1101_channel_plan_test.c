@@ -0,0 +1,175 @@
+/*
+ * Host test: channel plan bounds.
+ *
+ * Checks that set_channel_plan() takes 1 to 256 channels and the spacings CHANSPC can express
+ * (25.4 to 405 kHz with a 26 MHz crystal), refuses the others without touching radio_parms, and
+ * that radio_set_channel() refuses a channel past the plan and leaves CHANNR alone. The carrier
+ * of the first and last channel, worked out from FREQ2..0, CHANNR and CHANSPC on the simulated
+ * chip, must match the plan. Build and run from the repository root:
+ *
+ *   cc -std=c99 -DCC11xx_SIM -I. -o plan_test tests/cc1101_channel_plan_test.c cc1101_routine.c cc1101_sim.c
+ *   ./plan_test
+ *
+ * Exits non zero on the first failure.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_sim.h"
+
+#define BASE_HZ     433000000.0
+
+static radio_int_data_t radio_int_data;
+static spi_parms_t      spi_parms;
+static radio_parms_t    radio_parms;
+
+static int failures;
+
+// ------------------------------------------------------------------------------------------------
+static void check(int cond, const char *what, uint32_t value)
+// ------------------------------------------------------------------------------------------------
+{
+    printf("%-32s %6u: %s\n", what, value, cond ? "ok" : "FAILED");
+    failures += !cond;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Radio parameters without a channel plan yet
+static void parms_init(void)
+// ------------------------------------------------------------------------------------------------
+{
+    memset(&radio_parms, 0, sizeof(radio_parms));
+    set_freq_parameters(BASE_HZ, 304e3, 0, &radio_parms);
+    set_sync_parameters(PREAMBLE_4, SYNC_30_over_32, 5000, &radio_parms);
+    set_packet_parameters(255, false, false, &radio_parms);
+    set_packet_length_mode(PACKET_LENGTH_VARIABLE, &radio_parms);
+    set_modulation_parameters(RADIO_MOD_GFSK, RATE_115200, 0.5, &radio_parms);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Bring up the default chip with the plan in radio_parms
+static void setup(void)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_init(NULL);
+
+    memset((void *) &radio_int_data, 0, sizeof(radio_int_data));
+    memset(&spi_parms, 0, sizeof(spi_parms));
+    init_radio_config(&spi_parms, &radio_parms);
+
+    cc1101_sim_attach_radio(cc1101_sim_default(), &radio_int_data);
+    enable_isr_routine(&radio_int_data, &spi_parms, &radio_parms);
+    cc1101_sim_run_for(2000000);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Carrier of the simulated chip from its registers, in Hz
+static double chip_carrier_hz(void)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_t *sim = cc1101_sim_default();
+    double   f_xtal = radio_parms.f_xtal;
+    uint32_t freq, channr, m, e;
+
+    freq = ((uint32_t) cc1101_sim_reg(sim, CC11xx_FREQ2) << 16) | ((uint32_t) cc1101_sim_reg(sim, CC11xx_FREQ1) << 8)
+        | cc1101_sim_reg(sim, CC11xx_FREQ0);
+    channr = cc1101_sim_reg(sim, CC11xx_CHANNR);
+    m = cc1101_sim_reg(sim, CC11xx_MDMCFG0);
+    e = cc1101_sim_reg(sim, CC11xx_MDMCFG1) & 0x03;
+
+    return (f_xtal / 65536.0) * freq + (f_xtal / 262144.0) * (256 + m) * (1u << e) * channr;
+}
+
+// ------------------------------------------------------------------------------------------------
+static uint32_t carrier_error_hz(double expected)
+// ------------------------------------------------------------------------------------------------
+{
+    double err = chip_carrier_hz() - expected;
+
+    return (uint32_t) (err < 0 ? -err : err);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Channel counts and spacings accepted and refused
+static void test_plan_bounds(void)
+// ------------------------------------------------------------------------------------------------
+{
+    static const struct { uint32_t spacing_hz; uint16_t count; int ret; const char *what; } cases[] = {
+        { 200000,   0, 1, "no channel" },
+        { 200000,   1, 0, "one channel" },
+        { 200000, 256, 0, "256 channels" },
+        { 200000, 257, 1, "257 channels" },
+        {  25000,  10, 1, "spacing below CHANSPC" },
+        {  25400,  10, 0, "smallest spacing" },
+        { 405000,  10, 0, "largest spacing" },
+        { 406000,  10, 1, "spacing above CHANSPC" },
+    };
+    uint32_t i, err;
+    int      ret;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        parms_init();
+        ret = set_channel_plan(BASE_HZ, cases[i].spacing_hz, cases[i].count, &radio_parms);
+        if (cases[i].ret)
+        {
+            check((ret == 1) && (radio_parms.chan_count == 1) && (radio_parms.chanspc_hz == 0), cases[i].what, ret);
+            continue;
+        }
+        err = (radio_parms.chanspc_hz > cases[i].spacing_hz) ? radio_parms.chanspc_hz - cases[i].spacing_hz
+            : cases[i].spacing_hz - radio_parms.chanspc_hz;
+        check((ret == 0) && (radio_parms.chan_count == cases[i].count) && (err <= 400), cases[i].what, err);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Channels past the plan are refused, the first and last ones land on their carrier
+static void test_set_channel(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t err;
+    int      ret;
+
+    parms_init();
+    set_channel_plan(BASE_HZ, 100000, 256, &radio_parms);
+    setup();
+    err = carrier_error_hz(BASE_HZ);
+    check(err < 400, "channel 0 carrier error", err);
+
+    ret = radio_set_channel(&radio_int_data, 255, NULL);
+    check((ret == 0) && (cc1101_sim_reg(cc1101_sim_default(), CC11xx_CHANNR) == 255), "last of 256 channels", 255);
+    err = carrier_error_hz(BASE_HZ + 255.0 * radio_parms.chanspc_hz);
+    check(err < 400, "channel 255 carrier error", err);
+
+    parms_init();
+    set_channel_plan(BASE_HZ, 200000, 20, &radio_parms);
+    setup();
+    ret = radio_set_channel(&radio_int_data, 19, NULL);
+    check(ret == 0, "last of 20 channels", 19);
+    err = carrier_error_hz(BASE_HZ + 19.0 * radio_parms.chanspc_hz);
+    check(err < 400, "channel 19 carrier error", err);
+
+    ret = radio_set_channel(&radio_int_data, 20, NULL);
+    check((ret == 1) && (cc1101_sim_reg(cc1101_sim_default(), CC11xx_CHANNR) == 19), "channel 20 refused", 20);
+    ret = radio_set_channel(&radio_int_data, 255, NULL);
+    check((ret == 1) && (cc1101_sim_reg(cc1101_sim_default(), CC11xx_CHANNR) == 19), "channel 255 refused", 255);
+    check(cc1101_sim_marcstate(cc1101_sim_default()) == 0x0D, "still in RX", cc1101_sim_marcstate(cc1101_sim_default()));
+
+    parms_init();
+    setup();
+    ret = radio_set_channel(&radio_int_data, 1, NULL);
+    check((ret == 1) && (cc1101_sim_reg(cc1101_sim_default(), CC11xx_CHANNR) == 0), "no plan: channel 0 only", 1);
+}
+
+// ------------------------------------------------------------------------------------------------
+int main(void)
+// ------------------------------------------------------------------------------------------------
+{
+    test_plan_bounds();
+    test_set_channel();
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Host test: CSMA/CA of the TX queue against a channel the simulator makes busy or clear.
+ *
+ * With the channel clear every frame goes after one assessment, and its backoff is drawn within
+ * the window and waited before it reaches the air. With the channel busy a frame is given up
+ * after the configured number of assessments, and a channel that clears meanwhile lets it through
+ * at the next one. Build and run from the repository root:
+ *
+ *   cc -std=c99 -DCC11xx_SIM -I. -o csma_test tests/cc1101_csma_test.c cc1101_routine.c cc1101_sim.c
+ *   ./csma_test
+ *
+ * Exits non zero on the first failure.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_sim.h"
+
+#define NOISE_QUIET_DBM -110.0f
+#define NOISE_BUSY_DBM  -50.0f         // Above the carrier sense threshold of the simulator
+
+#define SLOT_US         1000
+#define BACKOFF_BE      3
+
+static radio_int_data_t radio_int_data;
+static spi_parms_t      spi_parms;
+static radio_parms_t    radio_parms;
+
+static uint32_t sent_count;
+static uint64_t sent_ns;
+
+static int failures;
+
+// ------------------------------------------------------------------------------------------------
+// Count the frames put on the air and note when the last one ended
+static void tx_sink(void *ctx, const uint8_t *frame, uint32_t len, cc1101_sim_tx_status_t status)
+// ------------------------------------------------------------------------------------------------
+{
+    (void) ctx;
+    (void) frame;
+    (void) len;
+    sent_count += (status == CC11xx_SIM_TX_OK);
+    sent_ns = cc1101_sim_now_ns();
+}
+
+// ------------------------------------------------------------------------------------------------
+static void check(int cond, const char *what, uint32_t value)
+// ------------------------------------------------------------------------------------------------
+{
+    printf("%-32s %5u: %s\n", what, value, cond ? "ok" : "FAILED");
+    failures += !cond;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Bring up the default chip on a quiet channel with the given CSMA/CA settings
+static void setup(const radio_csma_parms_t *csma)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_init(NULL);
+    cc1101_sim_set_noise(NOISE_QUIET_DBM);
+
+    memset((void *) &radio_int_data, 0, sizeof(radio_int_data)); // CSMA/CA counters from zero
+    memset(&spi_parms, 0, sizeof(spi_parms));
+    memset(&radio_parms, 0, sizeof(radio_parms));
+    set_freq_parameters(433e6, 304e3, 0, &radio_parms);
+    set_sync_parameters(PREAMBLE_4, SYNC_30_over_32, 5000, &radio_parms);
+    set_packet_parameters(255, false, false, &radio_parms);
+    set_packet_length_mode(PACKET_LENGTH_VARIABLE, &radio_parms);
+    set_modulation_parameters(RADIO_MOD_GFSK, RATE_115200, 0.5, &radio_parms);
+    init_radio_config(&spi_parms, &radio_parms);
+
+    cc1101_sim_attach_radio(cc1101_sim_default(), &radio_int_data);
+    enable_isr_routine(&radio_int_data, &spi_parms, &radio_parms);
+    cc1101_sim_set_tx_sink(cc1101_sim_default(), tx_sink, NULL);
+    check(radio_csma_config(&radio_int_data, csma) == 0, "csma config", 0);
+    cc1101_sim_run_for(2000000);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Run radio_tx_process() until the ticket is settled
+static radio_tx_status_t tx_wait(uint32_t ticket)
+// ------------------------------------------------------------------------------------------------
+{
+    int i;
+
+    for (i = 0; i < 5000 && radio_tx_status(&radio_int_data, ticket) == RADIO_TX_PENDING; i++)
+    {
+        radio_tx_process(&radio_int_data);
+        cc1101_sim_sleep_us(200);
+    }
+
+    return radio_tx_status(&radio_int_data, ticket);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Clear channel: one assessment per frame, backoffs within the window and waited for
+static void test_clear(void)
+// ------------------------------------------------------------------------------------------------
+{
+    static const radio_csma_parms_t csma = {SLOT_US, BACKOFF_BE, BACKOFF_BE, CC11xx_CSMA_ATTEMPTS, 0};
+    uint8_t  frame[20] = {1, 2, 3};
+    uint8_t  seen[1 << BACKOFF_BE];
+    radio_csma_stats_t stats;
+    uint32_t k, ticket, slots, prev_slots = 0, distinct = 0, in_window = 0, waited = 0, sent = 0;
+    uint64_t start_ns;
+
+    setup(&csma);
+    memset(seen, 0, sizeof(seen));
+
+    for (k = 0; k < 24; k++)
+    {
+        start_ns = cc1101_sim_now_ns();
+        radio_tx_enqueue(&radio_int_data, frame, sizeof(frame), &ticket);
+        sent += (tx_wait(ticket) == RADIO_TX_SENT);
+
+        radio_csma_stats(&radio_int_data, &stats);
+        slots = stats.backoff_slots - prev_slots;
+        prev_slots = stats.backoff_slots;
+        in_window += (slots < (1u << BACKOFF_BE));
+        if (slots < (1u << BACKOFF_BE) && !seen[slots])
+        {
+            seen[slots] = 1;
+            distinct++;
+        }
+        waited += (sent_ns - start_ns >= (uint64_t) slots * SLOT_US * 1000);
+    }
+
+    radio_csma_stats(&radio_int_data, &stats);
+    check(sent == 24 && sent_count == 24, "frames sent", sent);
+    check(stats.assessments == 24 && stats.busy == 0, "one assessment each", stats.assessments);
+    check(stats.clear_at[0] == 24, "clear at first", stats.clear_at[0]);
+    check(in_window == 24, "backoff within 2^be", in_window);
+    check(distinct >= 4, "backoffs spread", distinct);
+    check(waited == 24, "backoff waited", waited);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Busy channel: the frame is given up after max_attempts assessments
+static void test_busy(void)
+// ------------------------------------------------------------------------------------------------
+{
+    static const radio_csma_parms_t csma = {0, CC11xx_CSMA_MIN_BE, CC11xx_CSMA_MAX_BE, 3, 0};
+    uint8_t  frame[20] = {4, 5, 6};
+    radio_csma_stats_t stats;
+    radio_stats_t radio_stats;
+    uint32_t ticket;
+
+    setup(&csma);
+    sent_count = 0;
+    cc1101_sim_set_noise(NOISE_BUSY_DBM);
+    radio_tx_enqueue(&radio_int_data, frame, sizeof(frame), &ticket);
+    check(tx_wait(ticket) == RADIO_TX_CCA_FAILED, "busy: given up", ticket);
+
+    radio_csma_stats(&radio_int_data, &stats);
+    radio_get_stats(&radio_int_data, &radio_stats);
+    check(stats.assessments == 3 && stats.busy == 3, "busy: assessments", stats.assessments);
+    check(stats.failures == 1 && radio_stats.tx_cca_failures == 1, "busy: failure counted", stats.failures);
+    check(sent_count == 0, "busy: nothing on air", sent_count);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Channel clearing after two busy assessments: sent at the third one
+static void test_busy_then_clear(void)
+// ------------------------------------------------------------------------------------------------
+{
+    static const radio_csma_parms_t csma = {0, CC11xx_CSMA_MIN_BE, CC11xx_CSMA_MAX_BE, CC11xx_CSMA_ATTEMPTS, 0};
+    uint8_t  frame[20] = {7, 8, 9};
+    radio_csma_stats_t stats;
+    uint32_t i, ticket;
+
+    setup(&csma);
+    sent_count = 0;
+    cc1101_sim_set_noise(NOISE_BUSY_DBM);
+    radio_tx_enqueue(&radio_int_data, frame, sizeof(frame), &ticket);
+    for (i = 0, stats.busy = 0; (i < 5000) && (stats.busy < 2); i++)
+    {
+        radio_tx_process(&radio_int_data);
+        cc1101_sim_sleep_us(100);
+        radio_csma_stats(&radio_int_data, &stats);
+    }
+    cc1101_sim_set_noise(NOISE_QUIET_DBM);
+    i = (tx_wait(ticket) == RADIO_TX_SENT);
+    check(i && sent_count == 1, "cleared: sent", sent_count);
+
+    radio_csma_stats(&radio_int_data, &stats);
+    check(stats.busy == 2 && stats.assessments == 3, "cleared: assessments", stats.assessments);
+    check(stats.clear_at[2] == 1, "cleared: clear at third", stats.clear_at[2]);
+}
+
+// ------------------------------------------------------------------------------------------------
+int main(void)
+// ------------------------------------------------------------------------------------------------
+{
+    test_clear();
+    test_busy();
+    test_busy_then_clear();
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
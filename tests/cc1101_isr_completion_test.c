@@ -0,0 +1,227 @@
+/*
+ * Host test: no blocking SPI access from an SPI completion callback.
+ *
+ * Runs variable length packets, fixed length streams and an RX FIFO overflow through the
+ * simulator with spi_isr_strict set, so that a bus wait from a completion callback (a hang
+ * on a microcontroller) aborts the test. Build and run from the repository root:
+ *
+ *   cc -std=c99 -DCC11xx_SIM -I. -o isr_test tests/cc1101_isr_completion_test.c cc1101_routine.c cc1101_sim.c
+ *   ./isr_test
+ *
+ * Exits non zero on the first failure.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_sim.h"
+
+static radio_int_data_t radio_int_data;
+static spi_parms_t      spi_parms;
+static radio_parms_t    radio_parms;
+
+static uint8_t  sent[CC11xx_SIM_FRAME_MAX];
+static uint32_t sent_len;
+static int      sent_status = -1;
+
+static uint8_t  stream_buf[8000];
+static uint32_t stream_len;
+static int      stream_crc = -1;
+
+static int failures;
+
+// ------------------------------------------------------------------------------------------------
+// Capture the frames put on the air
+static void tx_sink(void *ctx, const uint8_t *frame, uint32_t len, cc1101_sim_tx_status_t status)
+// ------------------------------------------------------------------------------------------------
+{
+    (void) ctx;
+    memcpy(sent, frame, len);
+    sent_len = len;
+    sent_status = status;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Stream reception complete
+static void stream_done(radio_int_data_t *radio, uint8_t *data, uint32_t length, uint8_t crc_ok)
+// ------------------------------------------------------------------------------------------------
+{
+    (void) radio;
+    (void) data;
+    stream_len = length;
+    stream_crc = crc_ok;
+}
+
+// ------------------------------------------------------------------------------------------------
+static void check(int cond, const char *what, uint32_t length)
+// ------------------------------------------------------------------------------------------------
+{
+    printf("%-28s %5u: %s\n", what, length, cond ? "ok" : "FAILED");
+    failures += !cond;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Bring up the default chip with strict completion interrupts
+static void setup(packet_length_t length_mode)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_config_t cfg;
+
+    cc1101_sim_default_config(&cfg);
+    cfg.spi_isr_strict = true;
+    cc1101_sim_init(&cfg);
+
+    memset(&spi_parms, 0, sizeof(spi_parms));
+    memset(&radio_parms, 0, sizeof(radio_parms));
+    set_freq_parameters(433e6, 304e3, 0, &radio_parms);
+    set_sync_parameters(PREAMBLE_4, SYNC_30_over_32, 5000, &radio_parms);
+    set_packet_parameters(255, false, false, &radio_parms);
+    set_packet_length_mode(length_mode, &radio_parms);
+    set_modulation_parameters(RADIO_MOD_GFSK, RATE_115200, 0.5, &radio_parms);
+    init_radio_config(&spi_parms, &radio_parms);
+
+    cc1101_sim_attach_radio(cc1101_sim_default(), &radio_int_data);
+    enable_isr_routine(&radio_int_data, &spi_parms, &radio_parms);
+    cc1101_sim_set_tx_sink(cc1101_sim_default(), tx_sink, NULL);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Transmit with radio_tx_process until the ticket is settled
+static radio_tx_status_t tx_wait(uint32_t ticket)
+// ------------------------------------------------------------------------------------------------
+{
+    int i;
+
+    for (i = 0; i < 2000 && radio_tx_status(&radio_int_data, ticket) == RADIO_TX_PENDING; i++)
+    {
+        radio_tx_process(&radio_int_data);
+        cc1101_sim_sleep_us(1000);
+    }
+
+    return radio_tx_status(&radio_int_data, ticket);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Variable length packets longer than the FIFO, both directions
+static void test_packets(void)
+// ------------------------------------------------------------------------------------------------
+{
+    static const uint32_t lengths[] = {10, 61, 62, 63, 64, 120, 200, 254};
+    uint8_t  frame[256], packet[256];
+    uint32_t k, i, ticket;
+    uint8_t  length;
+
+    setup(PACKET_LENGTH_VARIABLE);
+
+    for (k = 0; k < sizeof(lengths) / sizeof(lengths[0]); k++)
+    {
+        frame[0] = lengths[k];
+
+        for (i = 0; i < lengths[k]; i++)
+        {
+            frame[1 + i] = (uint8_t) (i * 13 + k);
+        }
+
+        cc1101_sim_inject(cc1101_sim_default(), frame, lengths[k] + 1, 1000000, -50, true);
+        cc1101_sim_run_for(lengths[k] * 100000ULL + 20000000);
+        length = 0;
+        check(radio_receive_packet(&radio_int_data, packet, &length, NULL) == 0 && length == lengths[k]
+            && memcmp(packet, frame + 1, length) == 0, "packet rx", lengths[k]);
+
+        sent_status = -1;
+        radio_tx_enqueue(&radio_int_data, frame + 1, lengths[k], &ticket);
+        check(tx_wait(ticket) == RADIO_TX_SENT && sent_status == CC11xx_SIM_TX_OK
+            && sent_len == lengths[k] + 1 && memcmp(sent, frame, sent_len) == 0, "packet tx", lengths[k]);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Streams switching to fixed length for their tail, both directions
+static void test_streams(void)
+// ------------------------------------------------------------------------------------------------
+{
+    static const uint32_t lengths[] = {256, 257, 448, 449, 512, 1000, 4000};
+    static uint8_t frame[4002];
+    uint32_t k, i, ticket;
+
+    setup(PACKET_LENGTH_INFINITE);
+    radio_stream_rx_buffer(&radio_int_data, stream_buf, sizeof(stream_buf), stream_done);
+
+    for (k = 0; k < sizeof(lengths) / sizeof(lengths[0]); k++)
+    {
+        frame[0] = lengths[k] >> 8;
+        frame[1] = lengths[k] & 0xFF;
+
+        for (i = 0; i < lengths[k]; i++)
+        {
+            frame[2 + i] = (uint8_t) (i * 7 + k);
+        }
+
+        stream_len = 0;
+        stream_crc = -1;
+        cc1101_sim_inject(cc1101_sim_default(), frame, lengths[k] + 2, 1000000, -50, true);
+        cc1101_sim_run_for(lengths[k] * 100000ULL + 20000000);
+        check(stream_len == lengths[k] && stream_crc == 1 && memcmp(stream_buf, frame + 2, stream_len) == 0,
+            "stream rx", lengths[k]);
+
+        sent_status = -1;
+        radio_send_stream(&radio_int_data, frame + 2, lengths[k], &ticket);
+        check(tx_wait(ticket) == RADIO_TX_SENT && sent_status == CC11xx_SIM_TX_OK
+            && sent_len == lengths[k] + 2 && memcmp(sent, frame, sent_len) == 0, "stream tx", lengths[k]);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// RX FIFO overflow while the interrupts are masked, then a clean packet
+static void test_overflow(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  frame[256], packet[256];
+    radio_stats_t stats;
+    uint32_t i;
+    uint8_t  length = 0;
+
+    setup(PACKET_LENGTH_VARIABLE);
+
+    frame[0] = 200;
+
+    for (i = 0; i < 200; i++)
+    {
+        frame[1 + i] = (uint8_t) i;
+    }
+
+    cc1101_sim_inject(cc1101_sim_default(), frame, 201, 1000000, -50, true);
+    cc1101_sim_run_for(2500000);
+    cc1101_sim_it_disable();
+    cc1101_sim_run_for(10000000);
+    cc1101_sim_it_enable();
+    cc1101_sim_run_for(20000000);
+    radio_get_stats(&radio_int_data, &stats);
+    check(stats.rx_overflows == 1, "overflow counted", 200);
+
+    cc1101_sim_inject(cc1101_sim_default(), frame, 201, 1000000, -50, true);
+    cc1101_sim_run_for(40000000);
+    check(radio_receive_packet(&radio_int_data, packet, &length, NULL) == 0 && length == 200
+        && memcmp(packet, frame + 1, length) == 0, "rx after overflow", 200);
+}
+
+// ------------------------------------------------------------------------------------------------
+int main(void)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_stats_t stats;
+
+    test_packets();
+    cc1101_sim_get_stats(cc1101_sim_default(), &stats);
+    check(stats.spi_isr_waits == 0, "bus waits in completions", stats.spi_isr_waits);
+    test_streams();
+    cc1101_sim_get_stats(cc1101_sim_default(), &stats);
+    check(stats.spi_isr_waits == 0, "bus waits in completions", stats.spi_isr_waits);
+    test_overflow();
+    cc1101_sim_get_stats(cc1101_sim_default(), &stats);
+    check(stats.spi_isr_waits == 0, "bus waits in completions", stats.spi_isr_waits);
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
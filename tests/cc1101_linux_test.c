@@ -0,0 +1,275 @@
+/*
+ * Host test: the Linux backend (cc1101_linux.c) against a spidev/GPIO stand-in.
+ *
+ * open() and ioctl() are wrapped at link time: the spidev node runs each SPI_IOC_MESSAGE on a
+ * simulated chip, the GPIO line request gets a pipe that carries a line event for every GDO edge
+ * of that chip. A second simulated chip on the plain simulator backend is the peer on the air.
+ * The simulator is shared with the event thread, so it is driven under sim_lock. Build and run
+ * from the repository root:
+ *
+ *   cc -std=c99 -DCC11xx_LINUX -I. -o linux_test tests/cc1101_linux_test.c cc1101_routine.c \
+ *      cc1101_linux.c cc1101_sim.c -lpthread -Wl,--wrap=open,--wrap=ioctl
+ *   ./linux_test
+ *
+ * Exits non zero when a packet is lost or no SPI_IOC_MESSAGE carries a batch.
+ */
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_linux.h"
+#include "cc1101_sim.h"
+
+#define SPI_DEV     "/dev/spidev-sim"
+#define GPIO_CHIP   "/dev/gpiochip-sim"
+#define GDO0_LINE   24
+#define GDO2_LINE   25
+
+int __real_open(const char *path, int flags, ...);
+int __real_ioctl(int fd, unsigned long req, ...);
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static cc1101_sim_t *chip, *peer;
+static int spi_fd = -1, event_fd = -1;
+static uint32_t event_seqno, messages;
+
+static radio_int_data_t radio, radio_peer;
+static spi_parms_t      spi_parms, spi_peer;
+static radio_parms_t    radio_parms;
+
+// ------------------------------------------------------------------------------------------------
+// The stand-in device nodes are /dev/null, the others are opened for real
+int __wrap_open(const char *path, int flags, ...)
+// ------------------------------------------------------------------------------------------------
+{
+    va_list ap;
+    int fd, mode;
+
+    if (!strcmp(path, SPI_DEV) || !strcmp(path, GPIO_CHIP)){
+        fd = __real_open("/dev/null", O_RDWR);
+        if (!strcmp(path, SPI_DEV)){
+            spi_fd = fd;
+        }
+        return fd;
+    }
+    va_start(ap, flags);
+    mode = va_arg(ap, int);
+    va_end(ap);
+    return __real_open(path, flags, mode);
+}
+
+// ------------------------------------------------------------------------------------------------
+// GDO edge of the chip: queue the line event the kernel would
+static void line_event(int gdo2)
+// ------------------------------------------------------------------------------------------------
+{
+    struct gpio_v2_line_event event;
+    int level = gdo2 ? cc1101_sim_backend.gdo2(chip) : cc1101_sim_backend.gdo0(chip);
+
+    memset(&event, 0, sizeof(event));
+    event.id = level ? GPIO_V2_LINE_EVENT_RISING_EDGE : GPIO_V2_LINE_EVENT_FALLING_EDGE;
+    event.offset = gdo2 ? GDO2_LINE : GDO0_LINE;
+    event.seqno = ++event_seqno;
+    if (write(event_fd, &event, sizeof(event)) != sizeof(event)){
+        perror("line event");
+    }
+}
+
+// GDO edge callbacks of the chip
+static void gdo0_edge(void *ctx)
+{
+    (void) ctx;
+    line_event(0);
+}
+
+static void gdo2_edge(void *ctx)
+{
+    (void) ctx;
+    line_event(1);
+}
+
+// ------------------------------------------------------------------------------------------------
+// SPI_IOC_MESSAGE: the transfers up to each cs_change run as one transaction on the chip
+static int spi_message(struct spi_ioc_transfer *xfer, unsigned count)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t tx[256], rx[256];
+    unsigned i = 0, j, k, len;
+
+    messages++;
+    pthread_mutex_lock(&sim_lock);
+    while (i < count){
+        len = 0;
+        k = i;
+        do{
+            if (xfer[k].tx_buf){
+                memcpy(tx + len, (const void *) (uintptr_t) xfer[k].tx_buf, xfer[k].len);
+            }else{
+                memset(tx + len, 0, xfer[k].len);
+            }
+            len += xfer[k].len;
+        }while (!xfer[k++].cs_change && (k < count));
+        cc1101_sim_backend.spi_transfer(chip, tx, rx, len);
+        for (len = 0, j = i; j < k; j++){
+            if (xfer[j].rx_buf){
+                memcpy((void *) (uintptr_t) xfer[j].rx_buf, rx + len, xfer[j].len);
+            }
+            len += xfer[j].len;
+        }
+        i = k;
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return (int) count;
+}
+
+// ------------------------------------------------------------------------------------------------
+// GPIO line request and values, spidev messages; other ioctls pass through
+int __wrap_ioctl(int fd, unsigned long req, ...)
+// ------------------------------------------------------------------------------------------------
+{
+    va_list ap;
+    void *arg;
+    int pipe_fd[2];
+
+    va_start(ap, req);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+    if (req == GPIO_V2_GET_LINE_IOCTL){
+        if (pipe(pipe_fd)){
+            return -1;
+        }
+        event_fd = pipe_fd[1];
+        ((struct gpio_v2_line_request *) arg)->fd = pipe_fd[0];
+        cc1101_sim_attach_isr(chip, gdo0_edge, gdo2_edge, NULL, NULL);
+        return 0;
+    }
+    if (req == GPIO_V2_LINE_GET_VALUES_IOCTL){
+        pthread_mutex_lock(&sim_lock);
+        ((struct gpio_v2_line_values *) arg)->bits = cc1101_sim_backend.gdo0(chip) | (cc1101_sim_backend.gdo2(chip) << 1);
+        pthread_mutex_unlock(&sim_lock);
+        return 0;
+    }
+    if (fd == spi_fd){
+        if ((_IOC_TYPE(req) == SPI_IOC_MAGIC) && (_IOC_NR(req) == 0)){
+            return spi_message(arg, _IOC_SIZE(req) / sizeof(struct spi_ioc_transfer));
+        }
+        return 0; // Mode, word size and speed settings
+    }
+    return __real_ioctl(fd, req, arg);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Let the simulated world run in 100 us steps, the event thread running alongside
+static void run_ms(unsigned ms)
+// ------------------------------------------------------------------------------------------------
+{
+    unsigned i;
+
+    for (i = 0; i < ms * 10; i++){
+        pthread_mutex_lock(&sim_lock);
+        cc1101_sim_run_for(100000);
+        pthread_mutex_unlock(&sim_lock);
+        usleep(20);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Next packet of the peer, taken under the simulator lock. Returns 1 when none is waiting.
+static int peer_receive(uint8_t *packet, uint8_t *length)
+// ------------------------------------------------------------------------------------------------
+{
+    int ret;
+
+    pthread_mutex_lock(&sim_lock);
+    ret = radio_receive_packet(&radio_peer, packet, length, NULL);
+    pthread_mutex_unlock(&sim_lock);
+    return ret;
+}
+
+// ------------------------------------------------------------------------------------------------
+int main(void)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_linux_config_t config = {SPI_DEV, 0, GPIO_CHIP, GDO0_LINE, GDO2_LINE};
+    cc1101_linux_t lx;
+    radio_stats_t stats;
+    uint8_t frame[255], packet[255], length;
+    uint32_t ticket;
+    int k, i, received = 0, sent = 0, peer_received = 0;
+
+    cc1101_sim_init(NULL);
+    chip = cc1101_sim_default();
+    peer = cc1101_sim_add();
+
+    set_freq_parameters(433e6, 304e3, 0, &radio_parms);
+    set_sync_parameters(PREAMBLE_4, SYNC_30_over_32, 500, &radio_parms);
+    set_packet_parameters(255, false, false, &radio_parms);
+    set_modulation_parameters(RADIO_MOD_GFSK, RATE_115200, 0.5, &radio_parms);
+
+    if (cc1101_linux_open(&lx, &config, &spi_parms)){
+        perror("cc1101_linux_open");
+        return 1;
+    }
+    init_radio_config(&spi_parms, &radio_parms);
+    enable_isr_routine(&radio, &spi_parms, &radio_parms);
+    cc1101_linux_start(&lx, &radio);
+
+    pthread_mutex_lock(&sim_lock);
+    spi_peer.backend = &cc1101_sim_backend;
+    spi_peer.backend_ctx = peer;
+    init_radio_config(&spi_peer, &radio_parms);
+    cc1101_sim_attach_radio(peer, &radio_peer);
+    enable_isr_routine(&radio_peer, &spi_peer, &radio_parms);
+    pthread_mutex_unlock(&sim_lock);
+
+    for (i = 0; i < 255; i++){
+        frame[i] = (uint8_t) (i * 3);
+    }
+
+    // Reception through the line events
+    for (k = 0; k < 4; k++){
+        frame[0] = (uint8_t) k;
+        pthread_mutex_lock(&sim_lock);
+        cc1101_sim_inject(chip, frame, 255, 1000000, -50, true);
+        pthread_mutex_unlock(&sim_lock);
+        run_ms(60);
+        if ((radio_receive_packet(&radio, packet, &length, NULL) == 0) && (length == 255) && !memcmp(packet, frame, length)){
+            received++;
+        }
+    }
+    while (peer_receive(packet, &length) == 0); // The peer heard the injected frames too
+
+    // Transmission, the peer receives
+    for (k = 0; k < 3; k++){
+        frame[0] = (uint8_t) (0x40 + k);
+        radio_tx_enqueue(&radio, frame, 255, &ticket);
+        run_ms(60);
+        sent += (radio_tx_status(&radio, ticket) == RADIO_TX_SENT);
+        if ((peer_receive(packet, &length) == 0) && (length == 255) && !memcmp(packet, frame, length)){
+            peer_received++;
+        }
+    }
+
+    radio_get_stats(&radio, &stats);
+    printf("rx %d/4 tx %d/3 peer rx %d/3, messages %u (backend %u) batches %u transactions %u, events %u lost %u\n",
+        received, sent, peer_received, messages, lx.messages, stats.spi_batches, stats.spi_transactions,
+        lx.events, lx.events_lost);
+    cc1101_linux_close(&lx);
+
+    if ((received != 4) || (sent != 3) || (peer_received != 3) || (stats.spi_batches == 0) || lx.events_lost){
+        printf("FAILED\n");
+        return 1;
+    }
+    printf("passed\n");
+    return 0;
+}
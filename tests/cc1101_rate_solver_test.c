@@ -0,0 +1,193 @@
+/*
+ * Host test: radio_solve_rate() against a brute force search in double.
+ *
+ * For a set of data rates, deviations, crystals and ppm figures, the DRATE and DEVIATION words must
+ * be as close to the target as the closest words found by trying them all, and CHANBW the narrowest
+ * filter holding Carson's bandwidth plus the drift. Then the rejections: a data rate or a deviation
+ * out of reach, no filter wide enough, and set_rate_parameters() leaving radio_parms alone on them.
+ * Build and run from the repository root:
+ *
+ *   cc -std=c99 -DCC11xx_SIM -I. -o solver_test tests/cc1101_rate_solver_test.c cc1101_routine.c cc1101_sim.c -lm
+ *   ./solver_test
+ *
+ * Exits non zero on any mismatch.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_profiles.h"
+
+static const uint32_t bauds[] = {
+    30, 50, 110, 250, 1000, 1200, 4800, 9600, 10000, 38400, 50000, 100000, 115200, 250000, 500000,
+};
+
+// Modulation indexes in percent, 0 for OOK / ASK
+static const uint32_t index_pct[] = {0, 50, 100, 200, 500};
+
+static const uint32_t crystals[] = {26000000, 27000000};
+
+static const uint32_t ppms[] = {0, 10, 40};
+
+#define FREQ_HZ 868300000
+
+// ------------------------------------------------------------------------------------------------
+// (base + m) * 2^e * fx / 2^shift
+static double word_value(double fx, int base, int m, int e, int shift)
+// ------------------------------------------------------------------------------------------------
+{
+    return fx * (base + m) * pow(2, e) / pow(2, shift);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Smallest |value - target| over all mantissas and exponents
+static double best_error(double fx, double target, int base, int m_count, int e_count, int shift)
+// ------------------------------------------------------------------------------------------------
+{
+    double best = -1.0, err;
+    int m, e;
+
+    for (e = 0; e < e_count; e++)
+    {
+        for (m = 0; m < m_count; m++)
+        {
+            err = fabs(word_value(fx, base, m, e, shift) - target);
+            if ((best < 0) || (err < best))
+            {
+                best = err;
+            }
+        }
+    }
+    return best;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Narrowest filter of at least bw, 0 if none
+static double narrowest_filter(double fx, double bw)
+// ------------------------------------------------------------------------------------------------
+{
+    double best = 0.0, f;
+    int m, e;
+
+    for (e = 0; e < 4; e++)
+    {
+        for (m = 0; m < 4; m++)
+        {
+            f = floor(fx / (8.0 * (4 + m) * (1 << e)));
+            if ((f >= bw) && ((best == 0.0) || (f < best)))
+            {
+                best = f;
+            }
+        }
+    }
+    return best;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Checks one solution, returns the number of mismatches
+static int check_fit(uint32_t fx, uint32_t baud, uint32_t deviation, uint32_t ppm)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_rate_fit_t fit;
+    double err, best, drift, filter;
+    int ret, want, failures = 0;
+
+    ret = radio_solve_rate(fx, FREQ_HZ, baud, deviation, ppm, &fit);
+
+    err = fabs(word_value(fx, 256, fit.drate_m, fit.drate_e, 28) - baud);
+    best = best_error(fx, baud, 256, 256, 16, 28);
+    if (err > best + baud * 1e-6)
+    {
+        printf("%u Hz %u Baud: drate %u/%u off by %.3f, best %.3f\n", fx, baud, fit.drate_e, fit.drate_m, err, best);
+        failures++;
+    }
+    want = (best / baud > 0.01);
+
+    if (deviation != 0)
+    {
+        err = fabs(word_value(fx, 8, fit.deviat_m, fit.deviat_e, 17) - deviation);
+        best = best_error(fx, deviation, 8, 8, 8, 17);
+        if (err > best + deviation * 1e-6)
+        {
+            printf("%u Hz %u Hz dev: deviat %u/%u off by %.3f, best %.3f\n", fx, deviation, fit.deviat_e, fit.deviat_m, err, best);
+            failures++;
+        }
+        want |= (best / deviation > 0.1);
+    }
+
+    drift = floor((double) FREQ_HZ * ppm * 4 / 1000000.0);
+    filter = narrowest_filter(fx, 2.0 * (deviation + baud) + drift);
+    if ((filter != 0.0) && (fit.chanbw_hz != (uint32_t) filter))
+    {
+        printf("%u Hz %u Baud %u Hz dev %u ppm: filter %u, narrowest %.0f\n", fx, baud, deviation, ppm, fit.chanbw_hz, filter);
+        failures++;
+    }
+    want |= (filter == 0.0);
+
+    if (ret != want)
+    {
+        printf("%u Hz %u Baud %u Hz dev %u ppm: returned %d, expected %d\n", fx, baud, deviation, ppm, ret, want);
+        failures++;
+    }
+    return failures;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Rejected settings, returns the number of mismatches
+static int check_rejections(void)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_rate_fit_t fit;
+    radio_parms_t radio_parms, before;
+    int failures = 0;
+
+    failures += (radio_solve_rate(26000000, FREQ_HZ, 0, 0, 0, &fit) != 1);
+    failures += (radio_solve_rate(26000000, FREQ_HZ, 10, 0, 0, &fit) != 1);         // Below 24.8 Baud
+    failures += (radio_solve_rate(26000000, FREQ_HZ, 2000000, 0, 0, &fit) != 1);    // Above 1.6 MBaud
+    failures += (radio_solve_rate(26000000, FREQ_HZ, 50, 25, 0, &fit) != 1);        // Below 1.6 kHz
+    failures += (fit.deviat_hz < 1500) || (fit.deviat_ppm < 1000000);               // ... but reported
+    failures += (radio_solve_rate(26000000, FREQ_HZ, 9600, 500000, 0, &fit) != 1);  // Above 380 kHz
+    failures += (radio_solve_rate(26000000, FREQ_HZ, 500000, 200000, 0, &fit) != 1); // No filter
+    failures += (fit.chanbw_e != 0) || (fit.chanbw_m != 0);
+    failures += (radio_solve_rate(26000000, FREQ_HZ, 50, 1600, 0, &fit) != 0);      // Within reach
+
+    memset(&radio_parms, 0, sizeof(radio_parms));
+    set_freq_parameters(FREQ_HZ, 310000, 0, &radio_parms);
+    before = radio_parms;
+    failures += (set_rate_parameters(RADIO_MOD_FSK2, 50, 25, 10, &radio_parms, &fit) != 1);
+    failures += (memcmp(&before, &radio_parms, sizeof(radio_parms)) != 0);
+    failures += (set_rate_parameters(RADIO_MOD_FSK2, 4800, 2400, 10, &radio_parms, &fit) != 0);
+    failures += (radio_parms.drate_hz != 4800) || (radio_parms.deviat_m != fit.deviat_m);
+
+    printf("rejections: %d mismatches\n", failures);
+    return failures;
+}
+
+// ------------------------------------------------------------------------------------------------
+int main(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t x, b, k, p, checked = 0;
+    int failures = 0;
+
+    for (x = 0; x < sizeof(crystals) / sizeof(crystals[0]); x++)
+    {
+        for (b = 0; b < sizeof(bauds) / sizeof(bauds[0]); b++)
+        {
+            for (k = 0; k < sizeof(index_pct) / sizeof(index_pct[0]); k++)
+            {
+                for (p = 0; p < sizeof(ppms) / sizeof(ppms[0]); p++)
+                {
+                    failures += check_fit(crystals[x], bauds[b], bauds[b] * index_pct[k] / 100, ppms[p]);
+                    checked++;
+                }
+            }
+        }
+    }
+    failures += check_rejections();
+
+    printf("%u settings, %d mismatches: %s\n", checked, failures, failures ? "FAILED" : "passed");
+    return failures != 0;
+}
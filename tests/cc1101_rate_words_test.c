@@ -0,0 +1,117 @@
+/*
+ * Host test: register words of get_rate_words() and cc1101_profiles.h against the float formulas.
+ *
+ * For every rate_t, a set of modulation indexes and two crystals, DRATE, DEVIATION and CHANBW
+ * words are compared with the floor(log2()) formulas and the channel bandwidth limits the driver
+ * used before the words became integer arithmetic (computed here in double). Build and run from
+ * the repository root:
+ *
+ *   cc -std=c99 -DCC11xx_SIM -I. -o rate_test tests/cc1101_rate_words_test.c cc1101_routine.c cc1101_sim.c -lm
+ *   ./rate_test
+ *
+ * Exits non zero on the first mismatch.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_profiles.h"
+
+static const uint32_t rate_values[NUM_RATE] = {
+    50, 110, 300, 600, 1200, 2400, 4800, 9600,
+    14400, 19200, 28800, 38400, 57600, 76800, 115200,
+};
+
+static const double chanbw_limits[16] = {
+    812000.0, 650000.0, 541000.0, 464000.0, 406000.0, 325000.0, 270000.0, 232000.0,
+    203000.0, 162000.0, 135000.0, 116000.0, 102000.0, 81000.0, 68000.0, 58000.0
+};
+
+// Multiples of 2^-16, exact in Q16 (25.25 at 110 Baud is 2777.5 Hz)
+static const float mod_indexes[] = {0.25f, 0.5f, 0.75f, 1.0f, 1.5f, 2.0f, 3.125f, 4.0f, 25.25f};
+
+static const uint32_t crystals[] = {26000000, 27000000};
+
+static const uint8_t deviatn_110 = CC11xx_DEVIATN_WORD_Q16(CC11xx_RATE_DEVIAT_Q16(110, CC11xx_MOD_INDEX_Q16(25.25)), 26000000);
+
+// Words as the float formulas give them
+typedef struct reference_s
+{
+    uint8_t drate_e, drate_m, deviat_e, deviat_m, chanbw_e, chanbw_m;
+} reference_t;
+
+// ------------------------------------------------------------------------------------------------
+// Exponent floor(log2(v * 2^s / fx)) and mantissa v * 2^ms / (fx * 2^e) - base, saturated
+static void float_words(double v, int s, int ms, double fx, int e_max, int base, int m_max, uint8_t *e, uint8_t *m)
+// ------------------------------------------------------------------------------------------------
+{
+    double le = floor(log2(v * (1 << s) / fx));
+    double lm;
+
+    le = (le < 0) ? 0 : (le > e_max) ? e_max : le;
+    lm = floor((v * pow(2, ms)) / (fx * pow(2, le))) - base;
+    lm = (lm < 0) ? 0 : (lm > m_max) ? m_max : lm;
+    *e = (uint8_t) le;
+    *m = (uint8_t) lm;
+}
+
+// ------------------------------------------------------------------------------------------------
+static void reference_words(uint32_t rate, double mod_index, uint32_t f_xtal, reference_t *ref)
+// ------------------------------------------------------------------------------------------------
+{
+    double deviat = rate * mod_index;
+    double bw = 2.0 * (deviat + rate);
+    int i;
+
+    float_words(rate, 20, 28, f_xtal, 15, 256, 255, &ref->drate_e, &ref->drate_m);
+    float_words(deviat, 14, 17, f_xtal, 7, 8, 7, &ref->deviat_e, &ref->deviat_m);
+    for (i = 0; (i < 15) && !(bw > chanbw_limits[i]); i++);
+    ref->chanbw_e = i >> 2;
+    ref->chanbw_m = i & 0x03;
+}
+
+// ------------------------------------------------------------------------------------------------
+int main(void)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_parms_t radio_parms;
+    reference_t ref;
+    uint32_t x, k, r, checked = 0;
+    int failures = 0;
+
+    for (x = 0; x < sizeof(crystals) / sizeof(crystals[0]); x++)
+    {
+        for (k = 0; k < sizeof(mod_indexes) / sizeof(mod_indexes[0]); k++)
+        {
+            for (r = 0; r < NUM_RATE; r++)
+            {
+                memset(&radio_parms, 0, sizeof(radio_parms));
+                radio_parms.f_xtal = crystals[x];
+                get_rate_words((rate_t) r, CC11xx_MOD_INDEX_Q16(mod_indexes[k]), &radio_parms);
+                reference_words(rate_values[r], mod_indexes[k], crystals[x], &ref);
+                checked++;
+
+                if ((radio_parms.drate_e != ref.drate_e) || (radio_parms.drate_m != ref.drate_m)
+                    || (radio_parms.deviat_e != ref.deviat_e) || (radio_parms.deviat_m != ref.deviat_m)
+                    || (radio_parms.chanbw_e != ref.chanbw_e) || (radio_parms.chanbw_m != ref.chanbw_m))
+                {
+                    printf("%u Hz, %u Baud, h %.4f: drate %u/%u deviat %u/%u chanbw %u/%u, float %u/%u %u/%u %u/%u\n",
+                        crystals[x], rate_values[r], mod_indexes[k],
+                        radio_parms.drate_e, radio_parms.drate_m, radio_parms.deviat_e, radio_parms.deviat_m,
+                        radio_parms.chanbw_e, radio_parms.chanbw_m, ref.drate_e, ref.drate_m,
+                        ref.deviat_e, ref.deviat_m, ref.chanbw_e, ref.chanbw_m);
+                    failures++;
+                }
+            }
+        }
+    }
+
+    // Static data: 2777.5 Hz gives DEVIATION_M 6, not the 5 of 2777 Hz
+    printf("DEVIATN 110 Baud h 25.25: %02X\n", deviatn_110);
+    failures += (deviatn_110 != 0x06);
+
+    printf("%u settings, %d mismatches: %s\n", checked, failures, failures ? "FAILED" : "passed");
+    return failures != 0;
+}
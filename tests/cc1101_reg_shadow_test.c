@@ -0,0 +1,179 @@
+/*
+ * Host test: configuration register shadow.
+ *
+ * Checks through the simulator that init_radio_config() leaves every configuration register
+ * shadowed except FSCAL3..1, that a CC_SPIWriteReg() of the value the chip already holds is
+ * counted in writes_avoided without an SPI transaction, that a changed value and the FSCAL
+ * registers always reach the chip, that SRES and SPWD drop the shadow, and that reads and burst
+ * writes refresh it. Build and run from the repository root:
+ *
+ *   cc -std=c99 -DCC11xx_SIM -I. -o shadow_test tests/cc1101_reg_shadow_test.c cc1101_routine.c cc1101_sim.c
+ *   ./shadow_test
+ *
+ * Exits non zero on the first failure.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_sim.h"
+
+static spi_parms_t      spi_parms;
+static radio_parms_t    radio_parms;
+
+static int failures;
+
+// ------------------------------------------------------------------------------------------------
+static void check(int cond, const char *what, uint32_t value)
+// ------------------------------------------------------------------------------------------------
+{
+    printf("%-32s %5u: %s\n", what, value, cond ? "ok" : "FAILED");
+    failures += !cond;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Configure the default chip, no interrupt routine: only the accesses made here reach the bus
+static void setup(void)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_init(NULL);
+
+    memset(&spi_parms, 0, sizeof(spi_parms));
+    memset(&radio_parms, 0, sizeof(radio_parms));
+    set_freq_parameters(433e6, 304e3, 0, &radio_parms);
+    set_sync_parameters(PREAMBLE_4, SYNC_30_over_32, 5000, &radio_parms);
+    set_packet_parameters(255, false, false, &radio_parms);
+    set_packet_length_mode(PACKET_LENGTH_VARIABLE, &radio_parms);
+    set_modulation_parameters(RADIO_MOD_GFSK, RATE_115200, 0.5, &radio_parms);
+    init_radio_config(&spi_parms, &radio_parms);
+}
+
+// ------------------------------------------------------------------------------------------------
+// SPI transactions the simulated chip has seen so far
+static uint32_t transactions(void)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_stats_t stats;
+
+    cc1101_sim_get_stats(cc1101_sim_default(), &stats);
+    return stats.spi_transactions;
+}
+
+// ------------------------------------------------------------------------------------------------
+static int shadowed(uint8_t addr)
+// ------------------------------------------------------------------------------------------------
+{
+    return (spi_parms.shadow_valid >> addr) & 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Shadow after the configuration burst
+static void test_init(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t addr, missing = 0, wrong = 0;
+
+    setup();
+    for (addr = 0; addr < CC11xx_NUM_CONFIG_REGS; addr++)
+    {
+        missing += shadowed(addr) ? 0 : 1;
+        if ((addr >= CC11xx_FSCAL3) && (addr <= CC11xx_FSCAL1))
+        {
+            continue; // Written by the calibration, never cached
+        }
+        wrong += (spi_parms.shadow[addr] != cc1101_sim_reg(cc1101_sim_default(), addr)) ? 1 : 0;
+    }
+    check(missing == 3, "not shadowed: FSCAL3..1 only", missing);
+    check(!shadowed(CC11xx_FSCAL3) && !shadowed(CC11xx_FSCAL1), "FSCAL3, FSCAL1 not shadowed", 0);
+    check(wrong == 0, "shadow matches the chip", wrong);
+    check(spi_parms.writes_avoided == 0, "no write avoided yet", spi_parms.writes_avoided);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Redundant writes stay off the bus, changed values and FSCAL writes do not
+static void test_writes(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  pktlen;
+    uint32_t before;
+
+    setup();
+    pktlen = cc1101_sim_reg(cc1101_sim_default(), CC11xx_PKTLEN);
+
+    before = transactions();
+    check(CC_SPIWriteReg(&spi_parms, CC11xx_PKTLEN, pktlen) == 0, "same value", pktlen);
+    check(transactions() == before, "same value: no transaction", transactions() - before);
+    check(spi_parms.writes_avoided == 1, "same value: avoided", spi_parms.writes_avoided);
+
+    before = transactions();
+    check(CC_SPIWriteReg(&spi_parms, CC11xx_PKTLEN, 40) == 0, "changed value", 40);
+    check(transactions() == before + 1, "changed value: one transaction", transactions() - before);
+    check(cc1101_sim_reg(cc1101_sim_default(), CC11xx_PKTLEN) == 40, "changed value: on the chip",
+          cc1101_sim_reg(cc1101_sim_default(), CC11xx_PKTLEN));
+    check(spi_parms.shadow[CC11xx_PKTLEN] == 40, "changed value: shadowed", spi_parms.shadow[CC11xx_PKTLEN]);
+
+    before = transactions();
+    CC_SPIWriteReg(&spi_parms, CC11xx_PKTLEN, 40);
+    check(transactions() == before, "new value again: avoided", transactions() - before);
+    check(spi_parms.writes_avoided == 2, "writes avoided", spi_parms.writes_avoided);
+
+    before = transactions();
+    CC_SPIWriteReg(&spi_parms, CC11xx_FSCAL3, 0xE9);
+    CC_SPIWriteReg(&spi_parms, CC11xx_FSCAL3, 0xE9);
+    check(transactions() == before + 2, "FSCAL3 always written", transactions() - before);
+    check(spi_parms.writes_avoided == 2, "FSCAL3 never avoided", spi_parms.writes_avoided);
+}
+
+// ------------------------------------------------------------------------------------------------
+// SRES and SPWD drop the shadow, reads and burst writes refresh it
+static void test_refresh(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  byte = 0;
+    int      ret;
+    uint8_t  burst[2] = { 0x12, 0x34 };
+    uint32_t before;
+
+    setup();
+    CC_SPIStrobe(&spi_parms, CC11xx_SRES);
+    cc1101_sim_run_for(1000000);
+    check(spi_parms.shadow_valid == 0, "SRES: shadow dropped", 0);
+
+    before = transactions();
+    CC_SPIWriteReg(&spi_parms, CC11xx_PKTLEN, 0xFF);
+    check(transactions() == before + 1, "SRES: reset value written", transactions() - before);
+
+    CC_SPIStrobe(&spi_parms, CC11xx_SRES);
+    cc1101_sim_run_for(1000000);
+    ret = CC_SPIReadReg(&spi_parms, CC11xx_CHANNR, &byte);
+    check(ret == 0, "read CHANNR", byte);
+    check(shadowed(CC11xx_CHANNR) && (spi_parms.shadow[CC11xx_CHANNR] == byte), "read: shadowed", byte);
+    before = transactions();
+    CC_SPIWriteReg(&spi_parms, CC11xx_CHANNR, byte);
+    check(transactions() == before, "read value: write avoided", transactions() - before);
+
+    CC_SPIWriteBurstReg(&spi_parms, CC11xx_SYNC1, burst, 2);
+    check(shadowed(CC11xx_SYNC1) && shadowed(CC11xx_SYNC0), "burst: shadowed", 2);
+    before = transactions();
+    CC_SPIWriteReg(&spi_parms, CC11xx_SYNC1, 0x12);
+    CC_SPIWriteReg(&spi_parms, CC11xx_SYNC0, 0x34);
+    check(transactions() == before, "burst values: writes avoided", transactions() - before);
+
+    CC_SPIStrobe(&spi_parms, CC11xx_SPWD);
+    check(spi_parms.shadow_valid == 0, "SPWD: shadow dropped", 0);
+    CC_SPIStrobe(&spi_parms, CC11xx_SIDLE);
+    cc1101_sim_run_for(1000000);
+}
+
+// ------------------------------------------------------------------------------------------------
+int main(void)
+// ------------------------------------------------------------------------------------------------
+{
+    test_init();
+    test_writes();
+    test_refresh();
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * Host test: ring of received packets and streams without a buffer.
+ *
+ * Runs packets through the simulator into a ring left undrained, then drained one packet at a
+ * time with its indexes about to wrap around 2^32, and checks that the packets come out intact
+ * and in order and that only the packets finding the ring full are counted as overruns. A stream
+ * coming with no buffer set is counted apart. Build and run from the repository root:
+ *
+ *   cc -std=c99 -DCC11xx_SIM -I. -o ring_test tests/cc1101_rx_ring_test.c cc1101_routine.c cc1101_sim.c
+ *   ./ring_test
+ *
+ * Exits non zero on the first failure. The ring depth must be a power of two, this must not build:
+ *
+ *   cc -std=c99 -DCC11xx_SIM -DCC11xx_RX_RING_DEPTH=6 -I. -c cc1101_routine.c
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_sim.h"
+
+static radio_int_data_t radio_int_data;
+static spi_parms_t      spi_parms;
+static radio_parms_t    radio_parms;
+
+static uint8_t  stream_buf[1024];
+static uint32_t stream_len;
+
+static int failures;
+
+// ------------------------------------------------------------------------------------------------
+// Stream reception complete
+static void stream_done(radio_int_data_t *radio, uint8_t *data, uint32_t length, uint8_t crc_ok)
+// ------------------------------------------------------------------------------------------------
+{
+    (void) radio;
+    (void) data;
+    stream_len = crc_ok ? length : 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+static void check(int cond, const char *what, uint32_t value)
+// ------------------------------------------------------------------------------------------------
+{
+    printf("%-28s %5u: %s\n", what, value, cond ? "ok" : "FAILED");
+    failures += !cond;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Bring up the default chip
+static void setup(packet_length_t length_mode)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_init(NULL);
+
+    memset(&spi_parms, 0, sizeof(spi_parms));
+    memset(&radio_parms, 0, sizeof(radio_parms));
+    set_freq_parameters(433e6, 304e3, 0, &radio_parms);
+    set_sync_parameters(PREAMBLE_4, SYNC_30_over_32, 5000, &radio_parms);
+    set_packet_parameters(255, false, false, &radio_parms);
+    set_packet_length_mode(length_mode, &radio_parms);
+    set_modulation_parameters(RADIO_MOD_GFSK, RATE_115200, 0.5, &radio_parms);
+    init_radio_config(&spi_parms, &radio_parms);
+
+    cc1101_sim_attach_radio(cc1101_sim_default(), &radio_int_data);
+    enable_isr_routine(&radio_int_data, &spi_parms, &radio_parms);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Put packet number n on the air and let the driver take it
+static void inject(uint32_t n)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  frame[33];
+    uint32_t i;
+
+    frame[0] = 32;
+    for (i = 0; i < 32; i++)
+    {
+        frame[1 + i] = (uint8_t) (i + n * 11);
+    }
+    cc1101_sim_inject(cc1101_sim_default(), frame, sizeof(frame), 1000000, -50, true);
+    cc1101_sim_run_for(10000000);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Next packet of the ring is packet number n
+static int is_packet(const radio_rx_slot_t *slot, uint32_t n)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t i;
+
+    if ((slot == NULL) || (slot->length != 32) || !slot->crc_ok)
+    {
+        return 0;
+    }
+    for (i = 0; i < 32; i++)
+    {
+        if (slot->data[i] != (uint8_t) (i + n * 11))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Ring left undrained: the packets past its depth are dropped and counted
+static void test_full(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t n, in_order = 0;
+
+    setup(PACKET_LENGTH_VARIABLE);
+
+    for (n = 0; n < CC11xx_RX_RING_DEPTH + 3; n++)
+    {
+        inject(n);
+    }
+    check(radio_rx_overruns(&radio_int_data) == 3, "overruns", radio_rx_overruns(&radio_int_data));
+
+    for (n = 0; n < CC11xx_RX_RING_DEPTH; n++)
+    {
+        in_order += is_packet(radio_rx_peek(&radio_int_data), n);
+        radio_rx_release(&radio_int_data);
+    }
+    check(in_order == CC11xx_RX_RING_DEPTH, "first packets kept", in_order);
+    check(radio_rx_peek(&radio_int_data) == NULL, "ring empty", 0);
+
+    inject(100);
+    check(is_packet(radio_rx_peek(&radio_int_data), 100), "room again", 100);
+    radio_rx_release(&radio_int_data);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Indexes wrapping around 2^32, drained every packet then every other packet
+static void test_wrap(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t n, in_order = 0;
+
+    setup(PACKET_LENGTH_VARIABLE);
+    radio_int_data.rx_ring.head = UINT32_MAX - CC11xx_RX_RING_DEPTH;
+    radio_int_data.rx_ring.tail = UINT32_MAX - CC11xx_RX_RING_DEPTH;
+
+    for (n = 0; n < 3 * CC11xx_RX_RING_DEPTH; n += 2)
+    {
+        inject(n);
+        in_order += is_packet(radio_rx_peek(&radio_int_data), n);
+        radio_rx_release(&radio_int_data);
+
+        inject(n + 1);
+        inject(n + 2);
+        in_order += is_packet(radio_rx_peek(&radio_int_data), n + 1);
+        radio_rx_release(&radio_int_data);
+        in_order += is_packet(radio_rx_peek(&radio_int_data), n + 2);
+        radio_rx_release(&radio_int_data);
+    }
+    check(radio_int_data.rx_ring.head < CC11xx_RX_RING_DEPTH * 4, "head wrapped", radio_int_data.rx_ring.head);
+    check(in_order == 3 * (3 * CC11xx_RX_RING_DEPTH / 2), "packets in order", in_order);
+    check(radio_rx_overruns(&radio_int_data) == 0, "no overrun", radio_rx_overruns(&radio_int_data));
+    check(radio_rx_peek(&radio_int_data) == NULL, "ring empty", 0);
+}
+
+// ------------------------------------------------------------------------------------------------
+// A stream without a buffer is a stream drop, not a ring overrun
+static void test_stream_drop(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  frame[402];
+    radio_stats_t stats;
+    uint32_t i;
+
+    setup(PACKET_LENGTH_INFINITE);
+
+    frame[0] = 400 >> 8;
+    frame[1] = 400 & 0xFF;
+    for (i = 0; i < 400; i++)
+    {
+        frame[2 + i] = (uint8_t) (i * 3);
+    }
+
+    cc1101_sim_inject(cc1101_sim_default(), frame, sizeof(frame), 1000000, -50, true);
+    cc1101_sim_run_for(60000000);
+    radio_get_stats(&radio_int_data, &stats);
+    check(stats.rx_stream_drops == 1, "stream dropped", stats.rx_stream_drops);
+    check(radio_rx_overruns(&radio_int_data) == 0, "no overrun", radio_rx_overruns(&radio_int_data));
+
+    radio_stream_rx_buffer(&radio_int_data, stream_buf, sizeof(stream_buf), stream_done);
+    stream_len = 0;
+    cc1101_sim_inject(cc1101_sim_default(), frame, sizeof(frame), 1000000, -50, true);
+    cc1101_sim_run_for(60000000);
+    radio_get_stats(&radio_int_data, &stats);
+    check(stream_len == 400 && memcmp(stream_buf, frame + 2, 400) == 0, "stream with a buffer", stream_len);
+    check(stats.rx_stream_drops == 1, "no more drops", stats.rx_stream_drops);
+}
+
+// ------------------------------------------------------------------------------------------------
+int main(void)
+// ------------------------------------------------------------------------------------------------
+{
+    test_full();
+    test_wrap();
+    test_stream_drop();
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
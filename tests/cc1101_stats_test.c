@@ -0,0 +1,185 @@
+/*
+ * Host test: lock free statistics reader.
+ *
+ * A reader thread started while a writer holds stats_seq odd must wait for it and return the
+ * completed update, not the half written one. Packets received and sent through the simulator,
+ * stepped a few microseconds at a time, must leave stats_seq even between every step (the GDO
+ * and SPI completion writers balance, nested or not) and radio_get_stats() must match the driver
+ * counters. radio_reset_stats() is a writer too. Build and run from the repository root:
+ *
+ *   cc -std=c99 -DCC11xx_SIM -I. -o stats_test tests/cc1101_stats_test.c cc1101_routine.c cc1101_sim.c -lpthread
+ *   ./stats_test
+ *
+ * Exits non zero on the first failure.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_sim.h"
+
+static radio_int_data_t radio_int_data;
+static spi_parms_t      spi_parms;
+static radio_parms_t    radio_parms;
+
+static radio_stats_t    reader_copy;
+static volatile int     reader_done;
+
+static int failures;
+
+// ------------------------------------------------------------------------------------------------
+static void check(int cond, const char *what, uint32_t value)
+// ------------------------------------------------------------------------------------------------
+{
+    printf("%-32s %5u: %s\n", what, value, cond ? "ok" : "FAILED");
+    failures += !cond;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Bring up the default chip, statistics cleared
+static void setup(void)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_init(NULL);
+
+    memset((void *) &radio_int_data, 0, sizeof(radio_int_data));
+    memset(&spi_parms, 0, sizeof(spi_parms));
+    memset(&radio_parms, 0, sizeof(radio_parms));
+    set_freq_parameters(433e6, 304e3, 0, &radio_parms);
+    set_sync_parameters(PREAMBLE_4, SYNC_30_over_32, 5000, &radio_parms);
+    set_packet_parameters(255, false, false, &radio_parms);
+    set_packet_length_mode(PACKET_LENGTH_VARIABLE, &radio_parms);
+    set_modulation_parameters(RADIO_MOD_GFSK, RATE_115200, 0.5, &radio_parms);
+    init_radio_config(&spi_parms, &radio_parms);
+
+    cc1101_sim_attach_radio(cc1101_sim_default(), &radio_int_data);
+    enable_isr_routine(&radio_int_data, &spi_parms, &radio_parms);
+}
+
+// ------------------------------------------------------------------------------------------------
+static void *reader(void *arg)
+// ------------------------------------------------------------------------------------------------
+{
+    (void) arg;
+    radio_get_stats(&radio_int_data, &reader_copy);
+    reader_done = 1;
+    return NULL;
+}
+
+// ------------------------------------------------------------------------------------------------
+static void sleep_ms(long ms)
+// ------------------------------------------------------------------------------------------------
+{
+    struct timespec ts;
+
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+// ------------------------------------------------------------------------------------------------
+// A reader concurrent with a writer gets the completed update
+static void test_reader_waits(void)
+// ------------------------------------------------------------------------------------------------
+{
+    pthread_t thread;
+
+    memset((void *) &radio_int_data, 0, sizeof(radio_int_data));
+    radio_int_data.stats_seq = 1; // Writer in the middle of an update
+    radio_int_data.stats.rx_packets = 7;
+    reader_done = 0;
+
+    check(pthread_create(&thread, NULL, reader, NULL) == 0, "reader started", 0);
+    sleep_ms(50);
+    check(!reader_done, "odd sequence: reader waits", reader_done);
+
+    radio_int_data.stats.rx_crc_errors = 3;
+    __sync_synchronize();
+    radio_int_data.stats_seq = 2;
+    pthread_join(thread, NULL);
+    check(reader_done, "even sequence: reader returns", reader_done);
+    check((reader_copy.rx_packets == 7) && (reader_copy.rx_crc_errors == 3), "whole update copied",
+          reader_copy.rx_crc_errors);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Run the simulator in small steps, checking between each that no writer is left open
+static uint32_t run_stepped(uint64_t ns)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t odd = 0;
+    uint64_t t;
+
+    for (t = 0; t < ns; t += 5000)
+    {
+        cc1101_sim_run_for(5000);
+        odd += radio_int_data.stats_seq & 1;
+    }
+    return odd;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Writers from traffic balance, the snapshot matches the driver counters, reset clears it
+static void test_traffic(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  frame[201], packet[256];
+    uint8_t  length;
+    uint32_t i, k, ticket, odd = 0, seq, received = 0;
+    radio_stats_t stats;
+
+    setup();
+    seq = radio_int_data.stats_seq;
+
+    for (k = 0; k < 3; k++)
+    {
+        frame[0] = 200;
+        for (i = 0; i < 200; i++)
+        {
+            frame[1 + i] = (uint8_t) (i * 3 + k);
+        }
+        cc1101_sim_inject(cc1101_sim_default(), frame, sizeof(frame), 1000000, -50, true);
+        odd += run_stepped(25000000);
+        length = 0;
+        received += (radio_receive_packet(&radio_int_data, packet, &length, NULL) == 0) && (length == 200);
+
+        radio_tx_enqueue(&radio_int_data, frame + 1, 200, &ticket);
+        for (i = 0; (i < 200) && (radio_tx_status(&radio_int_data, ticket) == RADIO_TX_PENDING); i++)
+        {
+            radio_tx_process(&radio_int_data);
+            odd += run_stepped(200000);
+        }
+    }
+    check(received == 3, "packets received", received);
+    check(odd == 0, "sequence even between steps", odd);
+    check(radio_int_data.stats_seq != seq, "sequence moved", radio_int_data.stats_seq - seq);
+
+    radio_get_stats(&radio_int_data, &stats);
+    check(stats.rx_packets == 3, "rx_packets", stats.rx_packets);
+    check(stats.tx_packets == 3, "tx_packets", stats.tx_packets);
+    check(stats.spi_transactions == radio_int_data.spi.transactions, "spi_transactions", stats.spi_transactions);
+    check(stats.pkt_spi_transactions <= stats.pkt_spi_transactions_max, "last packet within max",
+          stats.pkt_spi_transactions_max);
+
+    seq = radio_int_data.stats_seq;
+    radio_reset_stats(&radio_int_data);
+    check(radio_int_data.stats_seq == seq + 2, "reset: one write", radio_int_data.stats_seq - seq);
+    radio_get_stats(&radio_int_data, &stats);
+    check((stats.rx_packets == 0) && (stats.tx_packets == 0) && (stats.spi_transactions == 0),
+          "reset: counters cleared", stats.spi_transactions);
+}
+
+// ------------------------------------------------------------------------------------------------
+int main(void)
+// ------------------------------------------------------------------------------------------------
+{
+    test_reader_waits();
+    test_traffic();
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
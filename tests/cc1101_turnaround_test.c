@@ -0,0 +1,235 @@
+/*
+ * Host test: turnaround mode (MCSM1 RXOFF_MODE FSTXON, TXOFF_MODE RX).
+ *
+ * Checks through the simulator that radio_turnaround_config() sets MCSM1 and gives it back, that
+ * after a good packet the chip waits in FSTXON and a reply queued meanwhile goes out from there
+ * without an assessment and is timed in stats.turnaround, that the chip returns to RX by itself
+ * after a frame, that it goes back to RX when nobody replies within the hold time, and that none
+ * of this calibrates. Build and run from the repository root:
+ *
+ *   cc -std=c99 -DCC11xx_SIM -I. -o turnaround_test tests/cc1101_turnaround_test.c cc1101_routine.c cc1101_sim.c
+ *   ./turnaround_test
+ *
+ * Exits non zero on the first failure.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_sim.h"
+
+#define HOLD_US     20000
+
+static radio_int_data_t radio_int_data;
+static spi_parms_t      spi_parms;
+static radio_parms_t    radio_parms;
+
+static uint8_t  sent[CC11xx_SIM_FRAME_MAX];
+static uint32_t sent_len;
+static uint32_t sent_count;
+
+static int failures;
+
+// ------------------------------------------------------------------------------------------------
+// Capture the frames put on the air
+static void tx_sink(void *ctx, const uint8_t *frame, uint32_t len, cc1101_sim_tx_status_t status)
+// ------------------------------------------------------------------------------------------------
+{
+    (void) ctx;
+    if (status == CC11xx_SIM_TX_OK)
+    {
+        memcpy(sent, frame, len);
+        sent_len = len;
+        sent_count++;
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+static void check(int cond, const char *what, uint32_t value)
+// ------------------------------------------------------------------------------------------------
+{
+    printf("%-32s %5u: %s\n", what, value, cond ? "ok" : "FAILED");
+    failures += !cond;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Bring up the default chip in turnaround mode
+static void setup(void)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_init(NULL);
+
+    memset((void *) &radio_int_data, 0, sizeof(radio_int_data));
+    memset(&spi_parms, 0, sizeof(spi_parms));
+    memset(&radio_parms, 0, sizeof(radio_parms));
+    set_freq_parameters(433e6, 304e3, 0, &radio_parms);
+    set_sync_parameters(PREAMBLE_4, SYNC_30_over_32, 5000, &radio_parms);
+    set_packet_parameters(255, false, false, &radio_parms);
+    set_packet_length_mode(PACKET_LENGTH_VARIABLE, &radio_parms);
+    set_modulation_parameters(RADIO_MOD_GFSK, RATE_115200, 0.5, &radio_parms);
+    init_radio_config(&spi_parms, &radio_parms);
+
+    cc1101_sim_attach_radio(cc1101_sim_default(), &radio_int_data);
+    enable_isr_routine(&radio_int_data, &spi_parms, &radio_parms);
+    cc1101_sim_set_tx_sink(cc1101_sim_default(), tx_sink, NULL);
+    cc1101_sim_run_for(2000000);
+    sent_count = 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Calibrations the simulated chip has run so far
+static uint32_t calibrations(void)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_stats_t stats;
+
+    cc1101_sim_get_stats(cc1101_sim_default(), &stats);
+    return stats.calibrations;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Inject a good request and run until it has been received
+static void request(uint8_t seed)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  frame[21];
+    uint32_t i;
+
+    frame[0] = 20;
+    for (i = 0; i < 20; i++)
+    {
+        frame[1 + i] = (uint8_t) (i + seed);
+    }
+    cc1101_sim_inject(cc1101_sim_default(), frame, sizeof(frame), 1000000, -50, true);
+    cc1101_sim_run_for(5000000);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Run radio_tx_process() for ms milliseconds
+static void process_for(uint32_t ms)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t i;
+
+    for (i = 0; i < ms; i++)
+    {
+        radio_tx_process(&radio_int_data);
+        cc1101_sim_sleep_us(1000);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// MCSM1 follows the turnaround configuration
+static void test_config(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t mcsm1;
+    int     ret;
+
+    setup();
+    mcsm1 = cc1101_sim_reg(cc1101_sim_default(), CC11xx_MCSM1);
+    check(mcsm1 == 0x30, "off: RXOFF, TXOFF IDLE", mcsm1);
+
+    ret = radio_turnaround_config(&radio_int_data, HOLD_US);
+    mcsm1 = cc1101_sim_reg(cc1101_sim_default(), CC11xx_MCSM1);
+    check((ret == 0) && (mcsm1 == 0x37), "on: RXOFF FSTXON, TXOFF RX", mcsm1);
+
+    ret = radio_turnaround_config(&radio_int_data, 0);
+    mcsm1 = cc1101_sim_reg(cc1101_sim_default(), CC11xx_MCSM1);
+    check((ret == 0) && (mcsm1 == 0x30), "off again", mcsm1);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Request received, reply from FSTXON without assessment, back to RX without calibration
+static void test_reply(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  reply[20], packet[256];
+    uint8_t  length = 0, state;
+    uint32_t cal, ticket;
+    int      ret;
+    radio_stats_t stats;
+    radio_csma_stats_t csma;
+
+    setup();
+    radio_turnaround_config(&radio_int_data, HOLD_US);
+    cal = calibrations();
+
+    request(1);
+    state = cc1101_sim_marcstate(cc1101_sim_default());
+    check(state == CC11xx_STATE_FSTXON, "request: chip in FSTXON", state);
+    ret = radio_receive_packet(&radio_int_data, packet, &length, NULL);
+    check((ret == 0) && (length == 20), "request received", length);
+
+    memset(reply, 0xA5, sizeof(reply));
+    radio_tx_enqueue(&radio_int_data, reply, sizeof(reply), &ticket);
+    process_for(10);
+    ret = radio_tx_status(&radio_int_data, ticket);
+    check((ret == RADIO_TX_SENT) && (sent_count == 1) && (sent_len == 21) && (memcmp(sent + 1, reply, 20) == 0),
+          "reply sent", sent_len);
+    radio_csma_stats(&radio_int_data, &csma);
+    check(csma.assessments == 0, "reply: no assessment", csma.assessments);
+    radio_get_stats(&radio_int_data, &stats);
+    check(stats.turnaround.count == 1, "reply timed", stats.turnaround.count);
+    state = cc1101_sim_marcstate(cc1101_sim_default());
+    check(state == CC11xx_STATE_RX, "after the reply: RX", state);
+
+    // A frame with no request before it: assessed, from RX straight to TX
+    radio_tx_enqueue(&radio_int_data, reply, sizeof(reply), &ticket);
+    process_for(10);
+    ret = radio_tx_status(&radio_int_data, ticket);
+    radio_csma_stats(&radio_int_data, &csma);
+    check((ret == RADIO_TX_SENT) && (sent_count == 2), "unsolicited frame sent", sent_count);
+    check(csma.assessments == 1, "unsolicited frame: assessed", csma.assessments);
+    radio_get_stats(&radio_int_data, &stats);
+    check(stats.turnaround.count == 1, "unsolicited frame: not timed", stats.turnaround.count);
+
+    check(calibrations() == cal, "no calibration", calibrations() - cal);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Nobody replies: back to RX after the hold time, without calibration, and still receiving
+static void test_no_reply(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  packet[256];
+    uint8_t  length = 0, state;
+    uint32_t cal;
+    int      ret;
+    radio_stats_t stats;
+
+    setup();
+    radio_turnaround_config(&radio_int_data, HOLD_US);
+    cal = calibrations();
+
+    request(2);
+    process_for(HOLD_US / 1000 / 2);
+    state = cc1101_sim_marcstate(cc1101_sim_default());
+    check(state == CC11xx_STATE_FSTXON, "within the hold: FSTXON", state);
+    process_for(HOLD_US / 1000 + 2);
+    state = cc1101_sim_marcstate(cc1101_sim_default());
+    check(state == CC11xx_STATE_RX, "hold over: RX", state);
+    check(sent_count == 0, "nothing sent", sent_count);
+
+    radio_receive_packet(&radio_int_data, packet, &length, NULL);
+    request(3);
+    ret = radio_receive_packet(&radio_int_data, packet, &length, NULL);
+    check((ret == 0) && (length == 20) && (packet[0] == 3), "next request received", length);
+
+    radio_get_stats(&radio_int_data, &stats);
+    check(stats.turnaround.count == 0, "no reply timed", stats.turnaround.count);
+    check(calibrations() == cal, "no calibration", calibrations() - cal);
+}
+
+// ------------------------------------------------------------------------------------------------
+int main(void)
+// ------------------------------------------------------------------------------------------------
+{
+    test_config();
+    test_reply();
+    test_no_reply();
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Host test: queued frames sent back to back in one CSMA/CA burst.
+ *
+ * Fills the TX queue with a burst airtime long enough for all of it and checks through the
+ * simulator that every frame reaches the air once, in order and intact, that every ticket ends
+ * RADIO_TX_SENT and that the frames after the first went without their own assessment. Then a
+ * packet is received to check the radio is back in RX. Build and run from the repository root:
+ *
+ *   cc -std=c99 -DCC11xx_SIM -I. -o burst_test tests/cc1101_tx_burst_test.c cc1101_routine.c cc1101_sim.c
+ *   ./burst_test
+ *
+ * Exits non zero on the first failure.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_sim.h"
+
+#define BURST_FRAMES CC11xx_TX_QUEUE_DEPTH
+
+static radio_int_data_t radio_int_data;
+static spi_parms_t      spi_parms;
+static radio_parms_t    radio_parms;
+
+static uint8_t  frames[BURST_FRAMES][256];
+static uint8_t  lengths[BURST_FRAMES] = {20, 60, 120, 40};
+
+static uint32_t sunk;
+static uint32_t sunk_bad;
+
+static int failures;
+
+typedef char burst_holds_three_frames[(BURST_FRAMES >= 3) ? 1 : -1];
+
+// ------------------------------------------------------------------------------------------------
+// Check each frame put on the air against the one queued in its place
+static void tx_sink(void *ctx, const uint8_t *frame, uint32_t len, cc1101_sim_tx_status_t status)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t k = sunk % BURST_FRAMES;
+
+    (void) ctx;
+    if ((status != CC11xx_SIM_TX_OK) || (len != lengths[k] + 1u) || (frame[0] != lengths[k])
+        || memcmp(frame + 1, frames[k], lengths[k]))
+    {
+        sunk_bad++;
+    }
+    sunk++;
+}
+
+// ------------------------------------------------------------------------------------------------
+static void check(int cond, const char *what, uint32_t value)
+// ------------------------------------------------------------------------------------------------
+{
+    printf("%-28s %5u: %s\n", what, value, cond ? "ok" : "FAILED");
+    failures += !cond;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Bring up the default chip, bursts of up to burst_us of airtime
+static void setup(uint32_t burst_us)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_csma_parms_t csma = {0, CC11xx_CSMA_MIN_BE, CC11xx_CSMA_MAX_BE, CC11xx_CSMA_ATTEMPTS, burst_us};
+
+    cc1101_sim_init(NULL);
+
+    memset(&spi_parms, 0, sizeof(spi_parms));
+    memset(&radio_parms, 0, sizeof(radio_parms));
+    set_freq_parameters(433e6, 304e3, 0, &radio_parms);
+    set_sync_parameters(PREAMBLE_4, SYNC_30_over_32, 5000, &radio_parms);
+    set_packet_parameters(255, false, false, &radio_parms);
+    set_packet_length_mode(PACKET_LENGTH_VARIABLE, &radio_parms);
+    set_modulation_parameters(RADIO_MOD_GFSK, RATE_115200, 0.5, &radio_parms);
+    init_radio_config(&spi_parms, &radio_parms);
+
+    cc1101_sim_attach_radio(cc1101_sim_default(), &radio_int_data);
+    enable_isr_routine(&radio_int_data, &spi_parms, &radio_parms);
+    cc1101_sim_set_tx_sink(cc1101_sim_default(), tx_sink, NULL);
+    radio_csma_config(&radio_int_data, &csma);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Queue a full burst and run radio_tx_process() until every ticket is settled
+static void run_burst(uint32_t round)
+// ------------------------------------------------------------------------------------------------
+{
+    uint32_t tickets[BURST_FRAMES];
+    uint32_t k, i, settled = 0;
+
+    for (k = 0; k < BURST_FRAMES; k++)
+    {
+        for (i = 0; i < lengths[k]; i++)
+        {
+            frames[k][i] = (uint8_t) (i * 7 + k + round);
+        }
+
+        check(radio_tx_enqueue(&radio_int_data, frames[k], lengths[k], &tickets[k]) == 0, "enqueue", lengths[k]);
+    }
+
+    for (i = 0; (i < 2000) && (settled < BURST_FRAMES); i++)
+    {
+        radio_tx_process(&radio_int_data);
+        cc1101_sim_sleep_us(1000);
+
+        for (k = 0, settled = 0; k < BURST_FRAMES; k++)
+        {
+            settled += (radio_tx_status(&radio_int_data, tickets[k]) != RADIO_TX_PENDING);
+        }
+    }
+
+    for (k = 0; k < BURST_FRAMES; k++)
+    {
+        check(radio_tx_status(&radio_int_data, tickets[k]) == RADIO_TX_SENT, "ticket sent", k);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+int main(void)
+// ------------------------------------------------------------------------------------------------
+{
+    radio_csma_stats_t stats;
+    uint8_t  frame[61], packet[256];
+    uint8_t  length = 0;
+    uint32_t i;
+
+    setup(1000000);
+    run_burst(0);
+    run_burst(1);
+
+    radio_csma_stats(&radio_int_data, &stats);
+    check(sunk == 2 * BURST_FRAMES, "frames on air", sunk);
+    check(sunk_bad == 0, "frames intact, in order", sunk_bad);
+    check(stats.bursts == 2, "bursts", stats.bursts);
+    check(stats.chained == 2 * (BURST_FRAMES - 1), "frames chained", stats.chained);
+    check(stats.assessments == 2, "assessments", stats.assessments);
+
+    frame[0] = 60;
+    for (i = 0; i < 60; i++)
+    {
+        frame[1 + i] = (uint8_t) (i * 3);
+    }
+    cc1101_sim_inject(cc1101_sim_default(), frame, sizeof(frame), 1000000, -50, true);
+    cc1101_sim_run_for(20000000);
+    i = (radio_receive_packet(&radio_int_data, packet, &length, NULL) == 0);
+    check(i && (length == 60) && (memcmp(packet, frame + 1, 60) == 0), "rx after burst", length);
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
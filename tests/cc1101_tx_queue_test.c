@@ -0,0 +1,197 @@
+/*
+ * Host test: completion status of the frames of the TX queue.
+ *
+ * Runs frames through the simulator to each end a ticket can have: sent, cut short by a TX FIFO
+ * underflow (interrupts masked while the frame drains), and timed out while a packet is being
+ * received past the deadline of the frame. Checks unknown tickets and that frames longer than
+ * the packet length are refused with nothing queued, in variable and fixed length modes. Build
+ * and run from the repository root:
+ *
+ *   cc -std=c99 -DCC11xx_SIM -I. -o queue_test tests/cc1101_tx_queue_test.c cc1101_routine.c cc1101_sim.c
+ *   ./queue_test
+ *
+ * Exits non zero on the first failure.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cc1101_routine.h"
+#include "cc1101_sim.h"
+
+static radio_int_data_t radio_int_data;
+static spi_parms_t      spi_parms;
+static radio_parms_t    radio_parms;
+
+static uint8_t  sent[CC11xx_SIM_FRAME_MAX];
+static uint32_t sent_len;
+
+static int failures;
+
+// ------------------------------------------------------------------------------------------------
+// Capture the frames put on the air
+static void tx_sink(void *ctx, const uint8_t *frame, uint32_t len, cc1101_sim_tx_status_t status)
+// ------------------------------------------------------------------------------------------------
+{
+    (void) ctx;
+    (void) status;
+    memcpy(sent, frame, len);
+    sent_len = len;
+}
+
+// ------------------------------------------------------------------------------------------------
+static void check(int cond, const char *what, uint32_t value)
+// ------------------------------------------------------------------------------------------------
+{
+    printf("%-32s %5u: %s\n", what, value, cond ? "ok" : "FAILED");
+    failures += !cond;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Bring up the default chip, frames given up timeout_ms after they are queued
+static void setup(packet_length_t length_mode, uint8_t packet_length, uint32_t timeout_ms)
+// ------------------------------------------------------------------------------------------------
+{
+    cc1101_sim_init(NULL);
+
+    memset(&spi_parms, 0, sizeof(spi_parms));
+    memset(&radio_parms, 0, sizeof(radio_parms));
+    set_freq_parameters(433e6, 304e3, 0, &radio_parms);
+    set_sync_parameters(PREAMBLE_4, SYNC_30_over_32, timeout_ms, &radio_parms);
+    set_packet_parameters(packet_length, false, false, &radio_parms);
+    set_packet_length_mode(length_mode, &radio_parms);
+    set_modulation_parameters(RADIO_MOD_GFSK, RATE_115200, 0.5, &radio_parms);
+    init_radio_config(&spi_parms, &radio_parms);
+
+    cc1101_sim_attach_radio(cc1101_sim_default(), &radio_int_data);
+    enable_isr_routine(&radio_int_data, &spi_parms, &radio_parms);
+    cc1101_sim_set_tx_sink(cc1101_sim_default(), tx_sink, NULL);
+    cc1101_sim_run_for(2000000);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Run radio_tx_process() until the ticket is settled
+static radio_tx_status_t tx_wait(uint32_t ticket)
+// ------------------------------------------------------------------------------------------------
+{
+    int i;
+
+    for (i = 0; i < 2000 && radio_tx_status(&radio_int_data, ticket) == RADIO_TX_PENDING; i++)
+    {
+        radio_tx_process(&radio_int_data);
+        cc1101_sim_sleep_us(1000);
+    }
+
+    return radio_tx_status(&radio_int_data, ticket);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Sent, refused when too long, unknown tickets
+static void test_sent(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  frame[255];
+    uint32_t i, ticket, refused = 0xFFFF;
+    radio_stats_t stats;
+
+    for (i = 0; i < sizeof(frame); i++)
+    {
+        frame[i] = (uint8_t) (i * 3);
+    }
+
+    setup(PACKET_LENGTH_VARIABLE, 255, 500);
+    check(radio_tx_status(&radio_int_data, 0) == RADIO_TX_UNKNOWN, "ticket not issued", 0);
+    check(radio_tx_enqueue(&radio_int_data, frame, 100, &ticket) == 0, "enqueue", 100);
+    check(tx_wait(ticket) == RADIO_TX_SENT, "sent", ticket);
+    check(sent_len == 101 && sent[0] == 100 && memcmp(sent + 1, frame, 100) == 0, "on air intact", sent_len);
+
+    check(radio_tx_enqueue(&radio_int_data, frame, 255, &refused) == 1, "no room for length byte", 255);
+    check(refused == 0xFFFF && radio_int_data.tx_queue.head == ticket + 1, "nothing queued", refused);
+
+    for (i = 0; i < CC11xx_TX_QUEUE_DEPTH; i++)
+    {
+        radio_tx_enqueue(&radio_int_data, frame, 10, NULL);
+        cc1101_sim_run_for(20000000);
+    }
+    check(radio_tx_status(&radio_int_data, ticket) == RADIO_TX_UNKNOWN, "ticket too old", ticket);
+    radio_get_stats(&radio_int_data, &stats);
+    check(stats.tx_packets == 1 + CC11xx_TX_QUEUE_DEPTH, "frames counted", stats.tx_packets);
+
+    setup(PACKET_LENGTH_FIXED, 20, 500);
+    check(radio_tx_enqueue(&radio_int_data, frame, 21, NULL) == 1, "fixed: longer refused", 21);
+    sent_len = 0;
+    check(radio_tx_enqueue(&radio_int_data, frame, 10, &ticket) == 0, "fixed: shorter", 10);
+    i = (tx_wait(ticket) == RADIO_TX_SENT);
+    check(i && sent_len == 20 && memcmp(sent, frame, 10) == 0 && sent[10] == 0 && sent[19] == 0, "fixed: padded", sent_len);
+}
+
+// ------------------------------------------------------------------------------------------------
+// TX FIFO left to drain with the interrupts masked
+static void test_underflow(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  frame[200];
+    uint32_t i, ticket;
+    radio_stats_t stats;
+
+    memset(frame, 0x5A, sizeof(frame));
+    setup(PACKET_LENGTH_VARIABLE, 255, 500);
+    radio_tx_enqueue(&radio_int_data, frame, sizeof(frame), &ticket);
+    for (i = 0; (i < 2000) && !radio_int_data.packet_send; i++)
+    {
+        radio_tx_process(&radio_int_data);
+        cc1101_sim_sleep_us(100);
+    }
+    cc1101_sim_it_disable(); // Sync word out, no refill from here
+    cc1101_sim_run_for(30000000);
+    cc1101_sim_it_enable();
+    check(tx_wait(ticket) == RADIO_TX_UNDERFLOW, "underflow", ticket);
+    radio_get_stats(&radio_int_data, &stats);
+    check(stats.tx_underflows == 1, "underflow counted", stats.tx_underflows);
+
+    check(radio_tx_enqueue(&radio_int_data, frame, 20, &ticket) == 0, "enqueue after underflow", 20);
+    i = (tx_wait(ticket) == RADIO_TX_SENT);
+    check(i && sent_len == 21, "sent after underflow", sent_len);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Frames still waiting for a long reception when their deadline passes
+static void test_timeout(void)
+// ------------------------------------------------------------------------------------------------
+{
+    uint8_t  frame[255], packet[255];
+    uint8_t  length = 0;
+    uint32_t i, first, second;
+    radio_stats_t stats;
+
+    for (i = 0; i < sizeof(frame); i++)
+    {
+        frame[i] = (uint8_t) i;
+    }
+    frame[0] = 254;
+
+    setup(PACKET_LENGTH_VARIABLE, 255, 5);
+    cc1101_sim_inject(cc1101_sim_default(), frame, 255, 0, -50, true);
+    cc1101_sim_run_for(3000000); // Past the sync word, 18 ms of packet left
+    check(radio_tx_enqueue(&radio_int_data, frame, 20, &first) == 0, "enqueue while receiving", 20);
+    check(radio_tx_enqueue(&radio_int_data, frame, 20, &second) == 0, "enqueue while receiving", 20);
+    check(tx_wait(first) == RADIO_TX_TIMEOUT, "timeout", first);
+    check(tx_wait(second) == RADIO_TX_TIMEOUT, "timeout", second);
+    radio_get_stats(&radio_int_data, &stats);
+    check(stats.tx_timeouts == 2, "timeouts counted", stats.tx_timeouts);
+    cc1101_sim_run_for(30000000);
+    i = (radio_receive_packet(&radio_int_data, packet, &length, NULL) == 0);
+    check(i && (length == 254) && (memcmp(packet, frame + 1, 254) == 0), "packet received", length);
+}
+
+// ------------------------------------------------------------------------------------------------
+int main(void)
+// ------------------------------------------------------------------------------------------------
+{
+    test_sent();
+    test_underflow();
+    test_timeout();
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}